@@ -1,6 +1,7 @@
+#define LUAC_CROSS_FILE
 #include "cjson_mem.h"
 #include "../lua/lauxlib.h"
-#include <c_stdlib.h>
+#include C_HEADER_STDLIB
 
 static const char errfmt[] = "cjson %salloc: out of mem (%d bytes)";
 
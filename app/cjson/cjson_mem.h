@@ -2,6 +2,9 @@
 #define _CJSON_MEM_H_
 
 #include "../lua/lua.h"
+#ifdef LUA_CROSS_COMPILER
+#include <stdint.h>
+#endif
 
 void *cjson_mem_malloc (uint32_t sz);
 void *cjson_mem_realloc (void *p, uint32_t sz);
@@ -22,10 +22,10 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#include "c_stdio.h"
-#include "c_stdlib.h"
-#include "c_stdarg.h"
-#include "c_string.h"
+#include "../lua/luac_cross.h"
+#include C_HEADER_STDIO
+#include C_HEADER_STDLIB
+#include C_HEADER_STRING
 
 #include "strbuf.h"
 #include "cjson_mem.h"
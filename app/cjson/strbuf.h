@@ -22,8 +22,14 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#include "c_stdlib.h"
+#include "../lua/luac_cross.h"
+#include C_HEADER_STDLIB
+#include C_HEADER_STRING
+#ifdef LUA_CROSS_COMPILER
+#include <stdarg.h>
+#else
 #include "c_stdarg.h"
+#endif
 #include "user_config.h"
 
 /* Size: Total bytes allocated to *buf
@@ -48,12 +48,13 @@
  * ends up looking either like XYZ_module_enabled, or if not enabled,
  * XYZ_module_enabledLUA_USE_MODULES_XYZ.  This forms the basis for
  * letting the build system detect automatically (via nm) which modules need
- * to be linked in.
+ * to be linked in.  The table goes in a section named after the module, so
+ * that the linker sorts lua_rotable[] by name for luaR_findglobal().
  */
 #define NODEMCU_MODULE(cfgname, luaname, map, initfunc) \
   const LOCK_IN_SECTION(".lua_libs") \
     luaL_Reg MODULE_PASTE_(lua_lib_,cfgname) = { luaname, initfunc }; \
-  const LOCK_IN_SECTION(".lua_rotable") \
+  const LOCK_IN_SECTION(".lua_rotable." luaname) \
     luaR_table MODULE_EXPAND_PASTE_(cfgname,MODULE_EXPAND_PASTE_(_module_selected,MODULE_PASTE_(LUA_USE_MODULES_,cfgname))) \
     = { luaname, map }
 
@@ -64,7 +65,7 @@
     luaL_Reg MODULE_PASTE_(lua_lib_,name) = { luaname, initfunc }
 
 #define BUILTIN_LIB(name, luaname, map) \
-  const LOCK_IN_SECTION(".lua_rotable") \
+  const LOCK_IN_SECTION(".lua_rotable." luaname) \
     luaR_table MODULE_PASTE_(lua_rotable_,name) = { luaname, map }
 
 #if !defined(LUA_CROSS_COMPILER) && !(MIN_OPT_LEVEL==2 && LUA_OPTIMIZE_MEMORY==2)
@@ -97,6 +97,27 @@ extern void luaL_assertfail(const char *file, int line, const char *message);
 #define LUA_PROCESS_LINE_SIG 2
 #define LUA_OPTIMIZE_DEBUG      2
 
+// Have node.compile() optimize bytecode as "luac.cross -O" does: hoist ROM
+// module lookups out of loops, thread jumps and drop dead code.
+// #define LUA_OPTIMIZE_BYTECODE
+
+// Reserve this many bytes of mapped flash for the Lua Flash Store, which holds
+// modules precompiled with "luac.cross -f" and runs them without copying
+// their code into RAM. Must be a multiple of the 4Kb flash sector size.
+// Note that enabling or resizing it moves the SPIFFS partition.
+// #define LUA_FLASH_STORE         0x10000
+
+// Reserve this many bytes of mapped flash for tables frozen into rotables by
+// node.freeze(). The store is erased by the first freeze after each boot.
+// Must be a multiple of the 4Kb flash sector size.
+// #define LUA_FREEZE_STORE        0x2000
+
+// Allocate the Lua heap from an arena of this many bytes, taken from the
+// system heap at startup and managed by a TLSF allocator (app/lua/lalloc.c).
+// This keeps Lua churn from fragmenting the SDK heap. Allocations that don't
+// fit spill into the system heap; see node.meminfo().
+// #define LUA_ALLOC_ARENA         (24*1024)
+
 #define ENDUSER_SETUP_AP_SSID "SetupGadget"
 
 /*
@@ -21,7 +21,9 @@
 //#define LUA_USE_MODULES_ADXL345
 //#define LUA_USE_MODULES_AM2320
 //#define LUA_USE_MODULES_APA102
+//#define LUA_USE_MODULES_ARRAY
 #define LUA_USE_MODULES_BIT
+//#define LUA_USE_MODULES_BUFFER
 //#define LUA_USE_MODULES_BMP085
 //#define LUA_USE_MODULES_BME280
 //#define LUA_USE_MODULES_CJSON
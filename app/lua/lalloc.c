@@ -0,0 +1,286 @@
+/*
+** Lua heap arena: a TLSF allocator for the Lua heap
+** See Copyright Notice in lua.h
+*/
+
+#define lalloc_c
+#define LUA_CORE
+#define LUAC_CROSS_FILE
+
+#include "lua.h"
+#include C_HEADER_STDLIB
+#include C_HEADER_STRING
+
+#include "lalloc.h"
+
+#ifdef LUA_ALLOC_ARENA
+
+/*
+** The arena is a single block taken from the system heap by lalloc_init()
+** at boot, before the SDK and the network stack have fragmented it; builds
+** that don't call lalloc_init() take it on the first Lua allocation.  It
+** is managed as a two level segregated fit (TLSF) heap:
+** free blocks are kept on lists indexed by size class, and two levels of
+** bitmaps find the smallest non-empty class that fits a request, so both
+** malloc and free take constant time.  Free neighbours are merged at once,
+** which keeps the largest free block stable under long-running churn.
+**
+** Below SMALL_BLOCK the classes are exactly ALIGN bytes apart, so the
+** common GCObject sizes (string headers, tables, closures, upvalues) each
+** have their own exact-fit list, as in a slab allocator.
+**
+** If the arena can't satisfy a request, it is passed on to the system heap
+** and counted as spilled.
+*/
+
+#define ALIGN_LOG2    3
+#define ALIGN         (1 << ALIGN_LOG2)
+#define SL_LOG2       3                   /* 8 classes per power of two */
+#define SL_COUNT      (1 << SL_LOG2)
+#define FL_SHIFT      (SL_LOG2 + ALIGN_LOG2)
+#define SMALL_BLOCK   (1 << FL_SHIFT)
+#define FL_MAX        17                  /* blocks are below 128Kb */
+#define FL_COUNT      (FL_MAX - FL_SHIFT + 1)
+
+#if LUA_ALLOC_ARENA >= (1 << FL_MAX)
+#error "LUA_ALLOC_ARENA is too large"
+#endif
+
+typedef struct Block {
+  struct Block *prev_phys;   /* physically previous block, NULL for the first */
+  size_t size;               /* payload size, with BLOCK_FREE in bit 0 */
+  struct Block *next_free;   /* free list links: only valid in free blocks, */
+  struct Block *prev_free;   /* and otherwise part of the payload */
+} Block;
+
+#define BLOCK_FREE    1
+#define HEADER        offsetof(Block, next_free)
+#define MIN_PAYLOAD   (sizeof(Block) - HEADER)
+
+#define bsize(b)      ((b)->size & ~(size_t)(ALIGN-1))
+#define isfree(b)     ((b)->size & BLOCK_FREE)
+#define payload(b)    ((void *)((char *)(b) + HEADER))
+#define fromptr(p)    ((Block *)((char *)(p) - HEADER))
+#define nextphys(b)   ((Block *)((char *)payload(b) + bsize(b)))
+#define inarena(p)    ((char *)(p) >= arena.base && (char *)(p) < arena.end)
+
+static struct {
+  char *base, *end;              /* the arena, ending with a sentinel header */
+  unsigned fl_map;               /* bit fl set if sl_map[fl] != 0 */
+  unsigned sl_map[FL_COUNT];     /* bit sl set if free[fl][sl] != NULL */
+  Block *free[FL_COUNT][SL_COUNT];
+  size_t spilled;
+  int failed;                    /* the arena couldn't be allocated */
+} arena;
+
+static int bit_fls (size_t x) {
+  return 31 - __builtin_clz((unsigned) x);
+}
+
+static int bit_ffs (unsigned x) {
+  return __builtin_ctz(x);
+}
+
+static void mapping (size_t size, int *fl, int *sl) {
+  if (size < SMALL_BLOCK) {
+    *fl = 0;
+    *sl = size >> ALIGN_LOG2;
+  }
+  else {
+    int f = bit_fls(size);
+    *sl = (size >> (f - SL_LOG2)) ^ SL_COUNT;
+    *fl = f - FL_SHIFT + 1;
+  }
+}
+
+static void insert_free (Block *b) {
+  int fl, sl;
+  mapping(bsize(b), &fl, &sl);
+  b->size |= BLOCK_FREE;
+  b->prev_free = NULL;
+  b->next_free = arena.free[fl][sl];
+  if (b->next_free)
+    b->next_free->prev_free = b;
+  arena.free[fl][sl] = b;
+  arena.fl_map |= 1U << fl;
+  arena.sl_map[fl] |= 1U << sl;
+}
+
+static void remove_free (Block *b) {
+  int fl, sl;
+  mapping(bsize(b), &fl, &sl);
+  if (b->next_free)
+    b->next_free->prev_free = b->prev_free;
+  if (b->prev_free)
+    b->prev_free->next_free = b->next_free;
+  else if ((arena.free[fl][sl] = b->next_free) == NULL) {
+    arena.sl_map[fl] &= ~(1U << sl);
+    if (arena.sl_map[fl] == 0)
+      arena.fl_map &= ~(1U << fl);
+  }
+  b->size &= ~(size_t)BLOCK_FREE;
+}
+
+/* Absorb the physically next block, which must be free, into b */
+static void absorb (Block *b) {
+  Block *next = nextphys(b);
+  remove_free(next);
+  b->size += HEADER + bsize(next);
+  nextphys(b)->prev_phys = b;
+}
+
+/* Return a block to the free lists, merging it with free neighbours */
+static void release (Block *b) {
+  if (isfree(nextphys(b)))
+    absorb(b);
+  if (b->prev_phys && isfree(b->prev_phys)) {
+    Block *prev = b->prev_phys;
+    remove_free(prev);
+    prev->size += HEADER + bsize(b);
+    nextphys(prev)->prev_phys = prev;
+    b = prev;
+  }
+  insert_free(b);
+}
+
+/* Cut an in-use block down to size, releasing the remainder if usable */
+static void trim (Block *b, size_t size) {
+  if (bsize(b) >= size + sizeof(Block)) {
+    Block *rest = (Block *)((char *)payload(b) + size);
+    rest->size = bsize(b) - size - HEADER;
+    rest->prev_phys = b;
+    nextphys(rest)->prev_phys = rest;
+    b->size = size;
+    release(rest);
+  }
+}
+
+static size_t adjust (size_t n) {
+  return n < MIN_PAYLOAD ? MIN_PAYLOAD : (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+static void *arena_malloc (size_t n) {
+  size_t size, r;
+  unsigned map;
+  int fl, sl;
+  Block *b;
+  if (n >= LUA_ALLOC_ARENA)  /* can't fit, and adjust() could overflow */
+    return NULL;
+  size = r = adjust(n);
+  if (r >= SMALL_BLOCK)  /* round up so that any block in the class fits */
+    r += (1U << (bit_fls(r) - SL_LOG2)) - 1;
+  mapping(r, &fl, &sl);
+  if (fl >= FL_COUNT)
+    return NULL;
+  map = arena.sl_map[fl] & (~0U << sl);
+  if (map == 0) {
+    map = arena.fl_map & (~0U << (fl + 1));
+    if (map == 0)
+      return NULL;
+    fl = bit_ffs(map);
+    map = arena.sl_map[fl];
+  }
+  b = arena.free[fl][bit_ffs(map)];
+  remove_free(b);
+  trim(b, size);
+  return payload(b);
+}
+
+/* Resize a block in place, or return NULL if it has to move */
+static void *arena_resize (void *p, size_t n) {
+  Block *b = fromptr(p);
+  size_t size;
+  if (n >= LUA_ALLOC_ARENA)
+    return NULL;
+  size = adjust(n);
+  if (size > bsize(b)) {
+    Block *next = nextphys(b);
+    if (!isfree(next) || bsize(b) + HEADER + bsize(next) < size)
+      return NULL;
+    absorb(b);
+  }
+  trim(b, size);
+  return p;
+}
+
+static int arena_init (void) {
+  char *mem;
+  Block *b, *sentinel;
+  if (arena.failed || (mem = (char *)c_malloc(LUA_ALLOC_ARENA)) == NULL) {
+    arena.failed = 1;
+    return 0;
+  }
+  arena.base = (char *)(((size_t)mem + ALIGN - 1) & ~(size_t)(ALIGN - 1));
+  arena.end = (char *)(((size_t)mem + LUA_ALLOC_ARENA) & ~(size_t)(ALIGN - 1));
+  b = (Block *)arena.base;
+  b->prev_phys = NULL;
+  b->size = arena.end - arena.base - 2 * HEADER;
+  sentinel = nextphys(b);
+  sentinel->prev_phys = b;
+  sentinel->size = 0;  /* in use, so it is never merged */
+  insert_free(b);
+  return 1;
+}
+
+void lalloc_init (void) {
+  if (arena.base == NULL)
+    arena_init();
+}
+
+static void *spill (size_t n) {
+  void *p = c_malloc(n);
+  if (p)
+    arena.spilled++;
+  return p;
+}
+
+void *lalloc_realloc (void *ptr, size_t osize, size_t nsize) {
+  void *p;
+  if ((arena.base == NULL && !arena_init()) || (ptr != NULL && !inarena(ptr))) {
+    if (nsize == 0) {
+      c_free(ptr);
+      return NULL;
+    }
+    return c_realloc(ptr, nsize);
+  }
+  if (nsize == 0) {
+    if (ptr)
+      release(fromptr(ptr));
+    return NULL;
+  }
+  if (ptr == NULL)
+    return (p = arena_malloc(nsize)) != NULL ? p : spill(nsize);
+  if ((p = arena_resize(ptr, nsize)) != NULL)
+    return p;
+  if ((p = arena_malloc(nsize)) == NULL && (p = spill(nsize)) == NULL)
+    return NULL;
+  c_memcpy(p, ptr, osize < nsize ? osize : nsize);
+  release(fromptr(ptr));
+  return p;
+}
+
+void lalloc_getstats (lalloc_stats *st) {
+  Block *b;
+  int i;
+  st->size = st->used = st->free = st->largest = st->nfree = 0;
+  st->spilled = arena.spilled;
+  for (i = 0; i < LALLOC_BUCKETS; i++)
+    st->histogram[i] = 0;
+  if (arena.base == NULL)
+    return;
+  st->size = arena.end - arena.base;
+  for (b = (Block *)arena.base; bsize(b) != 0; b = nextphys(b)) {
+    if (isfree(b)) {
+      st->free += bsize(b);
+      st->nfree++;
+      i = bsize(b) < 32 ? 0 : bit_fls(bsize(b)) - 4;
+      st->histogram[i < LALLOC_BUCKETS ? i : LALLOC_BUCKETS - 1]++;
+      if (bsize(b) > st->largest)
+        st->largest = bsize(b);
+    }
+    else
+      st->used += HEADER + bsize(b);
+  }
+}
+
+#endif
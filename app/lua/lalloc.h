@@ -0,0 +1,30 @@
+/*
+** Lua heap arena: a TLSF allocator for the Lua heap
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lalloc_h
+#define lalloc_h
+
+#include "lua.h"
+
+/* Free block histogram: bucket i counts blocks of 16<<i up to (32<<i)-1
+** bytes, except that the first also counts smaller blocks and the last
+** larger ones */
+#define LALLOC_BUCKETS 12
+
+typedef struct {
+  size_t size;       /* bytes in the arena, 0 if it isn't in use */
+  size_t used;       /* bytes handed out, including block headers */
+  size_t free;       /* bytes in free blocks */
+  size_t largest;    /* largest block that can be allocated */
+  size_t nfree;      /* number of free blocks */
+  size_t spilled;    /* allocations that had to fall back to the system heap */
+  unsigned histogram[LALLOC_BUCKETS];
+} lalloc_stats;
+
+void lalloc_init(void);
+void *lalloc_realloc(void *ptr, size_t osize, size_t nsize);
+void lalloc_getstats(lalloc_stats *st);
+
+#endif
@@ -32,6 +32,7 @@
 #include "lobject.h"
 #include "lstate.h"
 #include "legc.h"
+#include "lalloc.h"
 
 #define FREELIST_REF	0	/* free list of references */
 
@@ -158,6 +159,92 @@ LUALIB_API void *luaL_checkudata (lua_State *L, int ud, const char *tname) {
 }
 
 
+LUALIB_API luaL_Bytes *luaL_tobytes (lua_State *L, int narg) {
+  luaL_Bytes *b = (luaL_Bytes *)lua_touserdata(L, narg);
+  if (b != NULL && lua_getmetatable(L, narg)) {
+    lua_getfield(L, LUA_REGISTRYINDEX, LUA_BUFFERHANDLE);
+    if (!lua_rawequal(L, -1, -2))
+      b = NULL;
+    lua_pop(L, 2);
+    return b;
+  }
+  return NULL;
+}
+
+
+LUALIB_API const char *luaL_checkbytes (lua_State *L, int narg, size_t *len) {
+  luaL_Bytes *b = luaL_tobytes(L, narg);
+  if (b != NULL) {
+    if (len) *len = b->len;
+    return b->data;
+  }
+  if (!lua_isstring(L, narg)) {
+    const char *msg = lua_pushfstring(L, "string or buffer expected, got %s",
+                                      luaL_typename(L, narg));
+    luaL_argerror(L, narg, msg);
+  }
+  return lua_tolstring(L, narg, len);
+}
+
+/*
+** A C function called from Lua code in a coroutine can yield; one called
+** from the main thread, or through pcall() or a metamethod, cannot.
+*/
+LUALIB_API int luaL_canyield (lua_State *L) {
+  return L->nCcalls <= L->baseCcalls;
+}
+
+
+LUALIB_API void luaL_checkyieldable (lua_State *L) {
+  if (!luaL_canyield(L))
+    luaL_error(L, L == G(L)->mainthread ? "not called from a coroutine" :
+                  "attempt to yield across metamethod/C-call boundary");
+}
+
+
+/*
+** Suspend the running coroutine in a wait.  The wait gets a new token,
+** stored in *token for the wake-up and left on the stack just below the
+** yield, in the frame of the waiting C function.  That frame goes when
+** other code resumes the coroutine, and luaL_waiting() then tells the
+** wake-up to leave the coroutine be.
+*/
+static unsigned waitcount = 0;
+
+LUALIB_API int luaL_yieldwait (lua_State *L, int *token) {
+  if (++waitcount == 0)  /* wrapped around; 0 is never a token */
+    waitcount = 1;
+  *token = (int)waitcount;
+  lua_pushlightuserdata(L, (void *)(size_t)waitcount);
+  return lua_yield(L, 0);
+}
+
+
+LUALIB_API int luaL_waiting (lua_State *co, int token) {
+  const TValue *mark;
+  if (co == NULL || co->status != LUA_YIELD || co->top != co->base)
+    return 0;
+  mark = co->base - 1;
+  return ttislightuserdata(mark) && pvalue(mark) == (void *)(size_t)(unsigned)token;
+}
+
+
+/*
+** Resume co with the nargs values on top of L.  An error in co is raised
+** in L, as an error in a callback is.
+*/
+LUALIB_API int luaL_resume (lua_State *L, lua_State *co, int nargs) {
+  int status;
+  lua_xmove(L, co, nargs);
+  status = lua_resume(co, nargs);
+  if (status != 0 && status != LUA_YIELD) {
+    lua_xmove(co, L, 1);  /* error message */
+    lua_error(L);
+  }
+  return status;
+}
+
+
 LUALIB_API void luaL_checkstack (lua_State *L, int space, const char *mes) {
   if (!lua_checkstack(L, space))
     luaL_error(L, "stack overflow (%s)", mes);
@@ -445,53 +532,98 @@ LUALIB_API const char *luaL_findtable (lua_State *L, int idx,
 */
 
 
-#define bufflen(B)	((B)->p - (B)->buffer)
-#define bufffree(B)	((size_t)(LUAL_BUFFERSIZE - bufflen(B)))
-
-#define LIMIT	(LUA_MINSTACK/2)
+/*
+** A buffer that outgrows B->buffer moves to a block on the heap, held by
+** a userdata box on the stack.  The block is grown with realloc, which
+** frees the old block at once rather than leaving it to the collector,
+** and the box's __gc frees the block if an error unwinds the stack.
+*/
+typedef struct UBox {
+  void *box;
+  size_t bsize;
+} UBox;
 
 
-static int emptybuffer (luaL_Buffer *B) {
-  size_t l = bufflen(B);
-  if (l == 0) return 0;  /* put nothing on stack */
-  else {
-    lua_pushlstring(B->L, B->buffer, l);
-    B->p = B->buffer;
-    B->lvl++;
-    return 1;
+static void *resizebox (lua_State *L, int idx, size_t newsize) {
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  UBox *box = (UBox *)lua_touserdata(L, idx);
+  void *temp = allocf(ud, box->box, box->bsize, newsize);
+  if (temp == NULL && newsize > 0) {  /* allocation error? */
+    resizebox(L, idx, 0);  /* free buffer */
+    luaL_error(L, "not enough memory for buffer allocation");
   }
+  box->box = temp;
+  box->bsize = newsize;
+  return temp;
 }
 
 
-static void adjuststack (luaL_Buffer *B) {
-  if (B->lvl > 1) {
-    lua_State *L = B->L;
-    int toget = 1;  /* number of levels to concat */
-    size_t toplen = lua_strlen(L, -1);
-    do {
-      size_t l = lua_strlen(L, -(toget+1));
-      if (B->lvl - toget + 1 >= LIMIT || toplen > l) {
-        toplen += l;
-        toget++;
-      }
-      else break;
-    } while (toget < B->lvl);
-    lua_concat(L, toget);
-    B->lvl = B->lvl - toget + 1;
+static int boxgc (lua_State *L) {
+  resizebox(L, 1, 0);
+  return 0;
+}
+
+
+#ifdef LUA_META_ROTABLES
+static const luaR_entry boxmt[] = {
+  {LRO_STRKEY("__gc"), LRO_FUNCVAL(boxgc)},
+  {LRO_NILKEY, LRO_NILVAL}
+};
+#endif
+
+
+static void *newbox (lua_State *L, size_t newsize) {
+  UBox *box = (UBox *)lua_newuserdata(L, sizeof(UBox));
+  box->box = NULL;
+  box->bsize = 0;
+#ifdef LUA_META_ROTABLES
+  lua_pushrotable(L, (void *)boxmt);
+#else
+  if (luaL_newmetatable(L, "_UBOX*")) {  /* only a table can be a metatable */
+    lua_pushcfunction(L, boxgc);
+    lua_setfield(L, -2, "__gc");
   }
+#endif
+  lua_setmetatable(L, -2);
+  return resizebox(L, -1, newsize);
 }
 
 
-LUALIB_API char *luaL_prepbuffer (luaL_Buffer *B) {
-  if (emptybuffer(B))
-    adjuststack(B);
-  return B->buffer;
+/* is the buffer in a box on the stack? */
+#define buffonstack(B)	((B)->b != (B)->buffer)
+
+
+/*
+** make room for sz more characters, doubling the buffer while it is too
+** small; the box must be on the top of the stack
+*/
+LUALIB_API char *luaL_prepbuffsize (luaL_Buffer *B, size_t sz) {
+  lua_State *L = B->L;
+  if (B->size - B->n < sz) {  /* not enough space? */
+    char *newbuff;
+    size_t newsize = B->size * 2;
+    if (MAX_SIZET - sz < B->n)  /* overflow? */
+      luaL_error(L, "buffer too large");
+    if (newsize - B->n < sz)  /* doubling not enough? */
+      newsize = B->n + sz;
+    if (buffonstack(B))
+      newbuff = (char *)resizebox(L, -1, newsize);
+    else {  /* move from the C stack to a box */
+      newbuff = (char *)newbox(L, newsize);
+      c_memcpy(newbuff, B->b, B->n);
+    }
+    B->b = newbuff;
+    B->size = newsize;
+  }
+  return &B->b[B->n];
 }
 
 
 LUALIB_API void luaL_addlstring (luaL_Buffer *B, const char *s, size_t l) {
-  while (l--)
-    luaL_addchar(B, *s++);
+  char *b = luaL_prepbuffsize(B, l);
+  c_memcpy(b, s, l);
+  luaL_addsize(B, l);
 }
 
 
@@ -501,34 +633,31 @@ LUALIB_API void luaL_addstring (luaL_Buffer *B, const char *s) {
 
 
 LUALIB_API void luaL_pushresult (luaL_Buffer *B) {
-  emptybuffer(B);
-  lua_concat(B->L, B->lvl);
-  B->lvl = 1;
+  lua_State *L = B->L;
+  lua_pushlstring(L, B->b, B->n);
+  if (buffonstack(B)) {
+    resizebox(L, -2, 0);  /* free the block now */
+    lua_remove(L, -2);  /* remove the box */
+  }
 }
 
 
 LUALIB_API void luaL_addvalue (luaL_Buffer *B) {
   lua_State *L = B->L;
-  size_t vl;
-  const char *s = lua_tolstring(L, -1, &vl);
-  if (vl <= bufffree(B)) {  /* fit into buffer? */
-    c_memcpy(B->p, s, vl);  /* put it there */
-    B->p += vl;
-    lua_pop(L, 1);  /* remove from stack */
-  }
-  else {
-    if (emptybuffer(B))
-      lua_insert(L, -2);  /* put buffer before new value */
-    B->lvl++;  /* add new value into B stack */
-    adjuststack(B);
-  }
+  size_t l;
+  const char *s = lua_tolstring(L, -1, &l);
+  if (buffonstack(B))
+    lua_insert(L, -2);  /* put value below buffer */
+  luaL_addlstring(B, s, l);
+  lua_remove(L, (buffonstack(B)) ? -2 : -1);  /* remove value */
 }
 
 
 LUALIB_API void luaL_buffinit (lua_State *L, luaL_Buffer *B) {
   B->L = L;
-  B->p = B->buffer;
-  B->lvl = 0;
+  B->b = B->buffer;
+  B->size = LUAL_BUFFERSIZE;
+  B->n = 0;
 }
 
 /* }====================================================== */
@@ -587,6 +716,8 @@ typedef struct LoadF {
 static const char *getF (lua_State *L, void *ud, size_t *size) {
   LoadF *lf = (LoadF *)ud;
   (void)L;
+  if (L == NULL && size == NULL) // Direct mode check
+    return NULL;
   if (lf->extraline) {
     lf->extraline = 0;
     *size = 1;
@@ -769,7 +900,14 @@ static int l_check_memlimit(lua_State *L, size_t needbytes) {
   /* don't allow allocation if it requires more memory then the total limit. */
   if (needbytes > g->memlimit) return 1;
   /* make sure the GC is not disabled. */
-  if (!is_block_gc(L)) {
+  if (!is_block_gc(L) && isgenerational(g)) {
+    /* a minor collection, then a major one if that was not enough. */
+    if (g->totalbytes >= limit)
+      luaC_step(L);
+    if (g->totalbytes >= limit)
+      luaC_fullgc(L);
+  }
+  else if (!is_block_gc(L)) {
     while (g->totalbytes >= limit) {
       /* only allow the GC to finished atleast 1 full cycle. */
       if (g->gcstate == GCSpause && ++cycle_count > 1) break;
@@ -780,13 +918,21 @@ static int l_check_memlimit(lua_State *L, size_t needbytes) {
 }
 
 
+#ifdef LUA_ALLOC_ARENA
+#define l_free(p, os)         lalloc_realloc((p), (os), 0)
+#define l_realloc(p, os, ns)  lalloc_realloc((p), (os), (ns))
+#else
+#define l_free(p, os)         c_free(p)
+#define l_realloc(p, os, ns)  c_realloc((p), (ns))
+#endif
+
 static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
   lua_State *L = (lua_State *)ud;
   int mode = L == NULL ? 0 : G(L)->egcmode;
   void *nptr;
 
   if (nsize == 0) {
-    c_free(ptr);
+    l_free(ptr, osize);
     return NULL;
   }
   if (L != NULL && (mode & EGC_ALWAYS)) /* always collect memory if requested */
@@ -798,10 +944,10 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
     if(G(L)->memlimit > 0 && (mode & EGC_ON_MEM_LIMIT) && l_check_memlimit(L, nsize - osize))
       return NULL;
   }
-  nptr = (void *)c_realloc(ptr, nsize);
+  nptr = (void *)l_realloc(ptr, osize, nsize);
   if (nptr == NULL && L != NULL && (mode & EGC_ON_ALLOC_FAILURE)) {
     luaC_fullgc(L); /* emergency full collection. */
-    nptr = (void *)c_realloc(ptr, nsize); /* try allocation again */
+    nptr = (void *)l_realloc(ptr, osize, nsize); /* try allocation again */
   }
   return nptr;
 }
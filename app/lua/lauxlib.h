@@ -73,6 +73,36 @@ LUALIB_API int   (luaL_newmetatable) (lua_State *L, const char *tname);
 LUALIB_API int   (luaL_rometatable) (lua_State *L, const char* tname, void *p);
 LUALIB_API void *(luaL_checkudata) (lua_State *L, int ud, const char *tname);
 
+/*
+** NodeMCU: the mutable byte buffers of the buffer module.  C functions that
+** take binary data use luaL_checkbytes() to accept a buffer as well as a
+** string, and then read it in place.
+*/
+#define LUA_BUFFERHANDLE	"buffer"
+
+typedef struct luaL_Bytes {
+  char *data;  /* the bytes: in this userdata, or in the one it is a view of */
+  size_t len;
+  int ref;  /* a view: reference to the buffer that holds the bytes */
+} luaL_Bytes;
+
+LUALIB_API luaL_Bytes *(luaL_tobytes) (lua_State *L, int narg);
+LUALIB_API const char *(luaL_checkbytes) (lua_State *L, int narg, size_t *l);
+
+/*
+** NodeMCU: C functions that wait for an event in a coroutine.  Such a
+** function calls luaL_checkyieldable() (or tests luaL_canyield()) before it
+** sets anything up, and ends with return luaL_yieldwait(L, &token).  The
+** C callback of the event checks luaL_waiting(co, token), since other code
+** may have resumed the coroutine, and then resumes it with luaL_resume().
+** The values it passes are the results of the function.
+*/
+LUALIB_API int (luaL_canyield) (lua_State *L);
+LUALIB_API void (luaL_checkyieldable) (lua_State *L);
+LUALIB_API int (luaL_yieldwait) (lua_State *L, int *token);
+LUALIB_API int (luaL_waiting) (lua_State *co, int token);
+LUALIB_API int (luaL_resume) (lua_State *L, lua_State *co, int nargs);
+
 LUALIB_API void (luaL_where) (lua_State *L, int lvl);
 LUALIB_API int (luaL_error) (lua_State *L, const char *fmt, ...);
 
@@ -143,24 +173,32 @@ LUALIB_API void luaL_assertfail(const char *file, int line, const char *message)
 
 
 
+/*
+** The first LUAL_BUFFERSIZE bytes are kept on the C stack.  A longer
+** string moves to a heap block held on the Lua stack, which doubles in
+** size as needed, so that it isn't concatenated from many pieces.
+*/
 typedef struct luaL_Buffer {
-  char *p;			/* current position in buffer */
-  int lvl;  /* number of strings in the stack (level) */
+  char *b;  /* buffer address: 'buffer' or a block on the heap */
+  size_t size;  /* buffer size */
+  size_t n;  /* number of characters in buffer */
   lua_State *L;
   char buffer[LUAL_BUFFERSIZE];
 } luaL_Buffer;
 
 #define luaL_addchar(B,c) \
-  ((void)((B)->p < ((B)->buffer+LUAL_BUFFERSIZE) || luaL_prepbuffer(B)), \
-   (*(B)->p++ = (char)(c)))
+  ((void)((B)->n < (B)->size || luaL_prepbuffsize((B), 1)), \
+   ((B)->b[(B)->n++] = (char)(c)))
 
 /* compatibility only */
 #define luaL_putchar(B,c)	luaL_addchar(B,c)
 
-#define luaL_addsize(B,n)	((B)->p += (n))
+#define luaL_addsize(B,s)	((B)->n += (s))
+
+#define luaL_prepbuffer(B)	luaL_prepbuffsize(B, LUAL_BUFFERSIZE)
 
 LUALIB_API void (luaL_buffinit) (lua_State *L, luaL_Buffer *B);
-LUALIB_API char *(luaL_prepbuffer) (luaL_Buffer *B);
+LUALIB_API char *(luaL_prepbuffsize) (luaL_Buffer *B, size_t sz);
 LUALIB_API void (luaL_addlstring) (luaL_Buffer *B, const char *s, size_t l);
 LUALIB_API void (luaL_addstring) (luaL_Buffer *B, const char *s);
 LUALIB_API void (luaL_addvalue) (luaL_Buffer *B);
@@ -200,10 +200,11 @@ static int luaB_gcinfo (lua_State *L) {
 
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
-    "count", "step", "setpause", "setstepmul","setmemlimit","getmemlimit", NULL};
+    "count", "step", "setpause", "setstepmul","setmemlimit","getmemlimit",
+    "generational", "incremental", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-		LUA_GCSETMEMLIMIT,LUA_GCGETMEMLIMIT};
+		LUA_GCSETMEMLIMIT,LUA_GCGETMEMLIMIT, LUA_GCGEN, LUA_GCINC};
   int o = luaL_checkoption(L, 1, "collect", opts);
   int ex = luaL_optint(L, 2, 0);
   int res = lua_gc(L, optsnum[o], ex);
@@ -217,6 +218,10 @@ static int luaB_collectgarbage (lua_State *L) {
       lua_pushboolean(L, res);
       return 1;
     }
+    case LUA_GCGEN: case LUA_GCINC: {  /* previous mode */
+      lua_pushstring(L, res == LUA_GCGEN ? "generational" : "incremental");
+      return 1;
+    }
     default: {
       lua_pushnumber(L, res);
       return 1;
@@ -505,12 +510,13 @@ static int luaB_index(lua_State *L) {
   if ((fres = luaR_findfunction(L, base_funcs_list)) != 0)
     return fres;
 #endif  
-  const char *keyname = luaL_checkstring(L, 2);
+  size_t len;
+  const char *keyname = luaL_checklstring(L, 2, &len);
   if (!c_strcmp(keyname, "_VERSION")) {
     lua_pushliteral(L, LUA_VERSION);
     return 1;
   }
-  void *res = luaR_findglobal(keyname, c_strlen(keyname));
+  void *res = luaR_findglobal(keyname, len);
   if (!res)
     return 0;
   else {
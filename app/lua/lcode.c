@@ -11,6 +11,7 @@
 
 #include "lua.h"
 #include C_HEADER_STDLIB
+#include C_HEADER_STRING
 
 #include "lcode.h"
 #include "ldebug.h"
@@ -21,6 +22,9 @@
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lparser.h"
+#include "lrotable.h"
+#include "lstate.h"
+#include "lstring.h"
 #include "ltable.h"
 
 
@@ -256,7 +260,7 @@ int luaK_stringK (FuncState *fs, TString *s) {
 
 int luaK_numberK (FuncState *fs, lua_Number r) {
   TValue o;
-  setnvalue(&o, r);
+  setnumvalue(&o, r);
   return addk(fs, &o, &o);
 }
 
@@ -301,6 +305,25 @@ void luaK_setoneret (FuncState *fs, expdesc *e) {
 }
 
 
+/*
+** `module.field': if the table in register `t' was just loaded by a
+** GETGLOBAL, and the key is a constant, turn the GETGLOBAL into a
+** GETGTABLE.  Nothing may jump to the GETTABLE that it replaces.
+*/
+static int fuseglobal (FuncState *fs, int t, int key) {
+  Instruction *prev;
+  if (fs->pc == 0 || fs->lasttarget == fs->pc || fs->jpc != NO_JUMP ||
+      t < fs->nactvar || !ISK(key))
+    return 0;
+  prev = &fs->f->code[fs->pc - 1];
+  if (GET_OPCODE(*prev) != OP_GETGLOBAL || GETARG_A(*prev) != t ||
+      GETARG_Bx(*prev) > MAXINDEXRK)
+    return 0;
+  *prev = CREATE_ABC(OP_GETGTABLE, 0, RKASK(GETARG_Bx(*prev)), key);
+  return 1;
+}
+
+
 void luaK_dischargevars (FuncState *fs, expdesc *e) {
   switch (e->k) {
     case VLOCAL: {
@@ -320,7 +343,10 @@ void luaK_dischargevars (FuncState *fs, expdesc *e) {
     case VINDEXED: {
       freereg(fs, e->u.s.aux);
       freereg(fs, e->u.s.info);
-      e->u.s.info = luaK_codeABC(fs, OP_GETTABLE, 0, e->u.s.info, e->u.s.aux);
+      if (!fuseglobal(fs, e->u.s.info, e->u.s.aux))
+        e->u.s.info = luaK_codeABC(fs, OP_GETTABLE, 0, e->u.s.info, e->u.s.aux);
+      else
+        e->u.s.info = fs->pc - 1;
       e->k = VRELOCABLE;
       break;
     }
@@ -928,3 +954,444 @@ void luaK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+#if defined(LUA_CROSS_COMPILER) || defined(LUA_OPTIMIZE_BYTECODE)
+/*
+** Bytecode optimizer, run on each function as the parser closes it (while
+** its local variables are still known) if registry[&luaK_optimize] is set:
+** by luac.cross -O, lua.bench -O and, if LUA_OPTIMIZE_BYTECODE is defined,
+** node.compile().
+**
+** It first hoists loads of ROM module globals out of loops.  Such a name
+** is not in the global table, so each GETGLOBAL or GETGTABLE of it misses
+** there and calls the __index function of _G to find the module.  In a
+** numeric for, while or repeat loop that doesn't assign the global, it is
+** now loaded once before the loop into a new local, and the loads in the
+** loop become MOVEs and GETTABLEs from it.  The new local takes the first free register at the loop
+** head, and the registers of the loop from there up move up by one.
+** Generic for loops are left alone, as their iterator call takes the
+** registers above the loop variables.  ROM modules are the globals that
+** luaR_findglobal() finds, and those in the manifest of luac.cross -c;
+** as for -c, code compiled this way assumes they aren't reassigned.
+**
+** Then it threads jumps to unconditional jumps through to their final
+** target, replaces jumps to a RETURN by the RETURN itself, and deletes
+** instructions that can't be reached, jumps to the next instruction and
+** moves of a register to itself.  Some instructions are never deleted:
+** the last one, which must be a RETURN, and any instruction that a test,
+** TFORLOOP or LOADBOOL skips, as those address it by position.
+**
+** Jump offsets, local variable ranges and line info follow the code.
+** The constant pool is left as it is.
+*/
+
+#define isjump(op)	((op) == OP_JMP || (op) == OP_FORLOOP || (op) == OP_FORPREP)
+#define jumptarget(code,pc)	((pc) + 1 + GETARG_sBx((code)[pc]))
+
+/* Number of the data words that follow the instruction at pc */
+static int extrawords (const Proto *f, int pc) {
+  Instruction i = f->code[pc];
+  switch (GET_OPCODE(i)) {
+    case OP_SETLIST: return GETARG_C(i) == 0;
+    case OP_CLOSURE: return f->p[GETARG_Bx(i)]->nups;
+    default: return 0;
+  }
+}
+
+/* Does the instruction at pc make the next one skippable? */
+static int skipsnext (const Proto *f, int pc) {
+  Instruction i = f->code[pc];
+  return testTMode(GET_OPCODE(i)) ||
+         (GET_OPCODE(i) == OP_LOADBOOL && GETARG_C(i) != 0);
+}
+
+static void threadjumps (Proto *f) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc += 1 + extrawords(f, pc)) {
+    if (GET_OPCODE(f->code[pc]) == OP_JMP) {
+      int target = jumptarget(f->code, pc), n;
+      /* follow the chain, giving up on a loop of jumps */
+      for (n = 0; n < f->sizecode && GET_OPCODE(f->code[target]) == OP_JMP &&
+                  jumptarget(f->code, target) != target; n++)
+        target = jumptarget(f->code, target);
+      /* a jump to a RETURN might as well return, unless a test owns it */
+      if (GET_OPCODE(f->code[target]) == OP_RETURN && !(pc > 0 && skipsnext(f, pc - 1)))
+        f->code[pc] = f->code[target];
+      else
+        SETARG_sBx(f->code[pc], target - pc - 1);
+    }
+  }
+}
+
+/* Mark the instructions that control can reach from the entry point */
+static void markreachable (const Proto *f, lu_byte *live, int *stack) {
+  int top = 0;
+#define follow(t)	{ int t_ = (t); if (t_ < f->sizecode && !live[t_]) live[stack[top++] = t_] = 1; }
+  follow(0);
+  while (top > 0) {
+    int pc = stack[--top], n = extrawords(f, pc);
+    Instruction i = f->code[pc];
+    OpCode op = GET_OPCODE(i);
+    while (n > 0)
+      live[pc + n--] = 1;
+    if (isjump(op))
+      follow(jumptarget(f->code, pc));
+    if (op == OP_LOADBOOL && GETARG_C(i) != 0)
+      follow(pc + 2)
+    else if (testTMode(op)) {
+      follow(pc + 1);
+      follow(pc + 2);
+    }
+    else if (op != OP_JMP && op != OP_FORPREP && op != OP_RETURN)
+      follow(pc + 1 + extrawords(f, pc));
+  }
+#undef follow
+}
+
+#ifdef LUA_OPTIMIZE_DEBUG
+/* Expand the packed line info into one line number per instruction */
+static void unpacklineinfo (const Proto *f, int *lines) {
+  int line = 0, pc = 0, n;
+  const unsigned char *p = f->packedlineinfo;
+  while (*p && *p != INFO_FILL_BYTE) {
+    if (*p & INFO_DELTA_MASK) {  /* line delta */
+      int delta = *p & INFO_DELTA_6BITS;
+      unsigned char sign = *p++ & INFO_SIGN_MASK;
+      int shift;
+      for (shift = 6; *p & INFO_DELTA_MASK; p++, shift += 7)
+        delta += (*p & INFO_DELTA_7BITS)<<shift;
+      line += sign ? -delta : delta+2;
+    } else {
+      line++;
+    }
+    for (n = *p++; n > 0 && pc < f->sizecode; n--)
+      lines[pc++] = line;
+  }
+}
+
+/* Rebuild the packed line info from one line number per instruction */
+static void packlineinfo (lua_State *L, Proto *f, const int *lines, int n) {
+  unsigned char *p;
+  int pass, size = 0;
+  for (pass = 0; pass < 2; pass++) {
+    int pc = 0, last = 0, len = 0;
+    p = f->packedlineinfo;
+#define putbyte(b)	{ if (pass) *p++ = cast(unsigned char, b); len++; }
+    while (pc < n) {
+      int line = lines[pc], count = 0, delta = line - last - 1;
+      while (pc < n && lines[pc] == line && count < INFO_MAX_LINECNT)
+        pc++, count++;
+      if (delta) {
+        if (delta < 0) {
+          delta = -delta - 1;
+          putbyte((INFO_DELTA_MASK|INFO_SIGN_MASK) | (delta & INFO_DELTA_6BITS));
+        } else {
+          delta = delta - 1;
+          putbyte(INFO_DELTA_MASK | (delta & INFO_DELTA_6BITS));
+        }
+        delta >>= 6;
+        while (delta) {
+          putbyte(INFO_DELTA_MASK | (delta & INFO_DELTA_7BITS));
+          delta >>= 7;
+        }
+      }
+      putbyte(count);
+      last = line;
+    }
+    putbyte(0);
+#undef putbyte
+    if (pass == 0) {
+      luaM_freearray(L, f->packedlineinfo,
+                     c_strlen(cast(char *, f->packedlineinfo)) + 1, unsigned char);
+      f->packedlineinfo = luaM_newvector(L, len, unsigned char);
+      size = len;
+    }
+  }
+  lua_assert(p == f->packedlineinfo + size);
+  UNUSED(size);
+}
+#endif
+
+/* The constant that names the global an instruction loads, or -1 */
+static int globalname (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_GETGLOBAL: return GETARG_Bx(i);
+    case OP_GETGTABLE: return INDEXK(GETARG_B(i));
+    default: return -1;
+  }
+}
+
+/* Is the global named by constant kx a ROM module? */
+static int isromglobal (lua_State *L, const Proto *f, int kx) {
+  TString *name = rawtsvalue(&f->k[kx]);
+#ifdef LUA_CROSS_COMPILER
+  const TValue *t = luaH_getstr(hvalue(registry(L)),
+                                luaS_newliteral(L, LUA_ROMCONST_KEY));
+  if (ttistable(t) && !ttisnil(luaH_getstr(hvalue(t), name)))
+    return 1;
+#else
+  UNUSED(L);
+#endif
+  return luaR_findglobal(getstr(name), name->tsv.len) != NULL;
+}
+
+/* Number of local variables active at pc, i.e. of registers in use */
+static int nactive (const Proto *f, int pc) {
+  int i, n = 0;
+  for (i = 0; i < f->sizelocvars && f->locvars[i].startpc <= pc; i++)
+    if (pc < f->locvars[i].endpc)
+      n++;
+  return n;
+}
+
+#define shiftreg(r,k)	((r) >= (k) ? (r) + 1 : (r))
+#define shiftRK(x,k)	(ISK(x) ? (x) : shiftreg(x, k))
+
+/*
+** Move registers k and up to the next register in the instructions from
+** pc to last.  With apply 0, only check that none of them uses a range of
+** registers that starts below k and goes on past it.
+*/
+static int shiftregs (Proto *f, int pc, int last, int k, int apply) {
+  for (; pc <= last; pc += 1 + extrawords(f, pc)) {
+    Instruction *i = &f->code[pc];
+    int a = GETARG_A(*i), b = GETARG_B(*i), c = GETARG_C(*i), hi = a;
+    switch (GET_OPCODE(*i)) {
+      case OP_LOADNIL: hi = b; break;
+      case OP_SELF: hi = a + 1; break;
+      case OP_CONCAT: if (b < k && c >= k) return 0; break;
+      case OP_CALL: case OP_TAILCALL:
+        hi = (b == 0 || c == 0) ? MAXSTACK : a + b + c; break;
+      case OP_RETURN: case OP_VARARG:
+        hi = (b == 0) ? MAXSTACK : a + b - 2; break;
+      case OP_FORLOOP: case OP_FORPREP: hi = a + 3; break;
+      case OP_TFORLOOP: hi = a + 2 + c; break;
+      case OP_SETLIST: hi = (b == 0) ? MAXSTACK : a + b; break;
+      default: break;
+    }
+    if (a < k && hi >= k)
+      return 0;
+    if (!apply)
+      continue;
+    switch (GET_OPCODE(*i)) {
+      case OP_JMP:
+        continue;
+      case OP_EQ: case OP_LT: case OP_LE:  /* A is not a register */
+        SETARG_B(*i, shiftRK(b, k));
+        SETARG_C(*i, shiftRK(c, k));
+        continue;
+      case OP_MOVE: case OP_LOADNIL: case OP_UNM: case OP_NOT: case OP_LEN:
+      case OP_TESTSET:
+        SETARG_B(*i, shiftreg(b, k));
+        break;
+      case OP_GETTABLE: case OP_SELF:
+        SETARG_B(*i, shiftreg(b, k));
+        SETARG_C(*i, shiftRK(c, k));
+        break;
+      case OP_SETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+      case OP_MOD: case OP_POW:
+        SETARG_B(*i, shiftRK(b, k));
+        SETARG_C(*i, shiftRK(c, k));
+        break;
+      case OP_CONCAT:
+        SETARG_B(*i, shiftreg(b, k));
+        SETARG_C(*i, shiftreg(c, k));
+        break;
+      case OP_CLOSURE: {  /* a MOVE that follows passes a register as upvalue */
+        int n;
+        for (n = extrawords(f, pc); n > 0; n--)
+          if (GET_OPCODE(i[n]) == OP_MOVE)
+            SETARG_B(i[n], shiftreg(GETARG_B(i[n]), k));
+        break;
+      }
+      default: break;
+    }
+    SETARG_A(*i, shiftreg(a, k));
+  }
+  return 1;
+}
+
+/*
+** Insert instruction ins at pc at, the head of the loop that runs to
+** last.  Jumps to the head from outside the loop now go to ins, those from
+** inside it still go to the head.
+*/
+static void insertcode (lua_State *L, Proto *f, int **lines, int at, int last,
+                        Instruction ins) {
+  int n = f->sizecode, pc, i;
+  for (pc = 0; pc < n; pc += 1 + extrawords(f, pc)) {
+    if (isjump(GET_OPCODE(f->code[pc]))) {
+      int t = jumptarget(f->code, pc);
+      int from = (pc >= at) ? pc + 1 : pc;
+      int to = (t > at || (t == at && pc >= at && pc <= last)) ? t + 1 : t;
+      SETARG_sBx(f->code[pc], to - from - 1);
+    }
+  }
+  luaM_reallocvector(L, f->code, n, n + 1, Instruction);
+  luaM_reallocvector(L, *lines, n, n + 1, int);
+  for (pc = n; pc > at; pc--) {
+    f->code[pc] = f->code[pc - 1];
+    (*lines)[pc] = (*lines)[pc - 1];
+  }
+  f->code[at] = ins;
+  f->sizecode = n + 1;
+  for (i = 0; i < f->sizelocvars; i++) {
+    if (f->locvars[i].startpc > at) f->locvars[i].startpc++;
+    if (f->locvars[i].endpc > at) f->locvars[i].endpc++;
+  }
+}
+
+/*
+** Hoist a load out of the loop from start to last, whose body starts at
+** body: start is a FORPREP, or the target of the loop's backward jumps.
+*/
+static int hoistloop (lua_State *L, Proto *f, int **lines,
+                      int start, int body, int last) {
+  int isfor = (GET_OPCODE(f->code[start]) == OP_FORPREP);
+  int k = nactive(f, body), kx = -1, pc, i, n;
+  if (f->maxstacksize >= MAXSTACK ||
+      (isfor && k < GETARG_A(f->code[start]) + 4))
+    return 0;
+  for (pc = start; pc <= last && kx < 0; pc += 1 + extrawords(f, pc)) {
+    int x = globalname(f->code[pc]), j;
+    if (x >= 0) {
+      for (j = start; j <= last; j += 1 + extrawords(f, j))
+        if (GET_OPCODE(f->code[j]) == OP_SETGLOBAL && GETARG_Bx(f->code[j]) == x)
+          break;
+      if (j > last && isromglobal(L, f, x))
+        kx = x;
+    }
+  }
+  if (kx < 0 || !shiftregs(f, start, last, k, 0))
+    return 0;
+  shiftregs(f, start, last, k, 1);
+  for (pc = start; pc <= last; pc += 1 + extrawords(f, pc)) {
+    Instruction ins = f->code[pc];
+    if (globalname(ins) != kx)
+      continue;
+    if (GET_OPCODE(ins) == OP_GETGLOBAL)
+      f->code[pc] = CREATE_ABC(OP_MOVE, GETARG_A(ins), k, 0);
+    else
+      f->code[pc] = CREATE_ABC(OP_GETTABLE, GETARG_A(ins), k, GETARG_C(ins));
+  }
+  f->maxstacksize++;
+  for (i = 0; i < f->sizelocvars && f->locvars[i].startpc <= body; i++) ;
+  insertcode(L, f, lines, start, last, CREATE_ABx(OP_GETGLOBAL, k, kx));
+  /* the new local is named after the global, and lives as long as the
+     loop's own: up to the FORLOOP, or past the last backward jump */
+  n = f->sizelocvars;
+  luaM_reallocvector(L, f->locvars, n, n + 1, LocVar);
+  for (pc = n; pc > i; pc--)
+    f->locvars[pc] = f->locvars[pc - 1];
+  f->locvars[i].varname = rawtsvalue(&f->k[kx]);
+  f->locvars[i].startpc = body + 1;
+  f->locvars[i].endpc = isfor ? last + 1 : last + 2;
+  f->sizelocvars = n + 1;
+  luaC_objbarrier(L, f, f->locvars[i].varname);
+  return 1;
+}
+
+/* Hoist one load out of a loop, if there is one to hoist */
+static int hoistload (lua_State *L, Proto *f, int **lines) {
+  int n = f->sizecode, pc, prev, done = 0;
+  int *last = luaM_newvector(L, n, int);  /* last backward jump to each pc */
+  for (pc = 0; pc < n; pc++)
+    last[pc] = -1;
+  for (pc = 0, prev = -1; pc < n; prev = pc, pc += 1 + extrawords(f, pc)) {
+    Instruction i = f->code[pc];
+    if (GET_OPCODE(i) == OP_JMP && GETARG_sBx(i) < 0 &&
+        !(prev >= 0 && GET_OPCODE(f->code[prev]) == OP_TFORLOOP))
+      last[jumptarget(f->code, pc)] = pc;
+  }
+  for (pc = 0, prev = -1; pc < n && !done; prev = pc, pc += 1 + extrawords(f, pc)) {
+    if (prev >= 0 && skipsnext(f, prev))
+      continue;  /* nothing can go in between */
+    if (GET_OPCODE(f->code[pc]) == OP_FORPREP)
+      done = hoistloop(L, f, lines, pc, pc + 1, jumptarget(f->code, pc));
+    else if (last[pc] >= 0)
+      done = hoistloop(L, f, lines, pc, pc, last[pc]);
+  }
+  luaM_freearray(L, last, n, int);
+  return done;
+}
+
+int luaK_optimize (lua_State *L, Proto *f) {
+  int n = f->sizecode, pc, newsize, i, hoisted = 0;
+  int *lines = luaM_newvector(L, n, int);
+  int *newpc;
+  lu_byte *live;
+  for (pc = 0; pc < n; pc++)
+    lines[pc] = 0;
+#ifdef LUA_OPTIMIZE_DEBUG
+  if (f->packedlineinfo)
+    unpacklineinfo(f, lines);
+#else
+  if (f->lineinfo)
+    for (pc = 0; pc < n; pc++)
+      lines[pc] = f->lineinfo[pc];
+#endif
+  while (hoistload(L, f, &lines))
+    hoisted++;
+  n = f->sizecode;
+  newpc = luaM_newvector(L, n + 1, int);
+  live = luaM_newvector(L, n, lu_byte);
+  for (pc = 0; pc < n; pc++)
+    live[pc] = 0;
+  threadjumps(f);
+  markreachable(f, live, newpc);  /* newpc serves as the work stack */
+  live[n - 1] = 1;  /* keep the final RETURN */
+  for (pc = 0; pc < n; pc += 1 + extrawords(f, pc)) {
+    Instruction ins = f->code[pc];
+    if (!live[pc] || (pc > 0 && skipsnext(f, pc - 1)) || pc == n - 1)
+      continue;
+    if ((GET_OPCODE(ins) == OP_JMP && GETARG_sBx(ins) == 0) ||
+        (GET_OPCODE(ins) == OP_MOVE && GETARG_A(ins) == GETARG_B(ins)))
+      live[pc] = 0;
+  }
+  /* unreachable instructions that another one skips must stay in place */
+  for (pc = 1; pc < n; pc++)
+    if (!live[pc] && live[pc - 1] && skipsnext(f, pc - 1))
+      live[pc] = 1;
+  for (pc = 0, newsize = 0; pc < n; pc++) {
+    newpc[pc] = newsize;
+    if (live[pc]) newsize++;
+  }
+  newpc[n] = newsize;
+  if (newsize < n) {
+    for (pc = 0; pc < n; pc += 1 + extrawords(f, pc)) {
+      if (live[pc] && isjump(GET_OPCODE(f->code[pc])))
+        SETARG_sBx(f->code[pc], newpc[jumptarget(f->code, pc)] - newpc[pc] - 1);
+    }
+    for (pc = 0; pc < n; pc++) {
+      if (live[pc]) {
+        f->code[newpc[pc]] = f->code[pc];
+        lines[newpc[pc]] = lines[pc];
+      }
+    }
+    luaM_reallocvector(L, f->code, n, newsize, Instruction);
+    f->sizecode = newsize;
+    for (i = 0; i < f->sizelocvars; i++) {
+      f->locvars[i].startpc = newpc[f->locvars[i].startpc];
+      f->locvars[i].endpc = newpc[f->locvars[i].endpc];
+    }
+  }
+  if (newsize < n || hoisted) {
+#ifdef LUA_OPTIMIZE_DEBUG
+    if (f->packedlineinfo)
+      packlineinfo(L, f, lines, newsize);
+#else
+    if (f->lineinfo) {
+      luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, newsize, int);
+      f->sizelineinfo = newsize;
+      for (pc = 0; pc < newsize; pc++)
+        f->lineinfo[pc] = lines[pc];
+    }
+#endif
+  }
+  luaM_freearray(L, newpc, n + 1, int);
+  luaM_freearray(L, lines, n, int);
+  luaM_freearray(L, live, n, lu_byte);
+  return hoisted;
+}
+#endif
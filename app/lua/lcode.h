@@ -71,6 +71,12 @@ LUAI_FUNC void luaK_prefix (FuncState *fs, UnOpr op, expdesc *v);
 LUAI_FUNC void luaK_infix (FuncState *fs, BinOpr op, expdesc *v);
 LUAI_FUNC void luaK_posfix (FuncState *fs, BinOpr op, expdesc *v1, expdesc *v2);
 LUAI_FUNC void luaK_setlist (FuncState *fs, int base, int nelems, int tostore);
+#if defined(LUA_CROSS_COMPILER) || defined(LUA_OPTIMIZE_BYTECODE)
+/* told of each function optimized: its size before, and the loads hoisted */
+typedef void (*luaK_Report) (lua_State *L, const Proto *f, int oldsize,
+                             int hoisted);
+LUAI_FUNC int luaK_optimize (lua_State *L, Proto *f);
+#endif
 
 
 #endif
@@ -16,6 +16,7 @@
 #include "lcode.h"
 #include "ldebug.h"
 #include "ldo.h"
+#include "lflash.h"
 #include "lfunc.h"
 #include "lobject.h"
 #include "lopcodes.h"
@@ -253,9 +254,12 @@ static int stripdebug (lua_State *L, Proto *f, int level) {
   TString* dummy;
   switch (level) {
     case 3:
-      sizepackedlineinfo = c_strlen(cast(char *, f->packedlineinfo))+1;
-      f->packedlineinfo = luaM_freearray(L, f->packedlineinfo, sizepackedlineinfo, unsigned char);
-      len += sizepackedlineinfo;
+      if (f->packedlineinfo && !proto_is_readonly(f)) {
+        sizepackedlineinfo = c_strlen(cast(char *, f->packedlineinfo))+1;
+        luaM_freearray(L, f->packedlineinfo, sizepackedlineinfo, unsigned char);
+        len += sizepackedlineinfo;
+      }
+      f->packedlineinfo = NULL;  /* line info of a readonly Proto stays in flash */
     case 2:
       len += f->sizelocvars * (sizeof(struct LocVar) + sizeof(dummy->tsv) + sizeof(struct LocVar *));
       f->locvars = luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar);
@@ -271,6 +275,8 @@ static int stripdebug (lua_State *L, Proto *f, int level) {
 /* This is a recursive function so it's stack size has been kept to a minimum! */
 LUA_API int luaG_stripdebug (lua_State *L, Proto *f, int level, int recv){
   int len = 0, i;
+  if (luaN_isflash(f))  /* Protos in the Lua Flash Store are read-only */
+    return 0;
   if (recv != 0 && f->sizep != 0) {
     for(i=0;i<f->sizep;i++) len += luaG_stripdebug(L, f->p[i], level, recv);
   }
@@ -497,6 +503,11 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
         check(ttisstring(&pt->k[b]));
         break;
       }
+      case OP_GETGTABLE: {
+        check(ISK(b) && ISK(c));
+        check(ttisstring(&pt->k[INDEXK(b)]));
+        break;
+      }
       case OP_SELF: {
         checkreg(pt, a+1);
         if (reg == a+1) last = pc;
@@ -606,6 +617,11 @@ static const char *getobjname (lua_State *L, CallInfo *ci, int stackpos,
     *name = luaF_getlocalname(p, stackpos+1, pc);
     if (*name)  /* is a local? */
       return "local";
+    i = p->code[pc];
+    if (GET_OPCODE(i) == OP_GETGTABLE && GETARG_A(i) == stackpos) {
+      *name = kname(p, GETARG_B(i));  /* indexing the global failed */
+      return "global";
+    }
     i = symbexec(p, pc, stackpos);  /* try symbolic execution */
     lua_assert(pc != -1);
     switch (GET_OPCODE(i)) {
@@ -622,7 +638,8 @@ static const char *getobjname (lua_State *L, CallInfo *ci, int stackpos,
           return getobjname(L, ci, b, name);  /* get name for `b' */
         break;
       }
-      case OP_GETTABLE: {
+      case OP_GETTABLE:
+      case OP_GETGTABLE: {
         int k = GETARG_C(i);  /* key index */
         *name = kname(p, k);
         return "field";
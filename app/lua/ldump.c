@@ -11,11 +11,15 @@
 #include "lua.h"
 #include C_HEADER_STRING
 
+#include "ldo.h"
+#include "lgc.h"
 #include "lobject.h"
 #include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
 #include "lundump.h"
 
-typedef struct {
+struct DumpState {
  lua_State* L;
  lua_Writer writer;
  void* data;
@@ -23,7 +27,10 @@ typedef struct {
  int status;
  DumpTargetInfo target;
  size_t wrote;
-} DumpState;
+ Table* strings;	/* compact format: index of each string written */
+ int nstrings;
+ int started;		/* luaU_dumpchild: header and main source written */
+};
 
 #define DumpMem(b,n,size,D)	DumpBlock(b,(n)*(size),D)
 #define DumpVar(x,D)	 	DumpMem(&x,1,sizeof(x),D)
@@ -47,10 +54,23 @@ static void DumpChar(int y, DumpState* D)
 
 static void Align4(DumpState *D)
 {
+ if (D->target.compact) return;
  while(D->wrote&3)
   DumpChar(0,D);
 }
 
+static void DumpVarint(uint32_t x, DumpState* D)
+{
+ /* 7 bits per byte, least significant first, high bit set if more follow */
+ char buf[5];
+ int n=0;
+ do {
+  buf[n++]=(char)((x&0x7F) | (x>0x7F ? 0x80 : 0));
+  x>>=7;
+ } while (x);
+ DumpBlock(buf,n,D);
+}
+
 static void MaybeByteSwap(char *number, size_t numbersize, DumpState *D)
 {
  int x=1;
@@ -94,7 +114,13 @@ static void DumpIntWithSize(int x, int sizeof_int, DumpState* D)
 
 static void DumpInt(int x, DumpState* D)
 {
- DumpIntWithSize(x,D->target.sizeof_int,D);
+ if (D->target.compact)
+ {
+  lua_assert(x>=0);
+  DumpVarint(x,D);
+ }
+ else
+  DumpIntWithSize(x,D->target.sizeof_int,D);
 }
 
 static void DumpSize(uint32_t x, DumpState* D)
@@ -163,6 +189,15 @@ static void DumpNumber(lua_Number x, DumpState* D)
 #endif // #if defined( LUA_NUMBER_INTEGRAL ) && !defined( LUA_CROSS_COMPILER )
 }
 
+/* Is x an integer that the compact format can write as a varint? */
+static int IsSmallInt(lua_Number x)
+{
+ lua_Number zero=0;
+ if (x<(lua_Number)-0x7FFFFFFF || x>(lua_Number)0x7FFFFFFF || (lua_Number)(int32_t)x!=x)
+  return 0;
+ return x!=0 || c_memcmp(&x,&zero,sizeof(x))==0;	/* not -0 */
+}
+
 static void DumpCode(const Proto *f, DumpState* D)
 {
  DumpInt(f->sizecode,D);
@@ -177,9 +212,37 @@ static void DumpCode(const Proto *f, DumpState* D)
  }
 }
 
-static void DumpString(const TString* s, DumpState* D)
+/*
+** In the compact format a string is written once, without its trailing
+** '\0', and then referred to by number: 0 is NULL, 1 is followed by the
+** length and the characters of a new string, and 2+i refers to the i-th
+** string written.
+*/
+static void DumpStringRef(const TString* s, DumpState* D)
 {
+ TValue* v;
  if (s==NULL || getstr(s)==NULL)
+ {
+  DumpVarint(0,D);
+  return;
+ }
+ v=luaH_setstr(D->L,D->strings,cast(TString*,s));
+ if (ttisnumber(v))
+  DumpVarint(2+cast_int(nvalue(v)),D);
+ else
+ {
+  setnvalue(v,cast_num(D->nstrings++));
+  DumpVarint(1,D);
+  DumpVarint(s->tsv.len,D);
+  DumpBlock(getstr(s),s->tsv.len,D);
+ }
+}
+
+static void DumpString(const TString* s, DumpState* D)
+{
+ if (D->target.compact)
+  DumpStringRef(s,D);
+ else if (s==NULL || getstr(s)==NULL)
  {
   strsize_t size=0;
   DumpSize(size,D);
@@ -201,6 +264,13 @@ static void DumpConstants(const Proto* f, DumpState* D)
  for (i=0; i<n; i++)
  {
   const TValue* o=&f->k[i];
+  if (D->target.compact && ttisnumber(o) && IsSmallInt(nvalue(o)))
+  {
+   int32_t x=(int32_t)nvalue(o);
+   DumpChar(LUAC_TSMALLINT,D);
+   DumpVarint(((uint32_t)x<<1)^(uint32_t)(x>>31),D);	/* zigzag */
+   continue;
+  }
   DumpChar(ttype(o),D);
   switch (ttype(o))
   {
@@ -220,11 +290,28 @@ static void DumpConstants(const Proto* f, DumpState* D)
 	break;
   }
  }
+ if (D->target.compact) return;	/* written by DumpNested */
  n=f->sizep;
  DumpInt(n,D);
  for (i=0; i<n; i++) DumpFunction(f->p[i],f->source,D);
 }
 
+/*
+** In the compact format the nested functions come before the rest of the
+** function, each preceded by a 1 and the list ended by a 0, so that a
+** chunk can be written while it is being compiled (see luaU_dumpchild)
+*/
+static void DumpNested(const Proto* f, DumpState* D)
+{
+ int i;
+ for (i=0; i<f->sizep; i++)
+ {
+  DumpChar(1,D);
+  DumpFunction(f->p[i],f->source,D);
+ }
+ DumpChar(0,D);
+}
+
 static void DumpDebug(const Proto* f, DumpState* D)
 {
  int i,n;
@@ -261,9 +348,8 @@ static void DumpDebug(const Proto* f, DumpState* D)
  for (i=0; i<n; i++) DumpString(f->upvalues[i],D);
 }
 
-static void DumpFunction(const Proto* f, const TString* p, DumpState* D)
+static void DumpBody(const Proto* f, DumpState* D)
 {
- DumpString((f->source==p || D->strip) ? NULL : f->source,D);
  DumpInt(f->linedefined,D);
  DumpInt(f->lastlinedefined,D);
  DumpChar(f->nups,D);
@@ -275,6 +361,13 @@ static void DumpFunction(const Proto* f, const TString* p, DumpState* D)
  DumpDebug(f,D);
 }
 
+static void DumpFunction(const Proto* f, const TString* p, DumpState* D)
+{
+ DumpString((f->source==p || D->strip) ? NULL : f->source,D);
+ if (D->target.compact) DumpNested(f,D);
+ DumpBody(f,D);
+}
+
 static void DumpHeader(DumpState* D)
 {
  char buf[LUAC_HEADERSIZE];
@@ -284,7 +377,7 @@ static void DumpHeader(DumpState* D)
  c_memcpy(h,LUA_SIGNATURE,sizeof(LUA_SIGNATURE)-1);
  h+=sizeof(LUA_SIGNATURE)-1;
  *h++=(char)LUAC_VERSION;
- *h++=(char)LUAC_FORMAT;
+ *h++=(char)(D->target.compact ? LUAC_FORMAT_COMPACT : LUAC_FORMAT);
  *h++=(char)D->target.little_endian;
  *h++=(char)D->target.sizeof_int;
  *h++=(char)D->target.sizeof_strsize_t;
@@ -295,21 +388,66 @@ static void DumpHeader(DumpState* D)
  DumpBlock(buf,LUAC_HEADERSIZE,D);
 }
 
+/*
+** anchor the string index of the compact format in the registry, as the
+** writer may use the stack (string.dump does)
+*/
+static void AnchorStrings(lua_State* L, Table* t)
+{
+ TValue key;
+ TValue* v;
+ setpvalue(&key,cast(void*,&luaU_dump_crosscompile));
+ v=luaH_set(L,hvalue(registry(L)),&key);
+ if (t)
+ {
+  sethvalue(L,v,t);
+  luaC_barriert(L,hvalue(registry(L)),v);
+ }
+ else
+  setnilvalue(v);
+}
+
+static void InitState(DumpState* D, lua_State* L, lua_Writer w, void* data, int strip, DumpTargetInfo target)
+{
+ D->L=L;
+ D->writer=w;
+ D->data=data;
+ D->strip=strip;
+ D->status=0;
+ D->target=target;
+ D->wrote=0;
+ D->strings=NULL;
+ D->nstrings=0;
+ D->started=0;
+}
+
+static void LocalTarget(DumpTargetInfo* target)
+{
+ int test=1;
+ target->little_endian=*(char*)&test;
+ target->sizeof_int=sizeof(int);
+ target->sizeof_strsize_t=sizeof(strsize_t);
+ target->sizeof_lua_Number=sizeof(lua_Number);
+ target->lua_Number_integral=(((lua_Number)0.5)==0);
+ target->is_arm_fpa=0;
+ target->compact=1;
+}
+
 /*
 ** dump Lua function as precompiled chunk with specified target
 */
 int luaU_dump_crosscompile (lua_State* L, const Proto* f, lua_Writer w, void* data, int strip, DumpTargetInfo target)
 {
  DumpState D;
- D.L=L;
- D.writer=w;
- D.data=data;
- D.strip=strip;
- D.status=0;
- D.target=target;
- D.wrote=0;
+ InitState(&D,L,w,data,strip,target);
+ if (target.compact)
+ {
+  D.strings=luaH_new(L,0,0);
+  AnchorStrings(L,D.strings);
+ }
  DumpHeader(&D);
  DumpFunction(f,NULL,&D);
+ if (target.compact) AnchorStrings(L,NULL);
  return D.status;
 }
 
@@ -319,12 +457,59 @@ int luaU_dump_crosscompile (lua_State* L, const Proto* f, lua_Writer w, void* da
 int luaU_dump (lua_State* L, const Proto* f, lua_Writer w, void* data, int strip)
 {
  DumpTargetInfo target;
- int test=1;
- target.little_endian=*(char*)&test;
- target.sizeof_int=sizeof(int);
- target.sizeof_strsize_t=sizeof(strsize_t);
- target.sizeof_lua_Number=sizeof(lua_Number);
- target.lua_Number_integral=(((lua_Number)0.5)==0);
- target.is_arm_fpa=0;
+ LocalTarget(&target);
  return luaU_dump_crosscompile(L,f,w,data,strip,target);
 }
+
+/*
+** Dump a chunk while it is being compiled, so that only the function being
+** compiled needs to be in memory.  luaU_dumpbegin pushes a userdata holding
+** the state (the string index is its environment, so both go away with it
+** if the compilation fails).  luaU_dumpchild then writes each function of
+** the main chunk as soon as it has been compiled, and luaU_dumpend writes
+** the main function itself, whose nested functions are no longer needed.
+*/
+DumpState* luaU_dumpbegin (lua_State* L, lua_Writer w, void* data, int strip)
+{
+ DumpTargetInfo target;
+ DumpState* D;
+ Udata* u;
+ Table* strings=luaH_new(L,0,0);
+ sethvalue2s(L,L->top,strings);  /* anchor it */
+ incr_top(L);
+ u=luaS_newudata(L,sizeof(DumpState),strings);
+ setuvalue(L,L->top-1,u);
+ D=cast(DumpState*,u+1);
+ LocalTarget(&target);
+ InitState(D,L,w,data,strip,target);
+ D->strings=strings;
+ return D;
+}
+
+static void DumpStart(const TString* source, DumpState* D)
+{
+ if (D->started) return;
+ D->started=1;
+ DumpHeader(D);
+ DumpString(D->strip ? NULL : source,D);
+}
+
+void luaU_dumpchild (DumpState* D, const Proto* f)
+{
+ DumpStart(f->source,D);
+ DumpChar(1,D);
+ DumpFunction(f,f->source,D);
+}
+
+int luaU_dumpend (DumpState* D, const Proto* f)
+{
+ if (D->started)
+  DumpChar(0,D);		/* its nested functions went through luaU_dumpchild */
+ else
+ {
+  DumpStart(f->source,D);	/* not compiled here, e.g. loaded from bytecode */
+  DumpNested(f,D);
+ }
+ DumpBody(f,D);
+ return D->status;
+}
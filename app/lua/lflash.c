@@ -0,0 +1,506 @@
+/*
+** Lua Flash Store: precompiled modules executed from mapped flash
+** See Copyright Notice in lua.h
+*/
+
+#define lflash_c
+#define LUA_CORE
+#define LUAC_CROSS_FILE
+
+#include "lua.h"
+#include C_HEADER_STRING
+
+#include "lauxlib.h"
+#include "ldo.h"
+#include "lflash.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lmem.h"
+#include "lstate.h"
+
+#if defined(LUA_FLASH_STORE) && defined(LUA_CROSS_COMPILER)
+#include C_HEADER_STDIO
+#elif defined(LUA_FLASH_STORE)
+#include "platform.h"
+#include "vfs.h"
+#include "user_interface.h"
+#endif
+
+#if defined(LUA_FREEZE_STORE) && !defined(LUA_CROSS_COMPILER)
+#include "platform.h"
+#include "lrotable.h"
+#include "lstring.h"
+#endif
+
+#define imageheader(image)    cast(const FlashHeader *, image)
+#define imagemodule(image, i) (cast(const FlashModule *, (image) + sizeof(FlashHeader)) + (i))
+#define imagestrt(image)      cast(GCObject *const *, (image) + imageheader(image)->strt)
+
+
+/*
+** Return the directory index of a module in an image, or -1 if the image
+** is missing or doesn't contain it
+*/
+int luaN_findmodule (const char *image, const char *name) {
+  lu_int32 i, n;
+  if (image == NULL || imageheader(image)->flash_sig != FLASH_SIG)
+    return -1;
+  n = imageheader(image)->nmodules;
+  for (i = 0; i < n; i++)
+    if (!c_strcmp(image + imagemodule(image, i)->name, name))
+      return cast_int(i);
+  return -1;
+}
+
+
+/*
+** Push the main function of module i of an image.  Its Proto is used where
+** it is, so only the closure is allocated.
+*/
+void luaN_loadmodule (lua_State *L, const char *image, int i) {
+  Proto *p = cast(Proto *, image + imagemodule(image, i)->proto);
+  Closure *cl;
+  lua_lock(L);
+  luaC_checkGC(L);
+  lua_assert(p->nups == 0);
+  cl = luaF_newLclosure(L, 0, hvalue(gt(L)));
+  cl->l.p = p;
+  setclvalue(L, L->top, cl);
+  incr_top(L);
+  lua_unlock(L);
+}
+
+
+#ifdef LUA_FLASH_STORE
+
+#ifdef LUA_CROSS_COMPILER
+/* On the host the store is just memory that luaN_loadimage() fills in */
+static char flash_region[LUA_FLASH_STORE] __attribute__((aligned(sizeof(size_t))));
+#else
+
+#if LUA_FLASH_STORE % INTERNAL_FLASH_SECTOR_SIZE != 0
+#error "LUA_FLASH_STORE must be a multiple of the flash sector size"
+#endif
+
+/*
+** The store is reserved at the end of the irom0 segment (see ld/nodemcu.ld)
+** so that it is mapped into the address space and SPIFFS is placed after
+** it.  It reads as zeros until an image has been loaded.  It is only ever
+** written through the flash API, but mustn't be const, or the compiler could
+** fold reads of it to zero.
+*/
+static char flash_region[LUA_FLASH_STORE]
+  __attribute__((used, aligned(INTERNAL_FLASH_SECTOR_SIZE), section(".irom.reserved")));
+#endif
+
+/* Return the loaded image, or NULL if there isn't a valid one */
+const char *luaN_image (void) {
+  const FlashHeader *h = imageheader(flash_region);
+  return h->flash_sig == FLASH_SIG && h->flash_layout == FLASH_VMLAYOUT ?
+         flash_region : NULL;
+}
+
+int luaN_isflash (const void *p) {
+  return (const char *)p >= flash_region &&
+         (const char *)p < flash_region + LUA_FLASH_STORE;
+}
+
+
+/*
+** Look a string up in the string table of the image.  luaS_newlstr() does
+** this before it searches the RAM string table, so a string that is in the
+** image is never created in RAM and strings stay unique.
+*/
+TString *luaN_findstring (const char *str, size_t l, unsigned int h) {
+  const char *image = luaN_image();
+  GCObject *o;
+  if (image == NULL)
+    return NULL;
+  for (o = imagestrt(image)[lmod(h, imageheader(image)->strt_size)];
+       o != NULL;
+       o = o->gch.next) {
+    TString *ts = rawgco2ts(o);
+    if (ts->tsv.hash == h && ts->tsv.len == l &&
+        c_memcmp(str, getstr(ts), l) == 0)
+      return ts;
+  }
+  return NULL;
+}
+
+
+#ifdef LUA_CROSS_COMPILER
+typedef FILE *ImageFile;
+#define image_open(name)       fopen(name, "rb")
+#define image_read(f, p, n)    fread(p, 1, n, f)
+#define image_rewind(f)        fseek(f, 0, SEEK_SET)
+#define image_close(f)         fclose(f)
+#else
+typedef int ImageFile;
+#define image_open(name)       vfs_open(name, "r")
+#define image_read(f, p, n)    vfs_read(f, p, n)
+#define image_rewind(f)        vfs_lseek(f, 0, VFS_SEEK_SET)
+#define image_close(f)         vfs_close(f)
+#endif
+
+typedef struct {
+  lu_int32 mask;                       /* bit i set: word[i] is a pointer */
+  size_t word[FLASH_BLOCKWORDS];
+} ImageBlock;
+
+/* Read the next block of an image file: 1 if read, 0 at its end, -1 if short */
+static int readblock (ImageFile f, ImageBlock *b) {
+  size_t n = image_read(f, &b->mask, sizeof(b->mask));
+  if (n == 0)
+    return 0;
+  if (n != sizeof(b->mask) ||
+      image_read(f, b->word, sizeof(b->word)) != sizeof(b->word))
+    return -1;
+  return 1;
+}
+
+/*
+** Read a whole image file and check it without touching the store: the
+** header, that every pointer and directory entry is an offset into the image
+** and that the file holds exactly flash_size bytes of it.  Returns NULL if
+** the image can be loaded, or what is wrong with it.
+*/
+static const char *checkimage (ImageFile f, FlashHeader *h) {
+  ImageBlock b;
+  lu_int32 dir = 0;
+  size_t off;
+  int i, r;
+  for (off = 0; (r = readblock(f, &b)) > 0; off += sizeof(b.word)) {
+    if (off == 0) {
+      c_memcpy(h, b.word, sizeof(*h));
+      dir = sizeof(*h) + h->nmodules * sizeof(FlashModule);
+      if (h->flash_sig != FLASH_SIG)
+        return "is not an LFS image";
+      if (h->flash_layout != FLASH_VMLAYOUT)
+        return "was built for a different VM";
+      if (h->flash_size > LUA_FLASH_STORE)
+        return "is too big for the Lua Flash Store";
+      if (h->flash_size % sizeof(b.word) != 0 ||
+          h->nmodules > LUA_FLASH_STORE / sizeof(FlashModule) ||
+          dir > h->flash_size ||
+          h->strt_size == 0 || (h->strt_size & (h->strt_size - 1)) != 0 ||
+          h->strt % sizeof(size_t) != 0 || h->strt > h->flash_size ||
+          h->strt_size > (h->flash_size - h->strt) / sizeof(size_t))
+        return "is corrupt";
+    }
+    if (off >= h->flash_size)
+      return "is corrupt";
+    for (i = 0; i < FLASH_BLOCKWORDS; i++)
+      if ((b.mask & (1u << i)) && b.word[i] >= h->flash_size)
+        return "is corrupt";
+    for (i = 0; i < FLASH_BLOCKWORDS * cast_int(sizeof(size_t) / 4); i++) {
+      size_t at = off + i * 4;  /* directory entries */
+      if (at >= sizeof(*h) && at < dir &&
+          cast(lu_int32 *, b.word)[i] >= h->flash_size)
+        return "is corrupt";
+    }
+  }
+  if (r < 0 || off == 0 || off != h->flash_size)
+    return "is truncated";
+  return NULL;
+}
+
+/* Relocate the pointers in a block of an image loaded at base */
+static void relocate (ImageBlock *b, size_t base) {
+  int i;
+  for (i = 0; i < FLASH_BLOCKWORDS; i++)
+    if (b->mask & (1u << i))
+      b->word[i] += base;
+}
+
+
+#ifdef LUA_CROSS_COMPILER
+
+/*
+** Load an image file into the store.  This must be done before any Lua
+** state is created, as the strings in the store replace those in RAM.
+** Returns NULL or an error message.
+*/
+const char *luaN_loadimage (const char *fname) {
+  static char msg[128];
+  FlashHeader h;
+  ImageBlock b;
+  const char *err;
+  size_t off;
+  ImageFile f = image_open(fname);
+  if (f == NULL) {
+    c_sprintf(msg, "cannot open %.80s", fname);
+    return msg;
+  }
+  err = checkimage(f, &h);
+  if (err == NULL) {
+    c_memset(flash_region, 0, sizeof(FlashHeader));
+    image_rewind(f);
+    for (off = 0; off < h.flash_size && readblock(f, &b) > 0; off += sizeof(b.word)) {
+      relocate(&b, (size_t)flash_region);
+      if (off == 0)  /* the header is copied last */
+        c_memcpy(flash_region + sizeof(h), cast(char *, b.word) + sizeof(h),
+                 sizeof(b.word) - sizeof(h));
+      else
+        c_memcpy(flash_region + off, b.word, sizeof(b.word));
+    }
+    if (off != h.flash_size)
+      err = "could not be read";
+    else
+      c_memcpy(flash_region, &h, sizeof(h));
+  }
+  image_close(f);
+  if (err == NULL)
+    return NULL;
+  c_sprintf(msg, "%.80s %s", fname, err);
+  return msg;
+}
+
+#else
+
+/*
+** Copy an image file from the file system into the store and restart.  The
+** whole file is read and checked before the store is erased; after that
+** the module restarts whatever happens, as RAM may refer to the old image.
+** The body is written before the header, so that an interrupted reload
+** leaves no valid image behind rather than a corrupt one.
+*/
+int luaN_reload (lua_State *L, const char *fname) {
+  uint32_t base = platform_flash_mapped2phys((uint32_t)flash_region);
+  ImageBlock *b;
+  FlashHeader h;
+  const char *err;
+  uint32_t off;
+  ImageFile f = image_open(fname);
+
+  if (!f)
+    return luaL_error(L, "cannot open %s", fname);
+  b = (ImageBlock *)lua_newuserdata(L, sizeof(ImageBlock));
+  err = checkimage(f, &h);
+  if (err != NULL || image_rewind(f) != 0) {
+    image_close(f);
+    return luaL_error(L, "%s %s", fname, err ? err : "cannot be read");
+  }
+  for (off = 0; off < h.flash_size; off += INTERNAL_FLASH_SECTOR_SIZE)
+    platform_flash_erase_sector(platform_flash_get_sector_of_address(base + off));
+  for (off = 0; off < h.flash_size && readblock(f, b) > 0; off += sizeof(b->word)) {
+    relocate(b, (size_t)flash_region);
+    if (off == 0)  /* leave the header erased until the end */
+      c_memset(b->word, 0xff, sizeof(h));
+    if (platform_flash_write(b->word, base + off, sizeof(b->word)) != sizeof(b->word))
+      break;
+  }
+  image_close(f);
+  if (off == h.flash_size)
+    platform_flash_write(&h, base, sizeof(h));
+  else
+    NODE_ERR("LFS reload of %s failed, restarting\n", fname);
+  system_restart();
+  return 0;
+}
+
+#endif
+
+#endif
+
+
+#if defined(LUA_FREEZE_STORE) && !defined(LUA_CROSS_COMPILER)
+
+#if LUA_FREEZE_STORE % INTERNAL_FLASH_SECTOR_SIZE != 0
+#error "LUA_FREEZE_STORE must be a multiple of the flash sector size"
+#endif
+
+/*
+** Frozen tables: node.freeze() copies a table of constants into flash as a
+** rotable, laid out like the module maps (an array of luaR_entry ending in
+** a nil key), so that the RAM copy can be collected.  Frozen tables are
+** appended to a store that lasts for one boot: the first freeze after a
+** restart erases it, as the tables of the previous session may refer to RAM
+** (string values, light userdata) that is gone.
+**
+** Nested tables become rotables of their own, and a table reached twice is
+** frozen once.  Key names are copied into flash, but a string value has to
+** stay an interned TString, so it is fixed in RAM instead.  A metatable is
+** frozen too and stored under "__metatable", as in the module maps.
+*/
+static char freeze_region[LUA_FREEZE_STORE]
+  __attribute__((used, aligned(INTERNAL_FLASH_SECTOR_SIZE), section(".irom.reserved")));
+
+static size_t freeze_used;       /* bytes of the store in use this boot */
+static int freeze_erased;        /* the store has been erased this boot */
+
+#define FREEZE_ALIGN  8          /* entry arrays hold doubles */
+
+typedef struct FreezeState {
+  lua_State *L;
+  char *buf;                     /* image being built, NULL when sizing it */
+  size_t size;                   /* bytes of the image used so far */
+  size_t base;                   /* mapped address the image is written to */
+  int seen;                      /* stack index of a table -> entries map */
+} FreezeState;
+
+int luaN_isfrozen (const void *p) {
+  return (const char *)p >= freeze_region &&
+         (const char *)p < freeze_region + LUA_FREEZE_STORE;
+}
+
+static size_t freeze_alloc (FreezeState *fs, size_t n, size_t align) {
+  size_t off = (fs->size + align - 1) & ~(align - 1);
+  fs->size = off + n;
+  return off;
+}
+
+/* Freeze the key at stack index -2 into k, or just size it if k is NULL */
+static void freeze_key (FreezeState *fs, luaR_key *k) {
+  lua_State *L = fs->L;
+  if (lua_type(L, -2) == LUA_TSTRING) {
+    size_t l, off;
+    const char *s = lua_tolstring(L, -2, &l);
+    if (l > LUA_MAX_ROTABLE_NAME || c_strlen(s) != l)
+      luaL_error(L, "cannot freeze key '%s'", s);
+    off = freeze_alloc(fs, l + 1, 1);
+    if (k) {
+      c_memcpy(fs->buf + off, s, l + 1);
+      k->tag = luaR_strtag(s, l);
+      k->id.strkey = cast(const char *, fs->base + off);
+    }
+  }
+  else if (lua_type(L, -2) == LUA_TNUMBER) {
+    lua_Number n = lua_tonumber(L, -2);
+    if (n < -MAX_INT || n > MAX_INT || (lua_Number)(luaR_numkey)n != n)
+      luaL_error(L, "cannot freeze key %f", n);
+    if (k) {
+      k->tag = LUA_TNUMBER;
+      k->id.numkey = (luaR_numkey)n;
+    }
+  }
+  else
+    luaL_error(L, "cannot freeze a %s key", luaL_typename(L, -2));
+}
+
+static size_t freeze_table (FreezeState *fs, int t);
+
+/* Freeze the value on top of the stack into v, or just size it */
+static void freeze_value (FreezeState *fs, TValue *v) {
+  lua_State *L = fs->L;
+  const TValue *o = L->top - 1;
+  switch (ttype(o)) {
+    case LUA_TTABLE: {
+      size_t off = freeze_table(fs, lua_gettop(L));
+      if (v)
+        setrvalue(v, cast(void *, fs->base + off));
+      return;
+    }
+    case LUA_TFUNCTION:
+      if (!clvalue(o)->c.isC || clvalue(o)->c.nupvalues > 0)
+        luaL_error(L, "cannot freeze a Lua function or a C closure");
+      if (v)
+        setfvalue(v, cast(void *, clvalue(o)->c.f));
+      return;
+    case LUA_TSTRING:
+      if (v)
+        luaS_fix(rawtsvalue(o));
+      break;
+    case LUA_TNUMBER: case LUA_TBOOLEAN: case LUA_TLIGHTFUNCTION:
+    case LUA_TLIGHTUSERDATA: case LUA_TROTABLE:
+      break;
+    default:
+      luaL_error(L, "cannot freeze a %s value", luaL_typename(L, -1));
+  }
+  if (v)
+    setobj(L, v, o);
+}
+
+/* Freeze the table at stack index t, returning the offset of its entries */
+static size_t freeze_table (FreezeState *fs, int t) {
+  lua_State *L = fs->L;
+  luaR_entry *e = NULL;
+  size_t n = 0, entries;
+  luaL_checkstack(L, 4, "table nested too deep");
+  lua_pushvalue(L, t);
+  lua_rawget(L, fs->seen);
+  if (lua_isnumber(L, -1)) {  /* already frozen */
+    entries = (size_t)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return entries;
+  }
+  if (lua_toboolean(L, -1))
+    luaL_error(L, "cannot freeze a table that contains itself");
+  lua_pop(L, 1);
+  lua_pushvalue(L, t);
+  lua_pushboolean(L, 1);
+  lua_rawset(L, fs->seen);
+  for (lua_pushnil(L); lua_next(L, t); lua_pop(L, 1))
+    n++;
+  if (lua_getmetatable(L, t)) {
+    lua_pop(L, 1);
+    n++;
+  }
+  entries = freeze_alloc(fs, (n + 1) * sizeof(luaR_entry), FREEZE_ALIGN);
+  if (fs->buf)
+    e = cast(luaR_entry *, fs->buf + entries);
+  if (lua_getmetatable(L, t)) {
+    if (e) {
+      cast(luaR_key *, &e->key)->tag = LRO_KEYTAG("__metatable");
+      cast(luaR_key *, &e->key)->id.strkey = "__metatable";
+    }
+    freeze_value(fs, e ? cast(TValue *, &e->value) : NULL);
+    lua_pop(L, 1);
+    if (e) e++;
+  }
+  for (lua_pushnil(L); lua_next(L, t); lua_pop(L, 1)) {
+    freeze_key(fs, e ? cast(luaR_key *, &e->key) : NULL);
+    freeze_value(fs, e ? cast(TValue *, &e->value) : NULL);
+    if (e) e++;
+  }
+  if (e) {
+    cast(luaR_key *, &e->key)->tag = LUA_TNIL;
+    setnilvalue(cast(TValue *, &e->value));
+  }
+  lua_pushvalue(L, t);
+  lua_pushinteger(L, entries);
+  lua_rawset(L, fs->seen);
+  return entries;
+}
+
+/*
+** Freeze the table at stack index t and push the rotable.  The table is
+** walked twice: once to size the image and once to fill it in, after which
+** it is written to the store in one go.
+*/
+int luaN_freeze (lua_State *L, int t) {
+  FreezeState fs;
+  uint32_t phys, off;
+  size_t size;
+  t = t > 0 ? t : lua_gettop(L) + t + 1;
+  fs.L = L;
+  fs.buf = NULL;
+  fs.size = 0;
+  fs.base = (size_t)(freeze_region + freeze_used);
+  lua_newtable(L);
+  fs.seen = lua_gettop(L);
+  freeze_table(&fs, t);
+  size = (fs.size + FREEZE_ALIGN - 1) & ~(size_t)(FREEZE_ALIGN - 1);
+  if (size > LUA_FREEZE_STORE - freeze_used)
+    return luaL_error(L, "not enough space to freeze table (%d bytes free)",
+                      (int)(LUA_FREEZE_STORE - freeze_used));
+  fs.buf = (char *)lua_newuserdata(L, size);
+  c_memset(fs.buf, 0, size);
+  lua_newtable(L);
+  lua_replace(L, fs.seen);
+  fs.size = 0;
+  freeze_table(&fs, t);
+  phys = platform_flash_mapped2phys((uint32_t)freeze_region);
+  if (!freeze_erased) {
+    for (off = 0; off < LUA_FREEZE_STORE; off += INTERNAL_FLASH_SECTOR_SIZE)
+      platform_flash_erase_sector(platform_flash_get_sector_of_address(phys + off));
+    freeze_erased = 1;
+  }
+  if (platform_flash_write(fs.buf, phys + freeze_used, size) != size)
+    return luaL_error(L, "cannot write frozen table to flash");
+  freeze_used += size;
+  lua_pop(L, 2);
+  lua_pushrotable(L, cast(void *, fs.base));
+  return 1;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*
+** Lua Flash Store: precompiled modules executed from mapped flash
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lflash_h
+#define lflash_h
+
+#include "lua.h"
+#include "llimits.h"
+#include "lobject.h"
+
+/*
+** An LFS image is built by luac.cross -f.  It holds the Protos of one or more
+** modules together with their constants, code, debug info and strings, laid
+** out as the VM has them in RAM, so that they are used in place: loading a
+** module from LFS only allocates its closure.  The image starts with a
+** FlashHeader and a directory of nmodules FlashModule entries, followed by
+** the objects and the string table, a hash table of all the strings in the
+** image chained like the one in RAM (see luaN_findstring).
+**
+** The strings and Protos are marked black and fixed, so the collector never
+** marks, sweeps or frees them, and nothing in the image refers to RAM.
+**
+** Header and directory hold offsets from the start of the image.  Pointers
+** are held as offsets in the image file too, and relocated to the address of
+** the store when it is loaded: the file is a sequence of blocks, each a 32
+** bit mask followed by 32 pointer sized words of the image, where bit i of
+** the mask is set if word i is a pointer.
+*/
+#define FLASH_SIG          0x4C465332   /* "LFS2" */
+#define FLASH_BLOCKWORDS   32
+
+/* the object sizes an image is laid out for; a VM only loads its own */
+#define FLASH_LAYOUT(ptr, tvalue, proto, tstring) \
+  ((lu_int32)(ptr) | (lu_int32)(tvalue)<<8 | (lu_int32)(proto)<<16 | (lu_int32)(tstring)<<24)
+#define FLASH_VMLAYOUT \
+  FLASH_LAYOUT(sizeof(void *), sizeof(TValue), sizeof(Proto), sizeof(TString))
+
+typedef struct {
+  lu_int32 flash_sig;      /* FLASH_SIG if the image is valid */
+  lu_int32 flash_size;     /* total size of the image in bytes */
+  lu_int32 flash_layout;   /* FLASH_LAYOUT of the objects in the image */
+  lu_int32 nmodules;       /* number of directory entries that follow */
+  lu_int32 strt;           /* offset of the string table */
+  lu_int32 strt_size;      /* number of string table buckets, a power of 2 */
+} FlashHeader;
+
+typedef struct {
+  lu_int32 name;           /* offset of the zero-terminated module name */
+  lu_int32 proto;          /* offset of the module's main Proto */
+} FlashModule;
+
+LUAI_FUNC int luaN_findmodule (const char *image, const char *name);
+LUAI_FUNC void luaN_loadmodule (lua_State *L, const char *image, int i);
+
+#ifdef LUA_FLASH_STORE
+LUAI_FUNC const char *luaN_image (void);
+LUAI_FUNC int luaN_isflash (const void *p);
+LUAI_FUNC TString *luaN_findstring (const char *str, size_t l, unsigned int h);
+#ifdef LUA_CROSS_COMPILER
+LUAI_FUNC const char *luaN_loadimage (const char *fname);
+#else
+LUAI_FUNC int luaN_reload (lua_State *L, const char *fname);
+#endif
+#else
+#define luaN_isflash(p)    0
+#endif
+
+#ifdef LUA_CROSS_COMPILER
+#include "lundump.h"
+/* write an image of the n functions on top of the stack; from luac_cross/lflashimg.c */
+LUAI_FUNC int luaN_dumpimage (lua_State *L, int n, const char *const *names,
+                              lua_Writer w, void *data, int strip,
+                              DumpTargetInfo target, int host);
+#endif
+
+#if defined(LUA_FREEZE_STORE) && !defined(LUA_CROSS_COMPILER)
+LUAI_FUNC int luaN_freeze (lua_State *L, int t);
+LUAI_FUNC int luaN_isfrozen (const void *p);
+#endif
+
+#endif
@@ -37,7 +37,9 @@
 #define white2gray(x)	reset2bits((x)->gch.marked, WHITE0BIT, WHITE1BIT)
 #define black2gray(x)	resetbit((x)->gch.marked, BLACKBIT)
 
-#define stringmark(s)	reset2bits((s)->tsv.marked, WHITE0BIT, WHITE1BIT)
+/* only white strings are written, as those in flash (see lflash.h) are black */
+#define stringmark(s)	{ if (iswhite(obj2gco(s))) \
+                            reset2bits((s)->tsv.marked, WHITE0BIT, WHITE1BIT); }
 
 
 #define isfinalized(u)		testbit((u)->marked, FINALIZEDBIT)
@@ -274,6 +276,52 @@ static void traversestack (global_State *g, lua_State *l) {
 }
 
 
+/*
+** Bytes allocated for an object, as they are released by freeobj
+*/
+static lu_mem objsize (GCObject *o) {
+  switch (o->gch.tt) {
+    case LUA_TSTRING:
+      return sizestring(gco2ts(o));
+    case LUA_TUSERDATA:
+      return sizeudata(gco2u(o));
+    case LUA_TTABLE: {
+      Table *h = gco2h(o);
+      return sizeof(Table) + sizeof(TValue) * h->sizearray +
+             (luaH_isdummy(h->node) ? 0 : sizeof(Node) * sizenode(h));
+    }
+    case LUA_TFUNCTION: {
+      Closure *cl = gco2cl(o);
+      return (cl->c.isC) ? sizeCclosure(cl->c.nupvalues) :
+                           sizeLclosure(cl->l.nupvalues);
+    }
+    case LUA_TTHREAD: {
+      lua_State *th = gco2th(o);
+      return sizeof(lua_State) + sizeof(TValue) * th->stacksize +
+                                 sizeof(CallInfo) * th->size_ci;
+    }
+    case LUA_TPROTO: {
+      Proto *p = gco2p(o);
+      return sizeof(Proto) + sizeof(Proto *) * p->sizep +
+                             sizeof(TValue) * p->sizek +
+                             sizeof(LocVar) * p->sizelocvars +
+                             sizeof(TString *) * p->sizeupvalues +
+                             (proto_is_readonly(p) ? 0 : sizeof(Instruction) * p->sizecode +
+#ifdef LUA_OPTIMIZE_DEBUG
+                                                         (p->packedlineinfo ?
+                                                            c_strlen(cast(char *, p->packedlineinfo))+1 :
+                                                            0));
+#else
+                                                         sizeof(int) * p->sizelineinfo);
+#endif
+    }
+    case LUA_TUPVAL:
+      return sizeof(UpVal);
+    default: lua_assert(0); return 0;
+  }
+}
+
+
 /*
 ** traverse one gray object, turning it to black.
 ** Returns `quantity' traversed.
@@ -312,19 +360,7 @@ static l_mem propagatemark (global_State *g) {
       Proto *p = gco2p(o);
       g->gray = p->gclist;
       traverseproto(g, p);
-
-      return sizeof(Proto) + sizeof(Proto *) * p->sizep +
-                             sizeof(TValue) * p->sizek +
-                             sizeof(LocVar) * p->sizelocvars +
-                             sizeof(TString *) * p->sizeupvalues +
-                             (proto_is_readonly(p) ? 0 : sizeof(Instruction) * p->sizecode +
-#ifdef LUA_OPTIMIZE_DEBUG
-                                                         (p->packedlineinfo ?
-                                                            c_strlen(cast(char *, p->packedlineinfo))+1 :
-                                                            0));
-#else
-                                                         sizeof(int) * p->sizelineinfo);
-#endif
+      return objsize(o);
     }
     default: lua_assert(0); return 0;
   }
@@ -424,7 +460,10 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
       sweepwholelist(L, &gco2th(curr)->openupval);
     if ((curr->gch.marked ^ WHITEBITS) & deadmask) {  /* not dead? */
       lua_assert(!isdead(g, curr) || testbit(curr->gch.marked, FIXEDBIT));
-      makewhite(g, curr);  /* make it white (for next cycle) */
+      if (!isgenerational(g))
+        makewhite(g, curr);  /* make it white (for next cycle) */
+      else if (curr->gch.tt == LUA_TSTRING)
+        gray2black(curr);  /* survivors keep their mark; black strings are old */
       p = &curr->gch.next;
     }
     else {  /* must erase `curr' */
@@ -437,6 +476,29 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
 }
 
 
+/*
+** In generational mode new objects are linked in front of the old ones, so
+** a minor collection only sweeps up to the first old object.  That is
+** `genold' for `rootgc' and the first black string in each string chain,
+** unless the string table has been rehashed since all its strings were old.
+** The userdata list behind the main thread is swept in full.
+*/
+static GCObject **sweepyoung (lua_State *L, GCObject **p) {
+  while (*p != NULL && !isblack(*p))
+    p = sweeplist(L, p, 1);
+  return p;
+}
+
+
+static GCObject **sweepgen (lua_State *L) {
+  global_State *g = G(L);
+  GCObject **p = &g->rootgc;
+  while (*p != g->genold)
+    p = sweeplist(L, p, 1);
+  return sweepwholelist(L, &g->mainthread->next);
+}
+
+
 static void checkSizes (lua_State *L) {
   global_State *g = G(L);
   /* check size of string hash */
@@ -555,6 +617,15 @@ static void atomic (lua_State *L) {
   marktmu(g);  /* mark `preserved' userdata */
   udsize += propagateall(g);  /* remark, to propagate `preserveness' */
   cleartable(g->weak);  /* remove collected objects from weak tables */
+  if (isgenerational(g)) {
+    /* weak tables change without barriers: clear them again next time */
+    while (g->weak) {
+      Table *h = gco2h(g->weak);
+      g->weak = h->gclist;
+      h->gclist = g->grayagain;
+      g->grayagain = obj2gco(h);
+    }
+  }
   /* flip current white */
   g->currentwhite = cast_byte(otherwhite(g));
   g->sweepstrgc = 0;
@@ -565,9 +636,15 @@ static void atomic (lua_State *L) {
 
 static void sweepstrstep (global_State *g, lua_State *L) {
   lu_mem old = g->totalbytes;
-  sweepwholelist(L, &g->strt.hash[g->sweepstrgc++]);
-  if (g->sweepstrgc >= g->strt.size)  /* nothing more to sweep? */
+  if (g->genold != NULL && g->genstrsize == g->strt.size)
+    sweepyoung(L, &g->strt.hash[g->sweepstrgc++]);
+  else
+    sweepwholelist(L, &g->strt.hash[g->sweepstrgc++]);
+  if (g->sweepstrgc >= g->strt.size) {  /* nothing more to sweep? */
+    if (isgenerational(g))
+      g->genstrsize = g->strt.size;  /* all strings are old now */
     g->gcstate = GCSsweep;  /* end sweep-string phase */
+  }
   lua_assert(old >= g->totalbytes);
   g->estimate -= old - g->totalbytes;
 }
@@ -595,9 +672,14 @@ static l_mem singlestep (lua_State *L) {
     }
     case GCSsweep: {
       lu_mem old = g->totalbytes;
-      g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
+      if (g->genold != NULL)  /* minor collection? */
+        g->sweepgc = sweepgen(L);
+      else
+        g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
       if (*g->sweepgc == NULL) {  /* nothing more to sweep? */
         checkSizes(L);
+        if (isgenerational(g))
+          g->genold = g->rootgc;  /* all objects are old now */
         g->gcstate = GCSfinalize;  /* end sweep phase */
       }
       lua_assert(old >= g->totalbytes);
@@ -622,10 +704,92 @@ static l_mem singlestep (lua_State *L) {
 }
 
 
+/*
+** Generational mode: objects that survive a collection become old and keep
+** their mark, so a minor collection traverses and sweeps only the objects
+** created since the last one.  The collector waits in GCSpropagate between
+** collections, where the barriers keep old objects from pointing to
+** unmarked young ones: the young object is marked, or an old table is put
+** on `grayagain' to be traversed again.  Threads and weak tables change
+** without barriers, so they stay on `grayagain' from one collection to the
+** next.  Old garbage is only freed by a major collection, which makes every
+** object white again and marks from the roots.
+*/
+
+static void gencycle (lua_State *L) {
+  global_State *g = G(L);
+  while (g->gcstate != GCSpause)
+    singlestep(L);
+  g->gcstate = GCSpropagate;  /* old roots stay marked: no `markroot' */
+}
+
+
+static void setgenthreshold (global_State *g) {
+  g->GCthreshold = g->estimate + (g->estimate/100) * g->genminormul;
+}
+
+
+static void fullcollection (lua_State *L) {
+  global_State *g = G(L);
+  int gen = isgenerational(g);
+  if (gen) {  /* whiten old objects with a normal sweep */
+    g->gckind = KGC_NORMAL;
+    g->genold = NULL;
+  }
+  if (g->gcstate <= GCSpropagate) {
+    /* reset sweep marks to sweep all elements (returning them to white) */
+    g->sweepstrgc = 0;
+    g->sweepgc = &g->rootgc;
+    /* reset other collector lists */
+    g->gray = NULL;
+    g->grayagain = NULL;
+    g->weak = NULL;
+    g->gcstate = GCSsweepstring;
+  }
+  lua_assert(g->gcstate != GCSpause && g->gcstate != GCSpropagate);
+  /* finish any pending sweep phase */
+  while (g->gcstate != GCSfinalize) {
+    lua_assert(g->gcstate == GCSsweepstring || g->gcstate == GCSsweep);
+    singlestep(L);
+  }
+  markroot(L);
+  if (gen) {
+    g->gckind = KGC_GEN;
+    gencycle(L);
+    g->genbase = g->estimate;
+    setgenthreshold(g);
+  }
+  else {
+    while (g->gcstate != GCSpause) {
+      singlestep(L);
+    }
+    setthreshold(g);
+  }
+}
+
+
+static void genstep (lua_State *L) {
+  global_State *g = G(L);
+  if (g->genbase == 0)  /* major collection requested? */
+    fullcollection(L);
+  else {
+    gencycle(L);
+    if (g->estimate > (g->genbase/100) * (100 + LUAI_GENMAJORMUL))
+      g->genbase = 0;  /* old generation has grown too much: do a major next */
+    setgenthreshold(g);
+  }
+}
+
+
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
   if(is_block_gc(L)) return;
   set_block_gc(L);
+  if (isgenerational(g)) {
+    genstep(L);
+    unset_block_gc(L);
+    return;
+  }
   l_mem lim = (GCSTEPSIZE/100) * g->gcstepmul;
   if (lim == 0)
     lim = (MAX_LUMEM-1)/2;  /* no limit */
@@ -662,41 +826,78 @@ int luaC_sweepstrgc (lua_State *L) {
 }
 
 void luaC_fullgc (lua_State *L) {
-  global_State *g = G(L);
   if(is_block_gc(L)) return;
   set_block_gc(L);
-  if (g->gcstate <= GCSpropagate) {
-    /* reset sweep marks to sweep all elements (returning them to white) */
-    g->sweepstrgc = 0;
-    g->sweepgc = &g->rootgc;
-    /* reset other collector lists */
-    g->gray = NULL;
-    g->grayagain = NULL;
-    g->weak = NULL;
-    g->gcstate = GCSsweepstring;
+  fullcollection(L);
+  unset_block_gc(L);
+}
+
+
+/*
+** Switch between incremental and generational collection.  Either way a
+** full collection leaves the objects in the state the new mode expects.
+** Nothing is done while the collector is stopped or already running.
+*/
+void luaC_changemode (lua_State *L, int mode) {
+  global_State *g = G(L);
+  if (mode == g->gckind || is_block_gc(L)) return;
+  set_block_gc(L);
+  if (mode == KGC_NORMAL) {
+    g->gckind = KGC_NORMAL;
+    g->genold = NULL;
   }
-  lua_assert(g->gcstate != GCSpause && g->gcstate != GCSpropagate);
-  /* finish any pending sweep phase */
-  while (g->gcstate != GCSfinalize) {
-    lua_assert(g->gcstate == GCSsweepstring || g->gcstate == GCSsweep);
-    singlestep(L);
+  else
+    g->gckind = KGC_GEN;
+  fullcollection(L);
+  unset_block_gc(L);
+}
+
+
+static void censuslist (GCObject *o, lu_mem *count, lu_mem *bytes) {
+  for (; o != NULL; o = o->gch.next) {
+    count[o->gch.tt]++;
+    bytes[o->gch.tt] += objsize(o);
   }
-  markroot(L);
-  while (g->gcstate != GCSpause) {
-    singlestep(L);
+}
+
+
+/*
+** Count the collectable objects of each type and the bytes they use.  The
+** arrays are indexed by type tag up to LUA_TUPVAL.  Objects that are dead
+** but not yet swept are included, so run a full collection first for an
+** exact picture.
+*/
+void luaC_census (lua_State *L, lu_mem *count, lu_mem *bytes) {
+  global_State *g = G(L);
+  UpVal *uv;
+  int i;
+  for (i = 0; i <= LUA_TUPVAL; i++)
+    count[i] = bytes[i] = 0;
+  censuslist(g->rootgc, count, bytes);  /* also holds udata and closed upvalues */
+  for (i = 0; i < g->strt.size; i++)
+    censuslist(g->strt.hash[i], count, bytes);
+  if (g->tmudata) {  /* circular list of udata awaiting finalization */
+    GCObject *o = g->tmudata;
+    do {
+      o = o->gch.next;
+      count[LUA_TUSERDATA]++;
+      bytes[LUA_TUSERDATA] += objsize(o);
+    } while (o != g->tmudata);
+  }
+  for (uv = g->uvhead.u.l.next; uv != &g->uvhead; uv = uv->u.l.next) {
+    count[LUA_TUPVAL]++;  /* open upvalues */
+    bytes[LUA_TUPVAL] += sizeof(UpVal);
   }
-  setthreshold(g);
-  unset_block_gc(L);
 }
 
 
 void luaC_barrierf (lua_State *L, GCObject *o, GCObject *v) {
   global_State *g = G(L);
   lua_assert(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o));
-  lua_assert(g->gcstate != GCSfinalize && g->gcstate != GCSpause);
+  lua_assert(isgenerational(g) || (g->gcstate != GCSfinalize && g->gcstate != GCSpause));
   lua_assert(ttype(&o->gch) != LUA_TTABLE);
   /* must keep invariant? */
-  if (g->gcstate == GCSpropagate)
+  if (keepinvariant(g))
     reallymarkobject(g, v);  /* restore invariant */
   else  /* don't mind */
     makewhite(g, o);  /* mark as white just to avoid other barriers */
@@ -707,7 +908,7 @@ void luaC_barrierback (lua_State *L, Table *t) {
   global_State *g = G(L);
   GCObject *o = obj2gco(t);
   lua_assert(isblack(o) && !isdead(g, o));
-  lua_assert(g->gcstate != GCSfinalize && g->gcstate != GCSpause);
+  lua_assert(isgenerational(g) || (g->gcstate != GCSfinalize && g->gcstate != GCSpause));
   black2gray(o);  /* make table gray (again) */
   t->gclist = g->grayagain;
   g->grayagain = o;
@@ -717,7 +918,7 @@ void luaC_barrierback (lua_State *L, Table *t) {
 void luaC_marknew (lua_State *L, GCObject *o) {
   global_State *g = G(L);
   o->gch.marked = luaC_white(g);
-  if (g->gcstate == GCSpropagate)
+  if (g->gcstate == GCSpropagate && !isgenerational(g))
     reallymarkobject(g, o);  /* mark new objects as gray during propagate state. */
 }
 
@@ -737,7 +938,7 @@ void luaC_linkupval (lua_State *L, UpVal *uv) {
   o->gch.next = g->rootgc;  /* link upvalue into `rootgc' list */
   g->rootgc = o;
   if (isgray(o)) {
-    if (g->gcstate == GCSpropagate) {
+    if (keepinvariant(g)) {
       gray2black(o);  /* closed upvalues need barrier */
       luaC_barrier(L, uv, uv->v);
     }
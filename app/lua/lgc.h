@@ -21,6 +21,21 @@
 #define GCSfinalize	4
 
 
+/*
+** Kinds of garbage collection
+*/
+#define KGC_NORMAL	0	/* incremental */
+#define KGC_GEN		1	/* generational */
+
+#define isgenerational(g)	((g)->gckind == KGC_GEN)
+
+/*
+** Must the barriers keep the invariant that black objects never point to
+** white ones?  Always in generational mode, where old objects stay black.
+*/
+#define keepinvariant(g)	(isgenerational(g) || (g)->gcstate == GCSpropagate)
+
+
 /*
 ** some userful bit tricks
 */
@@ -59,7 +74,7 @@
 ** Layout for bit use in `marked' field:
 ** bit 0 - object is white (type 0)
 ** bit 1 - object is white (type 1)
-** bit 2 - object is black
+** bit 2 - object is black (for strings: old, in generational mode)
 ** bit 3 - for thread: Don't resize thread's stack
 ** bit 3 - for userdata: has been finalized
 ** bit 3 - for tables: has weak keys
@@ -125,6 +140,8 @@ LUAI_FUNC void luaC_callGCTM (lua_State *L);
 LUAI_FUNC void luaC_freeall (lua_State *L);
 LUAI_FUNC void luaC_step (lua_State *L);
 LUAI_FUNC void luaC_fullgc (lua_State *L);
+LUAI_FUNC void luaC_changemode (lua_State *L, int mode);
+LUAI_FUNC void luaC_census (lua_State *L, lu_mem *count, lu_mem *bytes);
 LUAI_FUNC int luaC_sweepstrgc (lua_State *L);
 LUAI_FUNC void luaC_marknew (lua_State *L, GCObject *o);
 LUAI_FUNC void luaC_link (lua_State *L, GCObject *o, lu_byte tt);
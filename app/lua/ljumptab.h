@@ -0,0 +1,47 @@
+/*
+** Jump table for luaV_execute when built with LUA_USE_COMPUTED_GOTO
+** See Copyright Notice in lua.h
+*/
+
+/* ORDER OP */
+static const void *const disptab[NUM_OPCODES] = {
+  &&L_OP_MOVE,
+  &&L_OP_LOADK,
+  &&L_OP_LOADBOOL,
+  &&L_OP_LOADNIL,
+  &&L_OP_GETUPVAL,
+  &&L_OP_GETGLOBAL,
+  &&L_OP_GETTABLE,
+  &&L_OP_SETGLOBAL,
+  &&L_OP_SETUPVAL,
+  &&L_OP_SETTABLE,
+  &&L_OP_NEWTABLE,
+  &&L_OP_SELF,
+  &&L_OP_ADD,
+  &&L_OP_SUB,
+  &&L_OP_MUL,
+  &&L_OP_DIV,
+  &&L_OP_MOD,
+  &&L_OP_POW,
+  &&L_OP_UNM,
+  &&L_OP_NOT,
+  &&L_OP_LEN,
+  &&L_OP_CONCAT,
+  &&L_OP_JMP,
+  &&L_OP_EQ,
+  &&L_OP_LT,
+  &&L_OP_LE,
+  &&L_OP_TEST,
+  &&L_OP_TESTSET,
+  &&L_OP_CALL,
+  &&L_OP_TAILCALL,
+  &&L_OP_RETURN,
+  &&L_OP_FORLOOP,
+  &&L_OP_FORPREP,
+  &&L_OP_TFORLOOP,
+  &&L_OP_SETLIST,
+  &&L_OP_CLOSE,
+  &&L_OP_CLOSURE,
+  &&L_OP_VARARG,
+  &&L_OP_GETGTABLE
+};
@@ -25,6 +25,7 @@
 #include "lauxlib.h"
 #include "lualib.h"
 #include "lrotable.h"
+#include "lflash.h"
 
 /* prefix for open functions in C libraries */
 #define LUA_POF		"luaopen_"
@@ -458,6 +459,21 @@ static int loader_preload (lua_State *L) {
 }
 
 
+#ifdef LUA_FLASH_STORE
+static int loader_flash (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  const char *image = luaN_image();
+  int i = luaN_findmodule(image, name);
+  if (i < 0) {
+    lua_pushfstring(L, "\n\tno module " LUA_QS " in the Lua Flash Store", name);
+    return 1;
+  }
+  luaN_loadmodule(L, image, i);
+  return 1;  /* library loaded successfully */
+}
+#endif
+
+
 static const int sentinel_ = 0;
 #define sentinel	((void *)&sentinel_)
 
@@ -643,7 +659,11 @@ static const luaL_Reg ll_funcs[] = {
 
 
 static const lua_CFunction loaders[] =
+#ifdef LUA_FLASH_STORE
+  {loader_preload, loader_flash, loader_Lua, loader_C, loader_Croot, NULL};
+#else
   {loader_preload, loader_Lua, loader_C, loader_Croot, NULL};
+#endif
 
 #if LUA_OPTIMIZE_MEMORY > 0
 #undef MIN_OPT_LEVEL
@@ -79,6 +79,8 @@ int luaO_rawequalObj (const TValue *t1, const TValue *t2) {
     case LUA_TNIL:
       return 1;
     case LUA_TNUMBER:
+      if (ttisint(t1) && ttisint(t2))
+        return ivalue(t1) == ivalue(t2);
       return luai_numeq(nvalue(t1), nvalue(t2));
     case LUA_TBOOLEAN:
       return bvalue(t1) == bvalue(t2);  /* boolean true must be 1 !! */
@@ -95,8 +97,31 @@ int luaO_rawequalObj (const TValue *t1, const TValue *t2) {
 }
 
 
+/*
+** a decimal integer of up to 9 digits, the common case, is converted
+** without strtod; anything else is left to it
+*/
+static int str2int (const char *s, lua_Number *result) {
+  unsigned int v = 0;
+  int neg, ndigits = 0;
+  while (isspace(cast(unsigned char, *s))) s++;
+  neg = (*s == '-');
+  if (*s == '-' || *s == '+') s++;
+  while (*s >= '0' && *s <= '9') {
+    if (++ndigits > 9) return 0;
+    v = v * 10 + (*s++ - '0');
+  }
+  if (ndigits == 0) return 0;
+  while (isspace(cast(unsigned char, *s))) s++;
+  if (*s != '\0') return 0;
+  *result = neg ? -cast_num(v) : cast_num(v);
+  return 1;
+}
+
+
 int luaO_str2d (const char *s, lua_Number *result) {
   char *endptr;
+  if (str2int(s, result)) return 1;
   *result = lua_str2number(s, &endptr);
   if (endptr == s) return 0;  /* conversion failed */
   if (*endptr == 'x' || *endptr == 'X')  /* maybe an hexadecimal constant? */
@@ -122,6 +147,50 @@ int luaO_str2d (const char *s, lua_Number *result) {
 }
 
 
+/*
+** write i in decimal, as sprintf's "%d" would, and return the length
+*/
+int luaO_int2str (char *s, long long i) {
+  char buf[LUAI_MAXNUMBER2STR];
+  char *p = buf + sizeof(buf);
+  unsigned long long u = (i < 0) ? 0ULL - (unsigned long long)i
+                                 : (unsigned long long)i;
+  unsigned int v;
+  size_t l;
+  while (u > 0xffffffffULL) {  /* only the last 10 digits fit 32 bits */
+    *--p = cast(char, '0' + u % 10);
+    u /= 10;
+  }
+  v = cast(unsigned int, u);
+  do {
+    *--p = cast(char, '0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  if (i < 0) *--p = '-';
+  l = buf + sizeof(buf) - p;
+  c_memcpy(s, p, l);
+  s[l] = '\0';
+  return cast_int(l);
+}
+
+
+/*
+** convert n as lua_number2str does and return the length; integral
+** values, the usual case, don't go through sprintf
+*/
+int luaO_num2str (char *s, lua_Number n) {
+#if defined LUA_NUMBER_INTEGRAL
+  return luaO_int2str(s, n);
+#else
+  /* "%.14g" has no exponent below 1e14; -0 keeps its sign */
+  if (n > -1e14 && n < 1e14 && n == cast_num((long long)n) &&
+      (n != 0 || 1/n > 0))
+    return luaO_int2str(s, (long long)n);
+  lua_number2str(s, n);
+  return cast_int(c_strlen(s));
+#endif
+}
+
 
 static void pushstr (lua_State *L, const char *str) {
   setsvalue2s(L, L->top, luaS_new(L, str));
@@ -35,6 +35,19 @@
 #define LUA_TDEADKEY	(LAST_TAG+3)
 
 
+/*
+** In the float build, a number that is a 32 bit integer (other than -0)
+** may be held as an int, tagged LUA_TNUMINT.  ttype() drops the variant
+** bit, so it is still a LUA_TNUMBER everywhere, and nvalue() converts it;
+** the VM uses the int directly for arithmetic, comparisons, for loops and
+** table indexing, which saves the soft-float calls on the ESP8266.
+*/
+#if !defined(LUA_NUMBER_INTEGRAL) && !defined(LUA_PACK_VALUE)
+#define LUA_TNUMINT	(LUA_TNUMBER | 0x10)
+#define TAGMASK		0x0F
+#endif
+
+
 /*
 ** Union of all collectable objects
 */
@@ -83,6 +96,9 @@ typedef union {
   void *p;
   lua_Number n;
   int b;
+#ifdef LUA_TNUMINT
+  int i;
+#endif
 } Value;
 #endif // #if defined( LUA_PACK_VALUE ) && defined( ELUA_ENDIAN_BIG )
 
@@ -161,7 +177,9 @@ typedef TValuefields TValue;
 #endif // #ifndef LUA_PACK_VALUE
 
 /* Macros to access values */
-#ifndef LUA_PACK_VALUE
+#if defined(LUA_TNUMINT)
+#define ttype(o)	((o)->tt & TAGMASK)
+#elif !defined(LUA_PACK_VALUE)
 #define ttype(o)	((o)->tt)
 #else // #ifndef LUA_PACK_VALUE
 #define ttype(o)	((o)->_t.sig == LUA_NOTNUMBER_SIG ? (o)->_t.tt : LUA_TNUMBER)
@@ -171,7 +189,16 @@ typedef TValuefields TValue;
 #define pvalue(o)	check_exp(ttislightuserdata(o), (o)->value.p)
 #define rvalue(o)	check_exp(ttisrotable(o), (o)->value.p)
 #define fvalue(o) check_exp(ttislightfunction(o), (o)->value.p)
+#ifdef LUA_TNUMINT
+#define ttisint(o)	((o)->tt == LUA_TNUMINT)
+#define ivalue(o)	check_exp(ttisint(o), (o)->value.i)
+#define nvalue(o)	check_exp(ttisnumber(o), \
+                  ttisint(o) ? cast_num((o)->value.i) : (o)->value.n)
+#else
+#define ttisint(o)	0
+#define ivalue(o)	cast_int(nvalue(o))
 #define nvalue(o)	check_exp(ttisnumber(o), (o)->value.n)
+#endif
 #define rawtsvalue(o)	check_exp(ttisstring(o), &(o)->value.gc->ts)
 #define tsvalue(o)	(&rawtsvalue(o)->tsv)
 #define rawuvalue(o)	check_exp(ttisuserdata(o), &(o)->value.gc->u)
@@ -209,6 +236,21 @@ typedef TValuefields TValue;
 #define setnvalue(obj,x) \
   { lua_Number i_x = (x); TValue *i_o=(obj); i_o->value.n=i_x; i_o->tt=LUA_TNUMBER; }
 
+#ifdef LUA_TNUMINT
+#define setivalue(obj,x) \
+  { int i_x = (x); TValue *i_o=(obj); i_o->value.i=i_x; i_o->tt=LUA_TNUMINT; }
+
+/* set a number, as an int if it is one */
+#define setnumvalue(obj,x) \
+  { lua_Number i_n = (x); int i_k; TValue *i_o=(obj); lua_number2int(i_k, i_n); \
+    if (luai_numeq(cast_num(i_k), i_n) && (i_k != 0 || 1/i_n > 0)) \
+      { i_o->value.i=i_k; i_o->tt=LUA_TNUMINT; } \
+    else { i_o->value.n=i_n; i_o->tt=LUA_TNUMBER; } }
+#else
+#define setivalue(obj,x)	setnvalue(obj, cast_num(x))
+#define setnumvalue(obj,x)	setnvalue(obj, x)
+#endif
+
 #define setpvalue(obj,x) \
   { void *i_x = (x); TValue *i_o=(obj); i_o->value.p=i_x; i_o->tt=LUA_TLIGHTUSERDATA; }
 
@@ -341,7 +383,7 @@ typedef TValuefields TValue;
 #define setsvalue2n	setsvalue
 
 #ifndef LUA_PACK_VALUE
-#define setttype(obj, tt) (ttype(obj) = (tt))
+#define setttype(obj, _tt) ((obj)->tt = (_tt))
 #else // #ifndef LUA_PACK_VALUE
 /* considering it used only in lgc to set LUA_TDEADKEY */
 /* we could define it this way */
@@ -549,6 +591,8 @@ LUAI_FUNC int luaO_int2fb (unsigned int x);
 LUAI_FUNC int luaO_fb2int (int x);
 LUAI_FUNC int luaO_rawequalObj (const TValue *t1, const TValue *t2);
 LUAI_FUNC int luaO_str2d (const char *s, lua_Number *result);
+LUAI_FUNC int luaO_int2str (char *s, long long i);
+LUAI_FUNC int luaO_num2str (char *s, lua_Number n);
 LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
                                                        va_list argp);
 LUAI_FUNC const char *luaO_pushfstring (lua_State *L, const char *fmt, ...);
@@ -245,11 +245,44 @@ static int singlevaraux (FuncState *fs, TString *n, expdesc *var, int base) {
 }
 
 
+#ifdef LUA_CROSS_COMPILER
+/*
+** luac.cross -c loads the numeric constants of the firmware's ROM modules
+** into registry[LUA_ROMCONST_KEY] as {module = {key = value}}.  A field
+** module.KEY of a global then compiles to the number itself, saving the
+** GETGLOBAL and GETTABLE and the two names in the constant pool.
+*/
+static int romconst (LexState *ls, TString *varname, expdesc *var) {
+  lua_State *L = ls->L;
+  const TValue *t, *m, *k;
+  if (ls->t.token != '.')
+    return 0;
+  t = luaH_getstr(hvalue(registry(L)), luaS_newliteral(L, LUA_ROMCONST_KEY));
+  if (!ttistable(t) || !ttistable(m = luaH_getstr(hvalue(t), varname)))
+    return 0;
+  luaX_lookahead(ls);
+  if (ls->lookahead.token != TK_NAME ||
+      !ttisnumber(k = luaH_getstr(hvalue(m), ls->lookahead.seminfo.ts)))
+    return 0;
+  luaX_next(ls);  /* skip the dot */
+  luaX_next(ls);  /* and the key */
+  init_exp(var, VKNUM, 0);
+  var->u.nval = nvalue(k);
+  return 1;
+}
+#endif
+
+
 static void singlevar (LexState *ls, expdesc *var) {
   TString *varname = str_checkname(ls);
   FuncState *fs = ls->fs;
-  if (singlevaraux(fs, varname, var, 1) == VGLOBAL)
+  if (singlevaraux(fs, varname, var, 1) == VGLOBAL) {
+#ifdef LUA_CROSS_COMPILER
+    if (romconst(ls, varname, var))
+      return;
+#endif
     var->u.s.info = luaK_stringK(fs, varname);  /* info points to global name */
+  }
 }
 
 
@@ -359,6 +392,30 @@ static void open_func (LexState *ls, FuncState *fs) {
 }
 
 
+#if defined(LUA_CROSS_COMPILER) || defined(LUA_OPTIMIZE_BYTECODE)
+/*
+** Optimize a function just compiled, before any of its debug information
+** is stripped, if registry[&luaK_optimize] is set.  If it holds a
+** luaK_Report, as for luac.cross -O, that is told the result.
+*/
+static void optimizefunc (lua_State *L, Proto *f) {
+  int oldsize = f->sizecode, hoisted;
+  void *report;
+  lua_pushlightuserdata(L, (void *)&luaK_optimize);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    return;
+  }
+  report = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  hoisted = luaK_optimize(L, f);
+  if (report)
+    (*(luaK_Report)report)(L, f, oldsize, hoisted);
+}
+#endif
+
+
 static void close_func (LexState *ls) {
   lua_State *L = ls->L;
   FuncState *fs = ls->fs;
@@ -384,6 +441,9 @@ static void close_func (LexState *ls) {
   f->sizelocvars = fs->nlocvars;
   luaM_reallocvector(L, f->upvalues, f->sizeupvalues, f->nups, TString *);
   f->sizeupvalues = f->nups;
+#if defined(LUA_CROSS_COMPILER) || defined(LUA_OPTIMIZE_BYTECODE)
+  optimizefunc(L, f);
+#endif
   lua_assert(luaG_checkcode(f));
   lua_assert(fs->bl == NULL);
   ls->fs = fs->prev;
@@ -408,6 +468,58 @@ static void compile_stripdebug(lua_State *L, Proto *f) {
 #endif
 
 
+static CompileStream *getstream (lua_State *L) {
+  CompileStream *stream;
+  lua_pushlightuserdata(L, (void *)&luaY_parser);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  stream = (CompileStream *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return stream;
+}
+
+
+/*
+** Hand a function of the main chunk to node.compile() and free its code,
+** constants, nested functions and debug information.  Its `nups' is kept,
+** as OP_CLOSURE in the main function needs it.
+*/
+static void streamfunc (LexState *ls, Proto *f) {
+  lua_State *L = ls->L;
+#ifdef LUA_OPTIMIZE_DEBUG
+  compile_stripdebug(L, f);
+#endif
+  ls->stream->emit(L, f, ls->stream->ud);
+  luaM_freearray(L, f->code, f->sizecode, Instruction);
+  f->code = NULL;
+  f->sizecode = 0;
+#ifdef LUA_OPTIMIZE_DEBUG
+  if (f->packedlineinfo) {
+    luaM_freearray(L, f->packedlineinfo, c_strlen(cast(char *, f->packedlineinfo))+1, unsigned char);
+    f->packedlineinfo = NULL;
+  }
+#else
+  luaM_freearray(L, f->lineinfo, f->sizelineinfo, int);
+  f->lineinfo = NULL;
+  f->sizelineinfo = 0;
+#endif
+  luaM_freearray(L, f->k, f->sizek, TValue);
+  f->k = NULL;
+  f->sizek = 0;
+  luaM_freearray(L, f->p, f->sizep, Proto *);  /* collected by the GC */
+  f->p = NULL;
+  f->sizep = 0;
+  luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar);
+  f->locvars = NULL;
+  f->sizelocvars = 0;
+  luaM_freearray(L, f->upvalues, f->sizeupvalues, TString *);
+  f->upvalues = NULL;
+  f->sizeupvalues = 0;
+  /* a long token may have grown the lexer buffer; it is empty between tokens */
+  if (luaZ_sizebuffer(ls->buff) > LUA_MINBUFFER)
+    luaZ_resizebuffer(L, ls->buff, LUA_MINBUFFER);
+}
+
+
 Proto *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff, const char *name) {
   struct LexState lexstate;
   struct FuncState funcstate;
@@ -415,6 +527,7 @@ Proto *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff, const char *name) {
   setsvalue2s(L, L->top, tname);  /* protect name */
   incr_top(L);
   lexstate.buff = buff;
+  lexstate.stream = getstream(L);
   luaX_setinput(L, &lexstate, z, tname);
   open_func(&lexstate, &funcstate);
   funcstate.f->is_vararg = VARARG_ISVARARG;  /* main func. is always vararg */
@@ -625,6 +738,8 @@ static void body (LexState *ls, expdesc *e, int needself, int line) {
   check_match(ls, TK_END, TK_FUNCTION, line);
   close_func(ls);
   pushclosure(ls, &new_fs, e);
+  if (ls->stream && ls->fs->prev == NULL)
+    streamfunc(ls, new_fs.f);
 }
 
 
@@ -966,6 +1081,7 @@ static void check_conflict (LexState *ls, struct LHS_assign *lh, expdesc *v) {
 
 static void assignment (LexState *ls, struct LHS_assign *lh, int nvars) {
   expdesc e;
+  check_condition(ls, lh->v.k != VKNUM, "cannot assign to a constant");
   check_condition(ls, VLOCAL <= lh->v.k && lh->v.k <= VINDEXED,
                       "syntax error");
   if (testnext(ls, ',')) {  /* assignment -> `,' primaryexp assignment */
@@ -1252,6 +1368,7 @@ static void funcstat (LexState *ls, int line) {
   expdesc v, b;
   luaX_next(ls);  /* skip FUNCTION */
   needself = funcname(ls, &v);
+  check_condition(ls, v.k != VKNUM, "cannot assign to a constant");
   body(ls, &b, needself, line);
   luaK_storevar(ls->fs, &v, &b);
   luaK_fixline(ls->fs, line);  /* definition `happens' in the first line */
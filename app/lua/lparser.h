@@ -84,5 +84,21 @@ typedef struct FuncState {
 LUAI_FUNC Proto *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
                                             const char *name);
 
+/*
+** node.compile() stores a pointer to this in the registry, under the key
+** &luaY_parser, to get each function of the main chunk as soon as it has
+** been compiled.  The parser then releases all of the function but the
+** header that the code of the main function refers to.
+*/
+typedef struct CompileStream {
+  void (*emit) (lua_State *L, Proto *f, void *ud);
+  void *ud;
+} CompileStream;
+
+#ifdef LUA_CROSS_COMPILER
+/* registry key of the ROM module constants folded by luac.cross -c */
+#define LUA_ROMCONST_KEY	"_ROMCONST"
+#endif
+
 
 #endif
@@ -13,49 +13,89 @@
 #define LUAR_FINDFUNCTION     0
 #define LUAR_FINDVALUE        1
 
-/* Externally defined read-only table array */
+/* Externally defined read-only table array, sorted by name at link time */
 extern const luaR_table lua_rotable[];
+extern const luaR_table lua_rotable_end[];
 
-/* Find a global "read only table" in the constant lua_rotable array */
-void* luaR_findglobal(const char *name, unsigned len) {
+/* Compare a counted, not necessarily terminated, name with a rotable name */
+static int luaR_namecmp(const char *name, unsigned len, const char *rname) {
   unsigned i;
+  for (i = 0; i < len; i++) {
+    int c = (unsigned char)name[i] - (unsigned char)rname[i];
+    if (c != 0 || rname[i] == '\0')
+      return c ? c : 1;
+  }
+  return rname[len] != '\0' ? -1 : 0;
+}
+
+/* Find a global "read only table" by a binary search of lua_rotable */
+void* luaR_findglobal(const char *name, unsigned len) {
+  const luaR_table *lo = lua_rotable, *hi = lua_rotable_end;
 
-  if (c_strlen(name) > LUA_MAX_ROTABLE_NAME)
+  if (len == 0 || len > LUA_MAX_ROTABLE_NAME)
     return NULL;
-  for (i=0; lua_rotable[i].name; i ++)
-    if (*lua_rotable[i].name != '\0' && c_strlen(lua_rotable[i].name) == len && !c_strncmp(lua_rotable[i].name, name, len)) {
-      return (void*)(lua_rotable[i].pentries);
-    }
+  while (lo < hi) {
+    const luaR_table *mid = lo + (hi - lo) / 2;
+    int c = luaR_namecmp(name, len, mid->name);
+    if (c == 0)
+      return (void*)(mid->pentries);
+    if (c < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
   return NULL;
 }
 
-/* Find an entry in a rotable and return it */
-static const TValue* luaR_auxfind(const luaR_entry *pentry, const char *strkey, luaR_numkey numkey, unsigned *ppos) {
-  const TValue *res = NULL;
-  unsigned i = 0;
-  
+/* The LRO_KEYTAG of a string of length l */
+lu_int32 luaR_strtag(const char *s, size_t l) {
+  lu_int32 h = 0, m = 1;
+  size_t i;
+  for (i = 0; i < l && i < LUA_MAX_ROTABLE_NAME; i++, m *= 31u)
+    h += (lu_int32)(unsigned char)s[i] * m;
+  return LRO_STRTAG(l, h);
+}
+
+/* Find a string key in a rotable, comparing the tags of the entries */
+static const luaR_entry* luaR_findstr(const luaR_entry *pentry, const char *strkey, size_t len) {
+  lu_int32 tag;
+
+  if (pentry == NULL || len > LUA_MAX_ROTABLE_NAME)
+    return NULL;
+  tag = luaR_strtag(strkey, len);
+  for (; pentry->key.tag != LUA_TNIL; pentry ++)
+    if (pentry->key.tag == tag &&
+        (pentry->key.id.strkey == strkey || !c_memcmp(pentry->key.id.strkey, strkey, len)))
+      return pentry;
+  return NULL;
+}
+
+/* Find a number key in a rotable */
+static const luaR_entry* luaR_findnum(const luaR_entry *pentry, luaR_numkey numkey) {
   if (pentry == NULL)
-    return NULL;  
-  while(pentry->key.type != LUA_TNIL) {
-    if ((strkey && (pentry->key.type == LUA_TSTRING) && (!c_strcmp(pentry->key.id.strkey, strkey))) || 
-        (!strkey && (pentry->key.type == LUA_TNUMBER) && ((luaR_numkey)pentry->key.id.numkey == numkey))) {
-      res = &pentry->value;
-      break;
-    }
-    i ++; pentry ++;
-  }
-  if (res && ppos)
-    *ppos = i;   
-  return res;
+    return NULL;
+  for (; pentry->key.tag != LUA_TNIL; pentry ++)
+    if (pentry->key.tag == LUA_TNUMBER && pentry->key.id.numkey == numkey)
+      return pentry;
+  return NULL;
+}
+
+static const TValue* luaR_result(const luaR_entry *pentries, const luaR_entry *pentry, unsigned *ppos) {
+  if (pentry == NULL)
+    return NULL;
+  if (ppos)
+    *ppos = pentry - pentries;
+  return &pentry->value;
 }
 
 int luaR_findfunction(lua_State *L, const luaR_entry *ptable) {
-  const TValue *res = NULL;
-  const char *key = luaL_checkstring(L, 2);
+  const luaR_entry *res;
+  size_t len;
+  const char *key = luaL_checklstring(L, 2, &len);
     
-  res = luaR_auxfind(ptable, key, 0, NULL);  
-  if (res && ttislightfunction(res)) {
-    luaA_pushobject(L, res);
+  res = luaR_findstr(ptable, key, len);
+  if (res && ttislightfunction(&res->value)) {
+    luaA_pushobject(L, &res->value);
     return 1;
   }
   else
@@ -66,49 +106,61 @@ int luaR_findfunction(lua_State *L, const luaR_entry *ptable) {
    If "strkey" is not NULL, the function will look for a string key,
    otherwise it will look for a number key */
 const TValue* luaR_findentry(void *data, const char *strkey, luaR_numkey numkey, unsigned *ppos) {
-  return luaR_auxfind((const luaR_entry*)data, strkey, numkey, ppos);
+  const luaR_entry *pentries = (const luaR_entry*)data;
+  if (strkey)
+    return luaR_result(pentries, luaR_findstr(pentries, strkey, c_strlen(strkey)), ppos);
+  return luaR_result(pentries, luaR_findnum(pentries, numkey), ppos);
+}
+
+/* Same as luaR_findentry, but for a Lua string key, using its length */
+const TValue* luaR_findstrentry(void *data, const TString *key, unsigned *ppos) {
+  const luaR_entry *pentries = (const luaR_entry*)data;
+  return luaR_result(pentries, luaR_findstr(pentries, getstr(key), key->tsv.len), ppos);
 }
 
 /* Find the metatable of a given table */
 void* luaR_getmeta(void *data) {
 #ifdef LUA_META_ROTABLES
-  const TValue *res = luaR_auxfind((const luaR_entry*)data, "__metatable", 0, NULL);
-  return res && ttisrotable(res) ? rvalue(res) : NULL;
+  const luaR_entry *res = luaR_findstr((const luaR_entry*)data, "__metatable", sizeof("__metatable")-1);
+  return res && ttisrotable(&res->value) ? rvalue(&res->value) : NULL;
 #else
   return NULL;
 #endif
 }
 
-static void luaR_next_helper(lua_State *L, const luaR_entry *pentries, int pos, TValue *key, TValue *val) {
+static void luaR_next_helper(lua_State *L, const luaR_entry *pentries, unsigned pos, TValue *key, TValue *val) {
   setnilvalue(key);
   setnilvalue(val);
-  if (pentries[pos].key.type != LUA_TNIL) {
+  if (pentries[pos].key.tag != LUA_TNIL) {
     /* Found an entry */
-    if (pentries[pos].key.type == LUA_TSTRING)
+    if (luaR_keytype(&pentries[pos].key) == LUA_TSTRING)
       setsvalue(L, key, luaS_newro(L, pentries[pos].key.id.strkey))
     else
       setnvalue(key, (lua_Number)pentries[pos].key.id.numkey)
    setobj2s(L, val, &pentries[pos].value);
   }
 }
-/* next (used for iteration) */
+
+/*
+ * next (used for iteration).  The previous key is found again from the key
+ * alone, by its tag; a string key made by luaR_next_helper() points at the
+ * name of its entry, so its characters are normally not compared either.
+ */
 void luaR_next(lua_State *L, void *data, TValue *key, TValue *val) {
   const luaR_entry* pentries = (const luaR_entry*)data;
-  char strkey[LUA_MAX_ROTABLE_NAME + 1], *pstrkey = NULL;
-  luaR_numkey numkey = 0;
   unsigned keypos;
   
   /* Special case: if key is nil, return the first element of the rotable */
   if (ttisnil(key)) 
     luaR_next_helper(L, pentries, 0, key, val);
   else if (ttisstring(key) || ttisnumber(key)) {
-    /* Find the previoud key again */  
-    if (ttisstring(key)) {
-      luaR_getcstr(strkey, rawtsvalue(key), LUA_MAX_ROTABLE_NAME);          
-      pstrkey = strkey;
-    } else   
-      numkey = (luaR_numkey)nvalue(key);
-    luaR_findentry(data, pstrkey, numkey, &keypos);
+    /* Find the previous key again */
+    if ((ttisstring(key) ? luaR_findstrentry(data, rawtsvalue(key), &keypos) :
+         luaR_findentry(data, NULL, (luaR_numkey)nvalue(key), &keypos)) == NULL) {
+      setnilvalue(key);
+      setnilvalue(val);
+      return;
+    }
     /* Advance to next key */
     keypos ++;    
     luaR_next_helper(L, pentries, keypos, key, val);
@@ -129,8 +181,14 @@ void luaR_getcstr(char *dest, const TString *src, size_t maxsize) {
 #ifdef LUA_META_ROTABLES
 
 #include "compiler.h"
+#include "lflash.h"
 
 int luaR_isrotable(void *p) {
+#if defined(LUA_FREEZE_STORE) && !defined(LUA_CROSS_COMPILER)
+  /* tables frozen by node.freeze() live past the end of irom0 text */
+  if (luaN_isfrozen(p))
+    return 1;
+#endif
   return RODATA_START_ADDRESS <= (char*)p && (char*)p <= RODATA_END_ADDRESS;
 }
 #endif
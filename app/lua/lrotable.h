@@ -30,7 +30,26 @@
 #endif // #ifdef ELUA_ENDIAN_LITTLE
 #endif // #ifndef LUA_PACK_VALUE
 
-#define LRO_STRKEY(k)   {LUA_TSTRING, {.strkey = k}}
+/*
+** A key starts with a tag word: its type, and for a string key also its
+** length and a 16 bit hash of its characters, the sum of s[i]*31^i.  The
+** compiler works the tag of a string literal out, so a lookup compares one
+** word per entry and only reads the name of an entry whose tag matches.
+** k must be a literal of at most LUA_MAX_ROTABLE_NAME characters.
+*/
+#define LRO_CHAR(k,i)     ((i) < sizeof(k)-1 ? (lu_int32)(unsigned char)(k)[i] : 0u)
+#define LRO_HASH4(k,i,m)  (LRO_CHAR(k,i)*(m) + LRO_CHAR(k,(i)+1)*(m)*31u + \
+                           LRO_CHAR(k,(i)+2)*(m)*961u + LRO_CHAR(k,(i)+3)*(m)*29791u)
+#define LRO_HASH16(k,i,m) (LRO_HASH4(k,i,m) + LRO_HASH4(k,(i)+4,(m)*923521u) + \
+                           LRO_HASH4(k,(i)+8,(m)*923521u*923521u) + \
+                           LRO_HASH4(k,(i)+12,(m)*923521u*923521u*923521u))
+#define LRO_HASH(k)       (LRO_HASH16(k,0,1u) + \
+                           LRO_HASH16(k,16,923521u*923521u*923521u*923521u))
+#define LRO_STRTAG(l, h)  (LUA_TSTRING | (lu_int32)((l) & 0xff)<<8 | (lu_int32)((h) & 0xffff)<<16)
+#define LRO_KEYTAG(k)     LRO_STRTAG(sizeof(k)-1, LRO_HASH(k))
+#define luaR_keytype(k)   ((int)((k)->tag & 0xff))
+
+#define LRO_STRKEY(k)   {LRO_KEYTAG(k), {.strkey = k}}
 #define LRO_NUMKEY(k)   {LUA_TNUMBER, {.numkey = k}}
 #define LRO_NILKEY      {LUA_TNIL, {.strkey=NULL}}
 
@@ -43,7 +62,7 @@ typedef int luaR_numkey;
 /* The next structure defines the type of a key */
 typedef struct
 {
-  int type;
+  lu_int32 tag;
   union
   {
     const char*   strkey;
@@ -58,7 +77,7 @@ typedef struct
   const TValue value;
 } luaR_entry;
 
-/* A rotable */
+/* A rotable; lua_rotable[] is sorted by name by the linker */
 typedef struct
 {
   const char *name;
@@ -68,6 +87,8 @@ typedef struct
 void* luaR_findglobal(const char *key, unsigned len);
 int luaR_findfunction(lua_State *L, const luaR_entry *ptable);
 const TValue* luaR_findentry(void *data, const char *strkey, luaR_numkey numkey, unsigned *ppos);
+const TValue* luaR_findstrentry(void *data, const TString *key, unsigned *ppos);
+lu_int32 luaR_strtag(const char *s, size_t l);
 void luaR_getcstr(char *dest, const TString *src, size_t maxsize);
 void luaR_next(lua_State *L, void *data, TValue *key, TValue *val);
 void* luaR_getmeta(void *data);
@@ -72,6 +72,7 @@ typedef struct global_State {
   lu_byte currentwhite;
   lu_byte gcstate;  /* state of garbage collector */
   lu_byte gcflags;  /* flags for the garbage collector */
+  lu_byte gckind;  /* kind of GC running: KGC_NORMAL or KGC_GEN */
   int sweepstrgc;  /* position of sweep in `strt' */
   GCObject *rootgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* position of sweep in `rootgc' */
@@ -87,6 +88,10 @@ typedef struct global_State {
   lu_mem gcdept;  /* how much GC is `behind schedule' */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC `granularity' */
+  GCObject *genold;  /* first old object in `rootgc', NULL for a major GC */
+  int genstrsize;  /* size of `strt' when all its strings were last old */
+  lu_mem genbase;  /* estimate after the last major GC, 0 to request one */
+  int genminormul;  /* heap growth (%) that triggers a minor collection */
   int egcmode;    /* emergency garbage collection operation mode */
   lua_CFunction panic;  /* to be called in unprotected errors */
   TValue l_registry;
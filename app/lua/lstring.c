@@ -13,6 +13,7 @@
 #include "lua.h"
 #include C_HEADER_STRING
 
+#include "lflash.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -81,13 +82,24 @@ static TString *newlstr (lua_State *L, const char *str, size_t l,
 }
 
 
-static TString *luaS_newlstr_helper (lua_State *L, const char *str, size_t l, int readonly) {
-  GCObject *o;
+unsigned int luaS_hash (const char *str, size_t l) {
   unsigned int h = cast(unsigned int, l);  /* seed */
   size_t step = (l>>5)+1;  /* if string is too long, don't hash all its chars */
   size_t l1;
   for (l1=l; l1>=step; l1-=step)  /* compute hash */
     h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, str[l1-1]));
+  return h;
+}
+
+
+static TString *luaS_newlstr_helper (lua_State *L, const char *str, size_t l, int readonly) {
+  GCObject *o;
+  unsigned int h = luaS_hash(str, l);
+#ifdef LUA_FLASH_STORE
+  TString *ts = luaN_findstring(str, l, h);
+  if (ts != NULL)
+    return ts;
+#endif
   for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
        o != NULL;
        o = o->gch.next) {
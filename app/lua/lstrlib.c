@@ -164,10 +164,14 @@ static int str_dump (lua_State *L) {
 #define CAP_UNFINISHED	(-1)
 #define CAP_POSITION	(-2)
 
+typedef struct PItem PItem;
+
 typedef struct MatchState {
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end (`\0') of source string */
   lua_State *L;
+  const PItem *prog;  /* compiled pattern, or NULL to interpret it */
+  const unsigned char *sets;  /* the bitmaps of its classes */
   int level;  /* total number of captures (finished or unfinished) */
   struct {
     const char *init;
@@ -438,6 +442,362 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
 
 
 
+/*
+** {======================================================
+** Compiled patterns
+** A pattern that is used again is compiled into an array of items,
+** one per pattern item, with each character class turned into a
+** bitmap of the characters it matches.  cmatch() then follows match()
+** step by step, without parsing the pattern or testing classes again.
+** Only well formed patterns are compiled: a malformed one is left to
+** match(), so that errors are raised exactly as before.  The last
+** PCACHE_SIZE patterns are remembered in a cache in the registry; a
+** pattern is compiled the second time it is seen.
+** =======================================================
+*/
+
+enum { P_END, P_EOS, P_OPEN, P_POSITION, P_CLOSE, P_BALANCE, P_FRONTIER,
+       P_BACKREF, P_ANY, P_CHAR, P_SET };
+
+struct PItem {
+  unsigned char op;
+  unsigned char rep;  /* '?', '*', '+', '-' after a single char item, or 0 */
+  unsigned char c1, c2;  /* P_CHAR, P_BACKREF and P_BALANCE characters */
+  unsigned short set;  /* offset of the bitmap of a P_SET or P_FRONTIER */
+};
+
+#define PCACHE_SIZE	8
+#define PMAXSIZE	4096  /* longer programs are not worth caching */
+
+typedef struct PCache {
+  const char *pat[PCACHE_SIZE];  /* the patterns, most recently used first */
+  const PItem *prog[PCACHE_SIZE];  /* their programs, or NULL if not compiled */
+} PCache;
+
+static const PItem nocompile;  /* program of a malformed pattern */
+static const char pcache_key = 'p';  /* registry key of the cache */
+
+#define testbit(set,c)	((set)[(c) >> 3] & (1 << ((c) & 7)))
+
+
+/* like classend(), but returns NULL for a malformed class */
+static const char *pclassend (const char *p) {
+  switch (*p++) {
+    case L_ESC:
+      return (*p == '\0') ? NULL : p+1;
+    case '[':
+      if (*p == '^') p++;
+      do {
+        if (*p == '\0') return NULL;
+        if (*(p++) == L_ESC && *p != '\0') p++;
+      } while (*p != ']');
+      return p+1;
+    default:
+      return p;
+  }
+}
+
+
+/*
+** compile p into items and bitmaps at sets; with items NULL, only
+** count them.  Returns the number of items, or -1 for a malformed pattern
+*/
+static int pcompile (const char *p, PItem *items, unsigned char *sets,
+                     int *nsets) {
+  int ni = 0;
+  *nsets = 0;
+  for (;;) {
+    PItem it;
+    const char *cl = NULL, *ce = NULL;  /* a class to turn into a bitmap */
+    it.op = P_END;
+    it.rep = it.c1 = it.c2 = 0;
+    it.set = 0;
+    switch (*p) {
+      case '(':
+        if (*(p+1) == ')') { it.op = P_POSITION; p += 2; }
+        else { it.op = P_OPEN; p++; }
+        break;
+      case ')':
+        it.op = P_CLOSE; p++;
+        break;
+      case '\0':
+        break;
+      case '$':
+        if (*(p+1) == '\0') { it.op = P_EOS; p++; break; }
+        goto single;
+      case L_ESC:
+        if (*(p+1) == 'b') {
+          if (*(p+2) == '\0' || *(p+3) == '\0') return -1;
+          it.op = P_BALANCE; it.c1 = uchar(*(p+2)); it.c2 = uchar(*(p+3));
+          p += 4;
+          break;
+        }
+        if (*(p+1) == 'f') {
+          p += 2;
+          if (*p != '[' || (ce = pclassend(p)) == NULL) return -1;
+          it.op = P_FRONTIER;
+          cl = p;
+          p = ce;
+          break;
+        }
+        if (isdigit(uchar(*(p+1)))) {
+          it.op = P_BACKREF; it.c1 = uchar(*(p+1));
+          p += 2;
+          break;
+        }
+        /* else go through */
+      default: single: {
+        const char *ep = pclassend(p);
+        if (ep == NULL) return -1;
+        if (*p == '.') it.op = P_ANY;
+        else if (ep == p+1) { it.op = P_CHAR; it.c1 = uchar(*p); }
+        else { it.op = P_SET; cl = p; ce = ep; }
+        if (*ep == '?' || *ep == '*' || *ep == '+' || *ep == '-')
+          it.rep = uchar(*ep++);
+        p = ep;
+        break;
+      }
+    }
+    if (cl != NULL) {  /* build the bitmap of the class from cl to ce */
+      if (items != NULL) {
+        unsigned char *set = sets + *nsets * 32;
+        int c;
+        c_memset(set, 0, 32);
+        for (c = 0; c < 256; c++) {
+          if (it.op == P_FRONTIER ? matchbracketclass(c, cl, ce-1)
+                                  : singlematch(c, cl, ce))
+            set[c >> 3] |= 1 << (c & 7);
+        }
+      }
+      it.set = (unsigned short)(*nsets * 32);
+      (*nsets)++;
+    }
+    if (items != NULL) items[ni] = it;
+    ni++;
+    if (it.op == P_END) return ni;
+  }
+}
+
+
+static int csingle (const MatchState *ms, int c, const PItem *p) {
+  switch (p->op) {
+    case P_ANY: return 1;
+    case P_CHAR: return (p->c1 == c);
+    default: return testbit(ms->sets + p->set, c);
+  }
+}
+
+
+static const char *cmatch (MatchState *ms, const char *s, const PItem *p);
+
+static const char *cmax_expand (MatchState *ms, const char *s,
+                                  const PItem *p) {
+  ptrdiff_t i = 0;  /* counts maximum expand for item */
+  while ((s+i)<ms->src_end && csingle(ms, uchar(*(s+i)), p))
+    i++;
+  /* keeps trying to match with the maximum repetitions */
+  while (i>=0) {
+    const char *res = cmatch(ms, (s+i), p+1);
+    if (res) return res;
+    i--;  /* else didn't match; reduce 1 repetition to try again */
+  }
+  return NULL;
+}
+
+
+static const char *cmin_expand (MatchState *ms, const char *s,
+                                  const PItem *p) {
+  for (;;) {
+    const char *res = cmatch(ms, s, p+1);
+    if (res != NULL)
+      return res;
+    else if (s<ms->src_end && csingle(ms, uchar(*s), p))
+      s++;  /* try with one more repetition */
+    else return NULL;
+  }
+}
+
+
+static const char *cmatch (MatchState *ms, const char *s, const PItem *p) {
+  init: /* using goto's to optimize tail recursion */
+  switch (p->op) {
+    case P_OPEN: case P_POSITION: {  /* start capture */
+      const char *res;
+      int level = ms->level;
+      if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
+      ms->capture[level].init = s;
+      ms->capture[level].len = (p->op == P_POSITION) ? CAP_POSITION
+                                                      : CAP_UNFINISHED;
+      ms->level = level+1;
+      if ((res=cmatch(ms, s, p+1)) == NULL)  /* match failed? */
+        ms->level--;  /* undo capture */
+      return res;
+    }
+    case P_CLOSE: {  /* end capture */
+      int l = capture_to_close(ms);
+      const char *res;
+      ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+      if ((res = cmatch(ms, s, p+1)) == NULL)  /* match failed? */
+        ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
+      return res;
+    }
+    case P_BALANCE: {  /* balanced string */
+      int cont = 1;
+      if (uchar(*s) != p->c1) return NULL;
+      for (;;) {
+        if (++s >= ms->src_end) return NULL;  /* string ends out of balance */
+        if (uchar(*s) == p->c2) {
+          if (--cont == 0) break;
+        }
+        else if (uchar(*s) == p->c1) cont++;
+      }
+      s++; p++; goto init;
+    }
+    case P_FRONTIER: {
+      const unsigned char *set = ms->sets + p->set;
+      int previous = (s == ms->src_init) ? '\0' : uchar(*(s-1));
+      if (testbit(set, previous) || !testbit(set, uchar(*s))) return NULL;
+      p++; goto init;
+    }
+    case P_BACKREF: {  /* capture results (%0-%9) */
+      s = match_capture(ms, s, p->c1);
+      if (s == NULL) return NULL;
+      p++; goto init;
+    }
+    case P_END: {  /* end of pattern */
+      return s;  /* match succeeded */
+    }
+    case P_EOS: {  /* `$' at the end of the pattern */
+      return (s == ms->src_end) ? s : NULL;
+    }
+    default: {  /* a single char item */
+      int m = s<ms->src_end && csingle(ms, uchar(*s), p);
+      switch (p->rep) {
+        case '?': {  /* optional */
+          const char *res;
+          if (m && ((res=cmatch(ms, s+1, p+1)) != NULL))
+            return res;
+          p++; goto init;
+        }
+        case '*': {  /* 0 or more repetitions */
+          return cmax_expand(ms, s, p);
+        }
+        case '+': {  /* 1 or more repetitions */
+          return (m ? cmax_expand(ms, s+1, p) : NULL);
+        }
+        case '-': {  /* 0 or more repetitions (minimum) */
+          return cmin_expand(ms, s, p);
+        }
+        default: {
+          if (!m) return NULL;
+          s++; p++; goto init;
+        }
+      }
+    }
+  }
+}
+
+
+/*
+** compile pattern p, leaving its program on the stack: a header item
+** with the offset of the bitmaps, the items, then the bitmaps
+*/
+static const PItem *newprog (lua_State *L, const char *p) {
+  int nsets;
+  int ni = pcompile(p, NULL, NULL, &nsets);
+  size_t size;
+  PItem *prog;
+  if (ni < 0) return &nocompile;
+  size = (ni + 1) * sizeof(PItem) + nsets * 32;
+  if (size > PMAXSIZE) return &nocompile;
+  prog = (PItem *)lua_newuserdata(L, size);
+  prog->set = (unsigned short)((ni + 1) * sizeof(PItem));
+  pcompile(p, prog + 1, (unsigned char *)(prog + ni + 1), &nsets);
+  return prog + 1;
+}
+
+
+/*
+** look up pattern p, the string at index parg, in the cache, and set
+** ms->prog to its program or NULL.  The program is left on the stack
+** (nil if there is none), so that it can't be collected while in use
+** even if a callback pushes it out of the cache.
+*/
+static void getprog (MatchState *ms, int parg, const char *p) {
+  lua_State *L = ms->L;
+  PCache *c;
+  const PItem *prog = NULL;
+  int i;
+  lua_pushlightuserdata(L, (void *)&pcache_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  c = (PCache *)lua_touserdata(L, -1);
+  if (c == NULL) {  /* first use: create the cache */
+    lua_pop(L, 1);
+    c = (PCache *)lua_newuserdata(L, sizeof(PCache));
+    c_memset(c, 0, sizeof(PCache));
+    lua_newtable(L);  /* its environment keeps patterns and programs alive */
+    lua_setfenv(L, -2);
+    lua_pushlightuserdata(L, (void *)&pcache_key);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+  }
+  lua_getfenv(L, -1);
+  for (i = 0; i < PCACHE_SIZE && c->pat[i] != p; i++) ;
+  if (i < PCACHE_SIZE) {  /* seen before */
+    prog = c->prog[i];
+    if (prog == NULL) {  /* second use: compile it */
+      prog = newprog(L, p);
+      if (prog != &nocompile) {
+        lua_pushlightuserdata(L, (void *)prog);
+        lua_insert(L, -2);
+        lua_rawset(L, -3);  /* env[prog] = program */
+      }
+    }
+  }
+  else {  /* new pattern: forget the oldest one */
+    i = PCACHE_SIZE - 1;
+    if (c->pat[i] != NULL) {
+      lua_pushlightuserdata(L, (void *)c->pat[i]);
+      lua_pushnil(L);
+      lua_rawset(L, -3);
+      if (c->prog[i] != NULL && c->prog[i] != &nocompile) {
+        lua_pushlightuserdata(L, (void *)c->prog[i]);
+        lua_pushnil(L);
+        lua_rawset(L, -3);
+      }
+    }
+    lua_pushlightuserdata(L, (void *)p);
+    lua_pushvalue(L, parg);
+    lua_rawset(L, -3);  /* env[p] = pattern */
+  }
+  for (; i > 0; i--) {  /* move it to the front */
+    c->pat[i] = c->pat[i-1];
+    c->prog[i] = c->prog[i-1];
+  }
+  c->pat[0] = p;
+  c->prog[0] = prog;
+  if (prog == &nocompile) prog = NULL;
+  if (prog != NULL) {
+    lua_pushlightuserdata(L, (void *)prog);
+    lua_rawget(L, -2);
+  }
+  else
+    lua_pushnil(L);
+  lua_replace(L, -3);  /* leave the program in place of the cache */
+  lua_pop(L, 1);  /* pop env */
+  ms->prog = prog;
+  if (prog != NULL)
+    ms->sets = (const unsigned char *)(prog - 1) + (prog - 1)->set;
+}
+
+
+static const char *domatch (MatchState *ms, const char *s, const char *p) {
+  return (ms->prog != NULL) ? cmatch(ms, s, ms->prog) : match(ms, s, p);
+}
+
+/* }====================================================== */
+
+
 static const char *lmemfind (const char *s1, size_t l1,
                                const char *s2, size_t l2) {
   if (l2 == 0) return s1;  /* empty strings are everywhere */
@@ -513,10 +873,11 @@ static int str_find_aux (lua_State *L, int find) {
     ms.L = L;
     ms.src_init = s;
     ms.src_end = s+l1;
+    getprog(&ms, 2, p);
     do {
       const char *res;
       ms.level = 0;
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if ((res=domatch(&ms, s1, p)) != NULL) {
         if (find) {
           lua_pushinteger(L, s1-s+1);  /* start */
           lua_pushinteger(L, res-s);   /* end */
@@ -551,12 +912,13 @@ static int gmatch_aux (lua_State *L) {
   ms.L = L;
   ms.src_init = s;
   ms.src_end = s+ls;
+  getprog(&ms, lua_upvalueindex(2), p);
   for (src = s + (size_t)lua_tointeger(L, lua_upvalueindex(3));
        src <= ms.src_end;
        src++) {
     const char *e;
     ms.level = 0;
-    if ((e = match(&ms, src, p)) != NULL) {
+    if ((e = domatch(&ms, src, p)) != NULL) {
       lua_Integer newstart = e-s;
       if (e == src) newstart++;  /* empty match? go at least one position */
       lua_pushinteger(L, newstart);
@@ -653,14 +1015,15 @@ static int str_gsub (lua_State *L) {
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE ||
                    tr == LUA_TLIGHTFUNCTION, 3,
                    "string/function/table/lightfunction expected");
-  luaL_buffinit(L, &b);
   ms.L = L;
   ms.src_init = src;
   ms.src_end = src+srcl;
+  getprog(&ms, 2, p);
+  luaL_buffinit(L, &b);
   while (n < max_s) {
     const char *e;
     ms.level = 0;
-    e = match(&ms, src, p);
+    e = domatch(&ms, src, p);
     if (e) {
       n++;
       add_value(&ms, &b, src, e);
@@ -778,6 +1141,10 @@ static int str_format (lua_State *L) {
           break;
         }
         case 'd':  case 'i': {
+          if (form[2] == '\0') {  /* plain `%d', the usual case */
+            luaO_int2str(buff, (LUA_INTFRM_T)luaL_checknumber(L, arg));
+            break;
+          }
           addintlen(form);
           c_sprintf(buff, form, (LUA_INTFRM_T)luaL_checknumber(L, arg));
           break;
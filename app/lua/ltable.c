@@ -62,6 +62,8 @@
 
 #define hashpointer(t,p)	hashmod(t, IntPoint(p))
 
+#define hashint(t,i)	hashmod(t, cast(unsigned int, i))
+
 
 /*
 ** number of ints inside a lua_Number
@@ -79,13 +81,15 @@ static const Node dummynode_ = {
 
 
 /*
-** hash for lua_Numbers
+** hash for lua_Numbers; one that is an int hashes as the int, so that it
+** is found whether the key is held as an int or as a float
 */
 static Node *hashnum (const Table *t, lua_Number n) {
   unsigned int a[numints];
   int i;
-  if (luai_numeq(n, 0))  /* avoid problems with -0 */
-    return gnode(t, 0);
+  lua_number2int(i, n);
+  if (luai_numeq(cast_num(i), n))  /* an int, or -0 */
+    return hashint(t, i);
   c_memcpy(a, &n, sizeof(a));
   for (i = 1; i < numints; i++) a[0] += a[i];
   return hashmod(t, a[0]);
@@ -100,6 +104,8 @@ static Node *hashnum (const Table *t, lua_Number n) {
 static Node *mainposition (const Table *t, const TValue *key) {
   switch (ttype(key)) {
     case LUA_TNUMBER:
+      if (ttisint(key))
+        return hashint(t, ivalue(key));
       return hashnum(t, nvalue(key));
     case LUA_TSTRING:
       return hashstr(t, rawtsvalue(key));
@@ -121,7 +127,9 @@ static Node *mainposition (const Table *t, const TValue *key) {
 ** the array part of the table, -1 otherwise.
 */
 static int arrayindex (const TValue *key) {
-  if (ttisnumber(key)) {
+  if (ttisint(key))
+    return ivalue(key);
+  else if (ttisnumber(key)) {
     lua_Number n = nvalue(key);
     int k;
     lua_number2int(k, n);
@@ -166,7 +174,7 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
   int i = findindex(L, t, key);  /* find original element */
   for (i++; i < t->sizearray; i++) {  /* try first array part */
     if (!ttisnil(&t->array[i])) {  /* a non-nil value? */
-      setnvalue(key, cast_num(i+1));
+      setivalue(key, i+1);
       setobj2s(L, key+1, &t->array[i]);
       return 1;
     }
@@ -509,6 +517,27 @@ Table *luaH_new (lua_State *L, int narray, int nhash) {
 }
 
 
+/*
+** remove all entries, but keep the array and hash parts allocated so
+** that the table can be refilled without rehashing
+*/
+void luaH_clear (Table *t) {
+  int i;
+  for (i=0; i<t->sizearray; i++)
+    setnilvalue(&t->array[i]);
+  if (t->node != dummynode) {
+    for (i=0; i<sizenode(t); i++) {
+      Node *n = gnode(t, i);
+      gnext(n) = NULL;
+      setnilvalue(gkey(n));
+      setnilvalue(gval(n));
+    }
+    t->lastfree = gnode(t, sizenode(t));  /* all positions are free */
+  }
+  t->flags = cast_byte(~0);  /* no metamethods left */
+}
+
+
 void luaH_free (lua_State *L, Table *t) {
   if (t->node != dummynode)
     luaM_freearray(L, t->node, sizenode(t), Node);
@@ -566,10 +595,10 @@ const TValue *luaH_getnum (Table *t, int key) {
   if (cast(unsigned int, key-1) < cast(unsigned int, t->sizearray))
     return &t->array[key-1];
   else {
-    lua_Number nk = cast_num(key);
-    Node *n = hashnum(t, nk);
+    Node *n = hashint(t, key);
     do {  /* check whether `key' is somewhere in the chain */
-      if (ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), nk))
+      if (ttisint(gkey(n)) ? ivalue(gkey(n)) == key :
+          ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), cast_num(key)))
         return gval(n);  /* that's it */
       else n = gnext(n);
     } while (n);
@@ -599,12 +628,10 @@ const TValue *luaH_getstr (Table *t, TString *key) {
 
 /* same thing for rotables */
 const TValue *luaH_getstr_ro (void *t, TString *key) {
-  char keyname[LUA_MAX_ROTABLE_NAME + 1];
   const TValue *res;  
   if (!t)
     return luaO_nilobject;
-  luaR_getcstr(keyname, key, LUA_MAX_ROTABLE_NAME);   
-  res = luaR_findentry(t, keyname, 0, NULL);
+  res = luaR_findstrentry(t, key, NULL);
   return res ? res : luaO_nilobject;
 }
 
@@ -618,7 +645,10 @@ const TValue *luaH_get (Table *t, const TValue *key) {
     case LUA_TSTRING: return luaH_getstr(t, rawtsvalue(key));
     case LUA_TNUMBER: {
       int k;
-      lua_Number n = nvalue(key);
+      lua_Number n;
+      if (ttisint(key))
+        return luaH_getnum(t, ivalue(key));
+      n = nvalue(key);
       lua_number2int(k, n);
       if (luai_numeq(cast_num(k), nvalue(key))) /* index is int? */
         return luaH_getnum(t, k);  /* use specialized version */
@@ -643,7 +673,10 @@ const TValue *luaH_get_ro (void *t, const TValue *key) {
     case LUA_TSTRING: return luaH_getstr_ro(t, rawtsvalue(key));
     case LUA_TNUMBER: {
       int k;
-      lua_Number n = nvalue(key);
+      lua_Number n;
+      if (ttisint(key))
+        return luaH_getnum_ro(t, ivalue(key));
+      n = nvalue(key);
       lua_number2int(k, n);
       if (luai_numeq(cast_num(k), nvalue(key))) /* index is int? */
         return luaH_getnum_ro(t, k);  /* use specialized version */
@@ -676,7 +709,7 @@ TValue *luaH_setnum (lua_State *L, Table *t, int key) {
     return cast(TValue *, p);
   else {
     TValue k;
-    setnvalue(&k, cast_num(key));
+    setivalue(&k, key);
     return newkey(L, t, &k);
   }
 }
@@ -749,12 +782,12 @@ int luaH_getn_ro (void *t) {
   return len;
 }
 
+int luaH_isdummy (Node *n) { return n == dummynode; }
+
 #if defined(LUA_DEBUG)
 
 Node *luaH_mainposition (const Table *t, const TValue *key) {
   return mainposition(t, key);
 }
 
-int luaH_isdummy (Node *n) { return n == dummynode; }
-
 #endif
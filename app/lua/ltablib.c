@@ -87,6 +87,53 @@ static int setn (lua_State *L) {
 }
 
 
+static int tcreate (lua_State *L) {
+  int narr = luaL_optint(L, 1, 0);
+  int nrec = luaL_optint(L, 2, 0);
+  luaL_argcheck(L, narr >= 0, 1, "should be >= 0");
+  luaL_argcheck(L, nrec >= 0, 2, "should be >= 0");
+  lua_createtable(L, narr, nrec);
+  return 1;
+}
+
+
+static int tclear (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_cleartable(L, 1);
+  return 0;
+}
+
+
+static int tmove (lua_State *L) {
+  int f = luaL_checkint(L, 2);
+  int e = luaL_checkint(L, 3);
+  int t = luaL_checkint(L, 4);
+  int tt = !lua_isnoneornil(L, 5) ? 5 : 1;  /* destination table */
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_checktype(L, tt, LUA_TTABLE);
+  if (e >= f) {  /* otherwise, nothing to move */
+    int n, i;
+    luaL_argcheck(L, f > 0 || e < INT_MAX + f, 3, "too many elements to move");
+    n = e - f + 1;  /* number of elements to move */
+    luaL_argcheck(L, t <= INT_MAX - n + 1, 4, "destination wrap around");
+    if (t > e || t <= f || (tt != 1 && !lua_rawequal(L, 1, tt))) {
+      for (i = 0; i < n; i++) {
+        lua_rawgeti(L, 1, f + i);
+        lua_rawseti(L, tt, t + i);
+      }
+    }
+    else {  /* overlapping, with the destination above the source */
+      for (i = n - 1; i >= 0; i--) {
+        lua_rawgeti(L, 1, f + i);
+        lua_rawseti(L, tt, t + i);
+      }
+    }
+  }
+  lua_pushvalue(L, tt);  /* return destination table */
+  return 1;
+}
+
+
 static int tinsert (lua_State *L) {
   int e = aux_getn(L, 1) + 1;  /* first empty element */
   int pos;  /* where to insert new element */
@@ -270,12 +317,15 @@ static int sort (lua_State *L) {
 #define MIN_OPT_LEVEL 1
 #include "lrodefs.h"
 const LUA_REG_TYPE tab_funcs[] = {
+  {LSTRKEY("clear"), LFUNCVAL(tclear)},
   {LSTRKEY("concat"), LFUNCVAL(tconcat)},
+  {LSTRKEY("create"), LFUNCVAL(tcreate)},
   {LSTRKEY("foreach"), LFUNCVAL(foreach)},
   {LSTRKEY("foreachi"), LFUNCVAL(foreachi)},
   {LSTRKEY("getn"), LFUNCVAL(getn)},
   {LSTRKEY("maxn"), LFUNCVAL(maxn)},
   {LSTRKEY("insert"), LFUNCVAL(tinsert)},
+  {LSTRKEY("move"), LFUNCVAL(tmove)},
   {LSTRKEY("remove"), LFUNCVAL(tremove)},
   {LSTRKEY("setn"), LFUNCVAL(setn)},
   {LSTRKEY("sort"), LFUNCVAL(sort)},
@@ -31,8 +31,10 @@
 #define c_freopen freopen
 #define c_getc getc
 #define c_getenv getenv
+#define c_malloc malloc
 #define c_memcmp memcmp
 #define c_memcpy memcpy
+#define c_memset memset
 #define c_printf printf
 #define c_puts puts
 #define c_reader reader
@@ -50,6 +52,7 @@
 #define c_strerror strerror
 #define c_strlen strlen
 #define c_strncat strncat
+#define c_strncasecmp strncasecmp
 #define c_strncmp strncmp
 #define c_strncpy strncpy
 #define c_strpbrk strpbrk
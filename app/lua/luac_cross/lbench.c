@@ -0,0 +1,242 @@
+/*
+** Host benchmark driver: runs Lua scripts on the NodeMCU VM and reports
+** time, allocations and peak heap for each one
+** See Copyright Notice in lua.h
+*/
+
+#define LUAC_CROSS_FILE
+
+#include "luac_cross.h"
+#include C_HEADER_STDIO
+#include C_HEADER_STDLIB
+#include C_HEADER_STRING
+#include <time.h>
+
+#define lbench_c
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lcode.h"
+#include "lflash.h"
+#include "lualib.h"
+
+#define PROGNAME	"lua.bench"	/* default program name */
+#define RUNS		3		/* default number of runs per script */
+
+static int runs=RUNS;			/* runs per script; best time wins */
+static int counting=0;			/* also count VM instructions? */
+static int optimizing=0;		/* optimize scripts as they load? */
+static const char* output=NULL;		/* results file, or NULL for stdout */
+static const char* image=NULL;		/* LFS image to load, if any */
+static const char* progname=PROGNAME;	/* actual program name */
+
+static void fatal(const char* message)
+{
+ fprintf(stderr,"%s: %s\n",progname,message);
+ exit(EXIT_FAILURE);
+}
+
+static void usage(const char* message)
+{
+ if (*message=='-')
+  fprintf(stderr,"%s: unrecognized option " LUA_QS "\n",progname,message);
+ else
+  fprintf(stderr,"%s: %s\n",progname,message);
+ fprintf(stderr,
+ "usage: %s [options] scripts.\n"
+ "Available options are:\n"
+#ifdef LUA_FLASH_STORE
+ "  -f name  load Lua Flash Store image " LUA_QL("name") " (from luac.cross -F)\n"
+#endif
+ "  -i       also count VM instructions and report millions per second\n"
+ "  -n runs  run each script " LUA_QL("runs") " times and keep the fastest (default %d)\n"
+ "  -o name  write results to file " LUA_QL("name") " (default is stdout)\n"
+ "  -O       optimize the scripts as " LUA_QL("luac.cross -O") " does\n"
+ "  -v       show version information\n"
+ "  --       stop handling options\n",
+ progname,RUNS);
+ exit(EXIT_FAILURE);
+}
+
+#define	IS(s)	(strcmp(argv[i],s)==0)
+
+static int doargs(int argc, char* argv[])
+{
+ int i;
+ if (argv[0]!=NULL && *argv[0]!=0) progname=argv[0];
+ for (i=1; i<argc; i++)
+ {
+  if (*argv[i]!='-')			/* end of options; keep it */
+   break;
+  else if (IS("--"))			/* end of options; skip it */
+  {
+   ++i;
+   break;
+  }
+#ifdef LUA_FLASH_STORE
+  else if (IS("-f"))			/* LFS image */
+  {
+   image=argv[++i];
+   if (image==NULL || *image==0) usage(LUA_QL("-f") " needs argument");
+  }
+#endif
+  else if (IS("-i"))			/* count instructions */
+   counting=1;
+  else if (IS("-n"))			/* number of runs */
+  {
+   const char* n=argv[++i];
+   if (n==NULL || (runs=atoi(n))<1) usage(LUA_QL("-n") " needs a positive argument");
+  }
+  else if (IS("-o"))			/* output file */
+  {
+   output=argv[++i];
+   if (output==NULL || *output==0) usage(LUA_QL("-o") " needs argument");
+  }
+  else if (IS("-O"))			/* optimize */
+   optimizing=1;
+  else if (IS("-v"))			/* show version */
+  {
+   printf("%s  %s\n",LUA_RELEASE,LUA_COPYRIGHT);
+   if (argc==2) exit(EXIT_SUCCESS);
+  }
+  else					/* unknown option */
+   usage(argv[i]);
+ }
+ if (i==argc) usage("no scripts given");
+ return i;
+}
+
+/*
+** Allocation statistics, kept by a wrapper around the state's allocator.
+** Only the Lua heap is counted; modules that call malloc directly (such
+** as cjson's string buffers) are not.
+*/
+typedef struct {
+ lua_Alloc f;				/* wrapped allocator */
+ void* ud;
+ size_t current;			/* bytes in use */
+ size_t peak;				/* high water mark of current */
+ size_t allocs;				/* number of new blocks */
+ size_t bytes;				/* total bytes requested */
+} Stats;
+
+static void* countalloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+ Stats* s=(Stats*)ud;
+ void* p=s->f(s->ud,ptr,osize,nsize);
+ if (p==NULL && nsize>0) return NULL;
+ if (ptr==NULL) osize=0;
+ if (nsize>osize)
+ {
+  s->bytes+=nsize-osize;
+  if (osize==0) s->allocs++;
+ }
+ s->current+=nsize-osize;
+ if (s->current>s->peak) s->peak=s->current;
+ return p;
+}
+
+typedef struct {
+ double ms;				/* execution time */
+ Stats stats;
+} Result;
+
+static unsigned long instructions;	/* executed by the counting run */
+
+static void counthook(lua_State* L, lua_Debug* ar)
+{
+ (void)L; (void)ar;
+ instructions++;
+}
+
+static double now(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return t.tv_sec*1e3+t.tv_nsec/1e6;
+}
+
+/*
+** Run a script once in a fresh state.  Loading and opening the libraries
+** are excluded from both the time and the allocation counts.  With count
+** set a hook counts every VM instruction; that run is not timed.
+*/
+static void run(const char* script, Result* r, int count)
+{
+ double t;
+ lua_State* L=lua_open();
+ if (L==NULL) fatal("cannot create state: not enough memory");
+ luaL_openlibs(L);
+ if (optimizing)
+ {
+  lua_pushlightuserdata(L,(void*)&luaK_optimize);
+  lua_pushboolean(L,1);
+  lua_rawset(L,LUA_REGISTRYINDEX);
+ }
+ if (luaL_loadfile(L,script)!=0) fatal(lua_tostring(L,-1));
+ r->stats.f=lua_getallocf(L,&r->stats.ud);
+ r->stats.current=lua_gc(L,LUA_GCCOUNT,0)*1024+lua_gc(L,LUA_GCCOUNTB,0);
+ r->stats.peak=r->stats.current;
+ r->stats.allocs=r->stats.bytes=0;
+ lua_setallocf(L,countalloc,&r->stats);
+ if (count)
+ {
+  instructions=0;
+  lua_sethook(L,counthook,LUA_MASKCOUNT,1);
+ }
+ t=now();
+ if (lua_pcall(L,0,0,0)!=0) fatal(lua_tostring(L,-1));
+ r->ms=now()-t;
+ lua_setallocf(L,r->stats.f,r->stats.ud);
+ lua_close(L);
+}
+
+/* The name of a script without its directory and extension */
+static void benchname(const char* script, char* name, size_t size)
+{
+ const char* b=strrchr(script,'/');
+ size_t n;
+ b=(b==NULL) ? script : b+1;
+ n=strcspn(b,".");
+ if (n>=size) n=size-1;
+ memcpy(name,b,n);
+ name[n]=0;
+}
+
+int main(int argc, char* argv[])
+{
+ FILE* f=stdout;
+ int i=doargs(argc,argv);
+#ifdef LUA_FLASH_STORE
+ if (image!=NULL && (image=luaN_loadimage(image))!=NULL) fatal(image);
+#endif
+ if (output!=NULL && (f=fopen(output,"w"))==NULL)
+  fatal("cannot open output file");
+ fprintf(f,"bench\ttime_ms\tallocs\talloc_bytes\tpeak_bytes%s\n",
+  counting ? "\tminstr_per_s" : "");
+ for (; i<argc; i++)
+ {
+  Result best,r;
+  char name[64];
+  int n;
+  run(argv[i],&best,0);
+  for (n=1; n<runs; n++)
+  {
+   run(argv[i],&r,0);
+   if (r.ms<best.ms) best.ms=r.ms;
+  }
+  benchname(argv[i],name,sizeof(name));
+  fprintf(f,"%s\t%.3f\t%lu\t%lu\t%lu",name,best.ms,
+   (unsigned long)best.stats.allocs,(unsigned long)best.stats.bytes,
+   (unsigned long)best.stats.peak);
+  if (counting)
+  {
+   run(argv[i],&r,1);
+   fprintf(f,"\t%.1f",instructions/(best.ms*1e3));
+  }
+  fputc('\n',f);
+  fflush(f);
+ }
+ if (f!=stdout) fclose(f);
+ return EXIT_SUCCESS;
+}
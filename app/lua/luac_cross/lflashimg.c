@@ -0,0 +1,436 @@
+/*
+** Build a Lua Flash Store image of compiled functions (see lflash.h)
+** See Copyright Notice in lua.h
+*/
+
+#define LUAC_CROSS_FILE
+
+#include "luac_cross.h"
+#include C_HEADER_STDLIB
+#include C_HEADER_STRING
+#include <stddef.h>
+
+#define lflashimg_c
+#define LUA_CORE
+
+#include "lua.h"
+
+#include "ldo.h"
+#include "lflash.h"
+#include "lgc.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "lstring.h"
+#include "lundump.h"
+
+/* ROM objects are black and fixed: the collector never marks or frees them */
+#define ROMSTRING	(bitmask(BLACKBIT)|bitmask(FIXEDBIT))
+#define ROMPROTO	(ROMSTRING|bitmask(READONLYBIT))
+
+#define ALIGN		8		/* alignment of every object */
+
+/* the fields of a Proto, in the order of the struct */
+enum {
+ P_K, P_CODE, P_P, P_LINEINFO, P_LOCVARS, P_UPVALUES, P_SOURCE,
+ P_SIZEUPVALUES, P_SIZEK, P_SIZECODE, P_SIZELINEINFO, P_SIZEP, P_SIZELOCVARS,
+ P_LINEDEFINED, P_LASTLINEDEFINED, P_GCLIST,
+ P_NUPS, P_NUMPARAMS, P_ISVARARG, P_MAXSTACKSIZE, P_N
+};
+
+/* sizes and offsets of the objects in the VM that loads the image */
+typedef struct {
+ int ptr;				/* size of pointers and size_t */
+ int tstring,tshash,tslen;		/* sizeof(TString), offsets of hash, len */
+ int tvalue,tvtt;			/* sizeof(TValue), offset of tt */
+ int locvar,lvstartpc,lvendpc;		/* sizeof(LocVar), offsets */
+ int proto,p[P_N];			/* sizeof(Proto), field offsets or -1 */
+} Layout;
+
+/* the VM luac.cross was built with, for images that lua.bench loads */
+static void hostlayout(Layout* t)
+{
+ t->ptr=sizeof(void*);
+ t->tstring=sizeof(TString);
+ t->tshash=offsetof(TString,tsv.hash);
+ t->tslen=offsetof(TString,tsv.len);
+ t->tvalue=sizeof(TValue);
+ t->tvtt=offsetof(TValue,tt);
+ t->locvar=sizeof(LocVar);
+ t->lvstartpc=offsetof(LocVar,startpc);
+ t->lvendpc=offsetof(LocVar,endpc);
+ t->proto=sizeof(Proto);
+ t->p[P_K]=offsetof(Proto,k);
+ t->p[P_CODE]=offsetof(Proto,code);
+ t->p[P_P]=offsetof(Proto,p);
+#ifdef LUA_OPTIMIZE_DEBUG
+ t->p[P_LINEINFO]=offsetof(Proto,packedlineinfo);
+ t->p[P_SIZELINEINFO]=-1;
+#else
+ t->p[P_LINEINFO]=offsetof(Proto,lineinfo);
+ t->p[P_SIZELINEINFO]=offsetof(Proto,sizelineinfo);
+#endif
+ t->p[P_LOCVARS]=offsetof(Proto,locvars);
+ t->p[P_UPVALUES]=offsetof(Proto,upvalues);
+ t->p[P_SOURCE]=offsetof(Proto,source);
+ t->p[P_SIZEUPVALUES]=offsetof(Proto,sizeupvalues);
+ t->p[P_SIZEK]=offsetof(Proto,sizek);
+ t->p[P_SIZECODE]=offsetof(Proto,sizecode);
+ t->p[P_SIZEP]=offsetof(Proto,sizep);
+ t->p[P_SIZELOCVARS]=offsetof(Proto,sizelocvars);
+ t->p[P_LINEDEFINED]=offsetof(Proto,linedefined);
+ t->p[P_LASTLINEDEFINED]=offsetof(Proto,lastlinedefined);
+ t->p[P_GCLIST]=offsetof(Proto,gclist);
+ t->p[P_NUPS]=offsetof(Proto,nups);
+ t->p[P_NUMPARAMS]=offsetof(Proto,numparams);
+ t->p[P_ISVARARG]=offsetof(Proto,is_vararg);
+ t->p[P_MAXSTACKSIZE]=offsetof(Proto,maxstacksize);
+}
+
+/*
+** the ESP8266: pointers, ints and size_t are 32 bits and doubles are 8 byte
+** aligned, so the Proto fields follow each other and a TValue holding a
+** double has 4 bytes of padding
+*/
+static void targetlayout(Layout* t, const DumpTargetInfo* target)
+{
+ int i,off=8;				/* after the CommonHeader */
+ t->ptr=4;
+ t->tstring=16; t->tshash=8; t->tslen=12;
+ t->tvalue=target->lua_Number_integral ? 8 : 16;
+ t->tvtt=target->lua_Number_integral ? 4 : 8;
+ t->locvar=12; t->lvstartpc=4; t->lvendpc=8;
+ for (i=0; i<=P_GCLIST; i++)
+ {
+#ifdef LUA_OPTIMIZE_DEBUG
+  if (i==P_SIZELINEINFO) { t->p[i]=-1; continue; }
+#endif
+  t->p[i]=off; off+=4;
+ }
+ for (; i<P_N; i++) t->p[i]=off++;
+ t->proto=off;
+}
+
+typedef struct {
+ size_t off;				/* of the TString in the image */
+ unsigned int hash;
+} ImageString;
+
+typedef struct {
+ lua_State* L;
+ const Layout* t;
+ DumpTargetInfo target;
+ int host;				/* native layout and byte order */
+ int strip;
+ int status;
+ char* b;				/* the image */
+ size_t n,size;
+ lu_int32* mask;			/* relocation masks, one per block */
+ int strings;				/* stack index of string -> offset */
+ ImageString* s;			/* the strings, in image order */
+ int ns,sizes;
+ TString* nosource;			/* source of stripped functions */
+} ImageState;
+
+#define BLOCK(S)	((size_t)FLASH_BLOCKWORDS*(S)->t->ptr)
+
+static void* grow(ImageState* S, void* p, size_t size)
+{
+ p=realloc(p,size);
+ if (p==NULL) luaD_throw(S->L,LUA_ERRMEM);
+ return p;
+}
+
+/* allocate n zeroed bytes of the image, returning their offset */
+static size_t alloc(ImageState* S, size_t n)
+{
+ size_t off=(S->n+ALIGN-1)&~(size_t)(ALIGN-1);
+ if (off+n>S->size)
+ {
+  size_t size=S->size ? S->size : 1024;	/* a multiple of BLOCK */
+  while (size<off+n) size*=2;
+  S->b=grow(S,S->b,size);
+  memset(S->b+S->size,0,size-S->size);
+  S->mask=grow(S,S->mask,size/BLOCK(S)*sizeof(lu_int32));
+  memset(S->mask+S->size/BLOCK(S),0,(size-S->size)/BLOCK(S)*sizeof(lu_int32));
+  S->size=size;
+ }
+ S->n=off+n;
+ return off;
+}
+
+static void putint(ImageState* S, size_t off, lu_int32 x, int size)
+{
+ int i;
+ if (S->host && size==4)
+  memcpy(S->b+off,&x,4);
+ else
+  for (i=0; i<size; i++) S->b[off+(S->target.little_endian ? i : size-1-i)]=(char)(x>>(8*i));
+}
+
+/* a pointer or size_t */
+static void putword(ImageState* S, size_t off, size_t x)
+{
+ if (S->host) memcpy(S->b+off,&x,sizeof(x));
+ else putint(S,off,(lu_int32)x,4);
+}
+
+/* a pointer to the object at offset x of the image, relocated when loaded */
+static void putptr(ImageState* S, size_t off, size_t x)
+{
+ size_t w=off/S->t->ptr;
+ if (x==0) return;			/* NULL */
+ putword(S,off,x);
+ S->mask[w/FLASH_BLOCKWORDS]|=(lu_int32)1<<(w%FLASH_BLOCKWORDS);
+}
+
+static void putheader(ImageState* S, size_t off, int tt, int marked)
+{
+ putint(S,off+S->t->ptr,tt,1);
+ putint(S,off+S->t->ptr+1,marked,1);
+}
+
+static void putnumber(ImageState* S, size_t off, const TValue* o)
+{
+ lua_Number x=nvalue(o);
+ if (S->target.lua_Number_integral)
+ {
+  if ((lua_Number)(lu_int32)x!=x) S->status=LUA_ERR_CC_NOTINTEGER;
+  putint(S,off,(lu_int32)x,4);
+  putint(S,off+S->t->tvtt,LUA_TNUMBER,4);
+ }
+#ifdef LUA_TNUMINT
+ else if (ttisint(o))
+ {
+  putint(S,off,ivalue(o),4);
+  putint(S,off+S->t->tvtt,LUA_TNUMINT,4);
+ }
+#endif
+ else
+ {
+  double d=x;
+  char* p=(char*)&d;
+  int i,little=1;
+  if (S->host || (*(char*)&little==1)==S->target.little_endian) memcpy(S->b+off,p,8);
+  else for (i=0; i<8; i++) S->b[off+i]=p[7-i];
+  putint(S,off+S->t->tvtt,LUA_TNUMBER,4);
+ }
+}
+
+/* add a string to the image once, returning its offset */
+static size_t addstring(ImageState* S, TString* ts)
+{
+ lua_State* L=S->L;
+ size_t off,len;
+ if (ts==NULL) return 0;
+ len=ts->tsv.len;
+ setsvalue2s(L,L->top,ts);
+ incr_top(L);
+ lua_rawget(L,S->strings);
+ if (lua_isnumber(L,-1))
+ {
+  off=(size_t)lua_tonumber(L,-1);
+  lua_pop(L,1);
+  return off;
+ }
+ lua_pop(L,1);
+ off=alloc(S,S->t->tstring+len+1);
+ putheader(S,off,LUA_TSTRING,ROMSTRING);
+ putint(S,off+S->t->tshash,ts->tsv.hash,4);
+ putword(S,off+S->t->tslen,len);
+ memcpy(S->b+off+S->t->tstring,getstr(ts),len);
+ if (S->ns==S->sizes)
+ {
+  S->sizes=S->sizes ? 2*S->sizes : 64;
+  S->s=grow(S,S->s,S->sizes*sizeof(ImageString));
+ }
+ S->s[S->ns].off=off;
+ S->s[S->ns++].hash=ts->tsv.hash;
+ setsvalue2s(L,L->top,ts);
+ incr_top(L);
+ lua_pushnumber(L,(lua_Number)off);
+ lua_rawset(L,S->strings);
+ return off;
+}
+
+static void putvalue(ImageState* S, size_t off, const TValue* o)
+{
+ switch (ttype(o))
+ {
+  case LUA_TNIL:
+	putint(S,off+S->t->tvtt,LUA_TNIL,4);
+	break;
+  case LUA_TBOOLEAN:
+	putint(S,off,bvalue(o),4);
+	putint(S,off+S->t->tvtt,LUA_TBOOLEAN,4);
+	break;
+  case LUA_TNUMBER:
+	putnumber(S,off,o);
+	break;
+  case LUA_TSTRING:
+	putptr(S,off,addstring(S,rawtsvalue(o)));
+	putint(S,off+S->t->tvtt,LUA_TSTRING,4);
+	break;
+  default:
+	lua_assert(0);			/* cannot happen */
+	break;
+ }
+}
+
+/*
+** add a function to the image after the functions nested in it, so that
+** every offset it refers to is known
+*/
+static size_t addproto(ImageState* S, const Proto* f)
+{
+ const Layout* t=S->t;
+ size_t* p=NULL;
+ size_t off,code,k=0,pp=0,lineinfo=0,locvars=0,upvalues=0,source;
+ int i,sizelineinfo=0,sizelocvars=0,sizeupvalues=0;
+ if (f->sizep>0)
+ {
+  p=grow(S,NULL,f->sizep*sizeof(size_t));
+  for (i=0; i<f->sizep; i++) p[i]=addproto(S,f->p[i]);
+  pp=alloc(S,f->sizep*t->ptr);
+  for (i=0; i<f->sizep; i++) putptr(S,pp+i*t->ptr,p[i]);
+  free(p);
+ }
+ code=alloc(S,f->sizecode*sizeof(Instruction));
+ for (i=0; i<f->sizecode; i++) putint(S,code+i*sizeof(Instruction),f->code[i],4);
+ if (f->sizek>0)
+ {
+  k=alloc(S,f->sizek*t->tvalue);
+  for (i=0; i<f->sizek; i++) putvalue(S,k+i*t->tvalue,&f->k[i]);
+ }
+ if (!S->strip)
+ {
+#ifdef LUA_OPTIMIZE_DEBUG
+  if (f->packedlineinfo)
+  {
+   size_t n=strlen((const char*)f->packedlineinfo)+1;
+   lineinfo=alloc(S,n);
+   memcpy(S->b+lineinfo,f->packedlineinfo,n);
+  }
+#else
+  sizelineinfo=f->sizelineinfo;
+  if (sizelineinfo>0)
+  {
+   lineinfo=alloc(S,sizelineinfo*4);
+   for (i=0; i<sizelineinfo; i++) putint(S,lineinfo+i*4,f->lineinfo[i],4);
+  }
+#endif
+  sizelocvars=f->sizelocvars;
+  if (sizelocvars>0)
+  {
+   locvars=alloc(S,sizelocvars*t->locvar);
+   for (i=0; i<sizelocvars; i++)
+   {
+    size_t lv=locvars+i*t->locvar;
+    putptr(S,lv,addstring(S,f->locvars[i].varname));
+    putint(S,lv+t->lvstartpc,f->locvars[i].startpc,4);
+    putint(S,lv+t->lvendpc,f->locvars[i].endpc,4);
+   }
+  }
+  sizeupvalues=f->sizeupvalues;
+  if (sizeupvalues>0)
+  {
+   upvalues=alloc(S,sizeupvalues*t->ptr);
+   for (i=0; i<sizeupvalues; i++) putptr(S,upvalues+i*t->ptr,addstring(S,f->upvalues[i]));
+  }
+ }
+ source=addstring(S,S->strip ? S->nosource : f->source);
+ off=alloc(S,t->proto);
+ putheader(S,off,LUA_TPROTO,ROMPROTO);
+ putptr(S,off+t->p[P_K],k);
+ putptr(S,off+t->p[P_CODE],code);
+ putptr(S,off+t->p[P_P],pp);
+ putptr(S,off+t->p[P_LINEINFO],lineinfo);
+ putptr(S,off+t->p[P_LOCVARS],locvars);
+ putptr(S,off+t->p[P_UPVALUES],upvalues);
+ putptr(S,off+t->p[P_SOURCE],source);
+ putint(S,off+t->p[P_SIZEUPVALUES],sizeupvalues,4);
+ putint(S,off+t->p[P_SIZEK],f->sizek,4);
+ putint(S,off+t->p[P_SIZECODE],f->sizecode,4);
+ if (t->p[P_SIZELINEINFO]>=0) putint(S,off+t->p[P_SIZELINEINFO],sizelineinfo,4);
+ putint(S,off+t->p[P_SIZEP],f->sizep,4);
+ putint(S,off+t->p[P_SIZELOCVARS],sizelocvars,4);
+ putint(S,off+t->p[P_LINEDEFINED],f->linedefined,4);
+ putint(S,off+t->p[P_LASTLINEDEFINED],f->lastlinedefined,4);
+ putint(S,off+t->p[P_NUPS],f->nups,1);
+ putint(S,off+t->p[P_NUMPARAMS],f->numparams,1);
+ putint(S,off+t->p[P_ISVARARG],f->is_vararg,1);
+ putint(S,off+t->p[P_MAXSTACKSIZE],f->maxstacksize,1);
+ return off;
+}
+
+/*
+** Write an image of the n functions on top of the stack, module i being
+** named names[i].  host selects the layout of the VM luac.cross was built
+** with instead of the ESP8266.  Returns 0 or a LUA_ERR_CC_* status.
+*/
+int luaN_dumpimage(lua_State* L, int n, const char* const* names,
+                   lua_Writer w, void* data, int strip,
+                   DumpTargetInfo target, int host)
+{
+ Layout t;
+ ImageState S;
+ size_t* bucket;
+ lu_int32 strt_size=1;
+ size_t dir,strt,block,off;
+ int i;
+ if (host) hostlayout(&t); else targetlayout(&t,&target);
+ if (!lua_checkstack(L,4)) luaD_throw(L,LUA_ERRMEM);
+ memset(&S,0,sizeof(S));
+ S.L=L;
+ S.t=&t;
+ S.target=target;
+ S.host=host;
+ S.strip=strip;
+ lua_newtable(L);
+ S.strings=lua_gettop(L);
+ lua_pushliteral(L,"=?");
+ S.nosource=rawtsvalue(L->top-1);
+ dir=alloc(&S,sizeof(FlashHeader)+n*sizeof(FlashModule));
+ for (i=0; i<n; i++)
+ {
+  size_t name,proto;
+  proto=addproto(&S,clvalue(L->top+(i-n-2))->l.p);
+  lua_pushstring(L,names[i]);
+  name=addstring(&S,rawtsvalue(L->top-1))+t.tstring;
+  lua_pop(L,1);
+  putint(&S,dir+sizeof(FlashHeader)+i*sizeof(FlashModule),(lu_int32)name,4);
+  putint(&S,dir+sizeof(FlashHeader)+i*sizeof(FlashModule)+4,(lu_int32)proto,4);
+ }
+ while (strt_size<(lu_int32)S.ns) strt_size*=2;
+ strt=alloc(&S,strt_size*t.ptr);
+ bucket=grow(&S,NULL,strt_size*sizeof(size_t));
+ memset(bucket,0,strt_size*sizeof(size_t));
+ for (i=0; i<S.ns; i++)		/* chain the strings as luaS_newlstr does */
+ {
+  size_t* b=&bucket[lmod(S.s[i].hash,strt_size)];
+  putptr(&S,S.s[i].off,*b);
+  *b=S.s[i].off;
+ }
+ for (i=0; i<(int)strt_size; i++) putptr(&S,strt+i*t.ptr,bucket[i]);
+ free(bucket);
+ block=BLOCK(&S);
+ off=(S.n+block-1)/block*block;		/* whole blocks */
+ if (off>S.n) alloc(&S,off-S.n);
+ S.n=off;
+ putint(&S,0,FLASH_SIG,4);
+ putint(&S,4,(lu_int32)S.n,4);
+ putint(&S,8,FLASH_LAYOUT(t.ptr,t.tvalue,t.proto,t.tstring),4);
+ putint(&S,12,n,4);
+ putint(&S,16,(lu_int32)strt,4);
+ putint(&S,20,strt_size,4);
+ for (off=0; off<S.n && S.status==0; off+=block)
+ {
+  char m[4];
+  lu_int32 mask=S.mask[off/block];
+  if (host) memcpy(m,&mask,4);
+  else for (i=0; i<4; i++) m[target.little_endian ? i : 3-i]=(char)(mask>>(8*i));
+  S.status=(*w)(L,m,4,data) || (*w)(L,S.b+off,block,data);
+ }
+ free(S.b); free(S.mask); free(S.s);
+ lua_pop(L,2);
+ return S.status;
+}
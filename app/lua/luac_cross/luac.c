@@ -18,13 +18,16 @@
 #include "lua.h"
 #include "lauxlib.h"
 
+#include "lcode.h"
 #include "ldo.h"
 #include "lfunc.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lopcodes.h"
+#include "lparser.h"
 #include "lstring.h"
 #include "lundump.h"
+#include "lflash.h"
 
 #define PROGNAME	"luac"		/* default program name */
 #define	OUTPUT		PROGNAME ".out"	/* default output file */
@@ -32,6 +35,9 @@
 static int listing=0;			/* list bytecodes? */
 static int dumping=1;			/* dump bytecodes? */
 static int stripping=0;			/* strip debug information? */
+static int flashing=0;			/* output a flash image? 2 for the host */
+static int optimizing=0;		/* optimize bytecode? */
+static const char* romconsts=NULL;	/* manifest of ROM module constants */
 static char Output[]={ OUTPUT };	/* default output file name */
 static const char* output=Output;	/* actual output file name */
 static const char* progname=PROGNAME;	/* actual program name */
@@ -49,6 +55,12 @@ static void cannot(const char* what)
  exit(EXIT_FAILURE);
 }
 
+static void cannotread(const char* filename)
+{
+ fprintf(stderr,"%s: cannot read %s: %s\n",progname,filename,strerror(errno));
+ exit(EXIT_FAILURE);
+}
+
 static void usage(const char* message)
 {
  if (*message=='-')
@@ -59,8 +71,12 @@ static void usage(const char* message)
  "usage: %s [options] [filenames].\n"
  "Available options are:\n"
  "  -        process stdin\n"
+ "  -c name  fold ROM module constants listed in manifest " LUA_QL("name") "\n"
+ "  -f       output a Lua Flash Store image, one module per file\n"
+ "  -F       output a Lua Flash Store image for lua.bench on this machine\n"
  "  -l       list\n"
  "  -o name  output to file " LUA_QL("name") " (default is \"%s\")\n"
+ "  -O       optimize bytecode and report instruction counts\n"
  "  -p       parse only\n"
  "  -s       strip debug information\n"
  "  -v       show version information\n"
@@ -91,6 +107,15 @@ static int doargs(int argc, char* argv[])
   }
   else if (IS("-"))			/* end of options; use stdin */
    break;
+  else if (IS("-c"))			/* ROM constants manifest */
+  {
+   romconsts=argv[++i];
+   if (romconsts==NULL || *romconsts==0) usage(LUA_QL("-c") " needs argument");
+  }
+  else if (IS("-f"))			/* flash image */
+   flashing=1;
+  else if (IS("-F"))			/* flash image for the host */
+   flashing=2;
   else if (IS("-l"))			/* list */
    ++listing;
   else if (IS("-o"))			/* output file */
@@ -99,6 +124,8 @@ static int doargs(int argc, char* argv[])
    if (output==NULL || *output==0) usage(LUA_QL("-o") " needs argument");
    if (IS("-")) output=NULL;
   }
+  else if (IS("-O"))			/* optimize */
+   optimizing=1;
   else if (IS("-p"))			/* parse only */
    dumping=0;
   else if (IS("-s"))			/* strip debug information */
@@ -184,6 +211,105 @@ static int writer(lua_State* L, const void* p, size_t size, void* u)
  return (fwrite(p,size,1,(FILE*)u)!=1) && (size!=0);
 }
 
+/* module name is the file name without directory and extension */
+static char* modulename(const char* filename)
+{
+ const char* s=strrchr(filename,'/');
+ const char* e;
+ char* name;
+ s=(s==NULL) ? filename : s+1;
+ e=strrchr(s,'.');
+ if (e==NULL || e==s) e=s+strlen(s);
+ name=malloc(e-s+1);
+ if (name==NULL) fatal("not enough memory for flash image");
+ memcpy(name,s,e-s);
+ name[e-s]=0;
+ return name;
+}
+
+/* write an LFS image with one module per file (see lflash.h) */
+static void flashimage(lua_State* L, int n, char** argv, FILE* D)
+{
+ char** names=malloc(n*sizeof(char*));
+ int i,result;
+ if (names==NULL) fatal("not enough memory for flash image");
+ for (i=0; i<n; i++) names[i]=modulename(IS("-") ? "stdin" : argv[i]);
+ lua_lock(L);
+ result=luaN_dumpimage(L,n,(const char* const*)names,writer,D,stripping,target,flashing>1);
+ lua_unlock(L);
+ if (result==LUA_ERR_CC_INTOVERFLOW) fatal("value too big or small for target integer type");
+ if (result==LUA_ERR_CC_NOTINTEGER) fatal("target lua_Number is integral but fractional value found");
+ for (i=0; i<n; i++) free(names[i]);
+ free(names);
+}
+
+/*
+** load a manifest of ROM module constants (see tools/romconsts.lua), one
+** "module.KEY value" per line, into the table that the parser folds
+** module.KEY expressions from; a line with just "module" names a ROM
+** module that has no constants, for the optimizer
+*/
+static void loadromconsts(lua_State* L, const char* filename)
+{
+ char line[256], name[128];
+ double value;
+ int n=0;
+ FILE* F=fopen(filename,"r");
+ if (F==NULL) cannotread(filename);
+ lua_newtable(L);
+ while (fgets(line,sizeof(line),F)!=NULL)
+ {
+  char* key;
+  char c;
+  int fields;
+  ++n;
+  if (sscanf(line," %c",&c)!=1 || c=='#') continue;	/* blank or comment */
+  fields=sscanf(line,"%127s %lf",name,&value);
+  key=strchr(name,'.');
+  if (fields==1 && key==NULL)				/* module alone */
+  {
+   lua_getfield(L,-1,name);
+   if (lua_isnil(L,-1))
+   {
+    lua_newtable(L);
+    lua_setfield(L,-3,name);
+   }
+   lua_pop(L,1);
+   continue;
+  }
+  if (fields!=2 || key==NULL || key==name || key[1]==0)
+  {
+   fprintf(stderr,"%s: %s:%d: expected " LUA_QL("module.KEY value") " or " LUA_QL("module") "\n",progname,filename,n);
+   exit(EXIT_FAILURE);
+  }
+  *key++=0;
+  lua_getfield(L,-1,name);
+  if (lua_isnil(L,-1))
+  {
+   lua_pop(L,1);
+   lua_newtable(L);
+   lua_pushvalue(L,-1);
+   lua_setfield(L,-3,name);
+  }
+  lua_pushnumber(L,(lua_Number)value);
+  lua_setfield(L,-2,key);
+  lua_pop(L,1);
+ }
+ if (ferror(F)) cannotread(filename);
+ fclose(F);
+ lua_setfield(L,LUA_REGISTRYINDEX,LUA_ROMCONST_KEY);
+}
+
+/* tell how the optimizer did with a function, as the parser closes it */
+static void report(lua_State* L, const Proto* f, int oldsize, int hoisted)
+{
+ char source[LUA_IDSIZE];
+ UNUSED(L);
+ luaO_chunkid(source,(f->source) ? getstr(f->source) : "=?",LUA_IDSIZE);
+ fprintf(stderr,"%s:%d: %d -> %d instructions, %d global loads hoisted\n",
+	source,f->linedefined,oldsize,f->sizecode,hoisted);
+}
+
 struct Smain {
  int argc;
  char** argv;
@@ -197,11 +323,31 @@ static int pmain(lua_State* L)
  const Proto* f;
  int i;
  if (!lua_checkstack(L,argc)) fatal("too many input files");
+ if (romconsts!=NULL) loadromconsts(L,romconsts);
+ if (optimizing)			/* the parser optimizes, and reports */
+ {
+  lua_pushlightuserdata(L,(void*)&luaK_optimize);
+  lua_pushlightuserdata(L,(void*)report);
+  lua_rawset(L,LUA_REGISTRYINDEX);
+ }
  for (i=0; i<argc; i++)
  {
   const char* filename=IS("-") ? NULL : argv[i];
   if (luaL_loadfile(L,filename)!=0) fatal(lua_tostring(L,-1));
  }
+ if (flashing)
+ {
+  if (listing) for (i=0; i<argc; i++) luaU_print(toproto(L,i-argc),listing>1);
+  if (dumping)
+  {
+   FILE* D= (output==NULL) ? stdout : fopen(output,"wb");
+   if (D==NULL) cannot("open");
+   flashimage(L,argc,argv,D);
+   if (ferror(D)) cannot("write");
+   if (fclose(D)) cannot("close");
+  }
+  return 0;
+ }
  f=combine(L,argc);
  if (listing) luaU_print(f,listing>1);
  if (dumping)
@@ -231,10 +377,14 @@ int main(int argc, char* argv[])
  target.sizeof_lua_Number=sizeof(lua_Number);
  target.lua_Number_integral=(((lua_Number)0.5)==0);
  target.is_arm_fpa=0;
+ target.compact=1;
 
  int i=doargs(argc,argv);
  argc-=i; argv+=i;
  if (argc<=0) usage("no input files given");
+ if (flashing==1 && (target.sizeof_int!=4 || target.is_arm_fpa ||
+     target.sizeof_lua_Number!=(target.lua_Number_integral ? 4 : 8)))
+  usage(LUA_QL("-f") " needs 32 bit ints and 64 bit float or 32 bit int numbers");
  L=lua_open();
  if (L==NULL) fatal("not enough memory for state");
  s.argc=argc;
@@ -118,6 +118,10 @@ static void PrintCode(const Proto* f)
    case OP_SETGLOBAL:
     printf("\t; %s",svalue(&f->k[bx]));
     break;
+   case OP_GETGTABLE:
+    printf("\t; %s ",svalue(&f->k[INDEXK(b)]));
+    PrintConstant(f,INDEXK(c));
+    break;
    case OP_GETTABLE:
    case OP_SELF:
     if (ISK(c)) { printf("\t; "); PrintConstant(f,INDEXK(c)); }
@@ -336,7 +336,10 @@ extern int readline4lua(const char *prompt, char *buffer, int length);
 ** They are only used in libraries and the stand-alone program. (The #if
 ** avoids including 'stdio.h' everywhere.)
 */
-#if !defined(LUA_USE_STDIO)
+#if defined(LUA_CROSS_COMPILER) && !defined(LUA_USE_STDIO)
+#define luai_writestring(s, l)  fwrite((s), 1, (l), stdout)
+#define luai_writeline()        fputc('\n', stdout)
+#elif !defined(LUA_USE_STDIO)
 #define luai_writestring(s, l)  c_puts(s)
 #define luai_writeline()        c_puts("\n")
 #endif // defined(LUA_USE_STDIO)
@@ -374,6 +377,18 @@ extern int readline4lua(const char *prompt, char *buffer, int length);
 #define LUAI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 
 
+/*
+@@ LUAI_GENMINORMUL is the default heap growth, as a percentage, that
+@* triggers a minor collection in generational mode.
+@@ LUAI_GENMAJORMUL is how much, as a percentage, the heap may grow beyond
+@* its size after the last major collection before another one is run.
+** CHANGE them to trade GC time against memory use.  The minor multiplier
+** can also be changed dynamically.
+*/
+#define LUAI_GENMINORMUL	20
+#define LUAI_GENMAJORMUL	100
+
+
 
 /*
 @@ LUA_COMPAT_GETN controls compatibility with old getn behavior.
@@ -449,6 +464,19 @@ extern int readline4lua(const char *prompt, char *buffer, int length);
 #endif
 
 
+/*
+@@ LUA_USE_COMPUTED_GOTO makes luaV_execute dispatch each instruction
+@* through a table of label addresses (a GCC extension) instead of a switch.
+** CHANGE it (define it) for a faster interpreter at the cost of some code
+** size.  This matters most on the ESP8266, where the firmware is built with
+** -fno-jump-tables and a switch becomes a chain of compares.
+*/
+/* #define LUA_USE_COMPUTED_GOTO */
+#if defined(LUA_USE_COMPUTED_GOTO) && !defined(__GNUC__)
+#error "LUA_USE_COMPUTED_GOTO needs GCC labels-as-values"
+#endif
+
+
 /*
 @@ LUAI_BITSINT defines the number of bits in an int.
 ** CHANGE here if Lua cannot automatically detect the number of bits of
@@ -894,7 +922,7 @@ union luai_Cast { double l_d; long l_l; };
 /* If you define the next macro you'll get the ability to set rotables as
    metatables for tables/userdata/types (but the VM might run slower)
 */
-#if (LUA_OPTIMIZE_MEMORY == 2) && !defined(LUA_CROSS_COMPILER)
+#if LUA_OPTIMIZE_MEMORY == 2
 #define LUA_META_ROTABLES 
 #endif
 
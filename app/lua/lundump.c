@@ -14,9 +14,12 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstring.h"
+#include "ltable.h"
 #include "lundump.h"
 #include "lzio.h"
 
@@ -29,6 +32,9 @@ typedef struct {
  int numsize;
  int toflt;
  size_t total;
+ int compact;		/* compact format (see ldump.c) */
+ Table* strings;	/* compact format: the strings read so far */
+ int nstrings;
 } LoadState;
 
 #ifdef LUAC_TRUST_BINARIES
@@ -107,13 +113,35 @@ static int LoadChar(LoadState* S)
 
 static void Align4(LoadState* S)
 {
+ if (S->compact) return;
  while(S->total&3)
   LoadChar(S);
 }
 
+static uint32_t LoadVarint(LoadState* S)
+{
+ uint32_t x=0;
+ int shift, c;
+ for (shift=0; ; shift+=7)
+ {
+  c=zgetc(S->Z);
+  IF (c==EOZ, "unexpected end");
+  IF (shift>28, "bad integer");
+  S->total++;
+  x|=(uint32_t)(c&0x7F)<<shift;
+  if (!(c&0x80)) return x;
+ }
+}
+
 static int LoadInt(LoadState* S)
 {
  int x;
+ if (S->compact)
+ {
+  uint32_t u=LoadVarint(S);
+  IF (u>MAX_INT, "bad integer");
+  return (int)u;
+ }
  LoadVar(S,x);
  IF (x<0, "bad integer");
  return x;
@@ -156,9 +184,33 @@ static lua_Number LoadNumber(LoadState* S)
  return x;
 }
 
+static TString* LoadStringRef(LoadState* S)
+{
+ uint32_t ref=LoadVarint(S);
+ if (ref==0)
+  return NULL;
+ else if (ref==1)
+ {
+  int size=LoadInt(S);
+  char* s=luaZ_openspace(S->L,S->b,size);
+  TString* ts;
+  TValue* v;
+  LoadBlock(S,s,size);
+  ts=luaS_newlstr(S->L,s,size);
+  v=luaH_setnum(S->L,S->strings,++S->nstrings);
+  setsvalue(S->L,v,ts);
+  luaC_barriert(S->L,S->strings,v);
+  return ts;
+ }
+ IF (ref-2>=(uint32_t)S->nstrings, "bad string");
+ return rawtsvalue(luaH_getnum(S->strings,ref-1));
+}
+
 static TString* LoadString(LoadState* S)
 {
  int32_t size;
+ if (S->compact)
+  return LoadStringRef(S);
  LoadVar(S,size);
  if (size==0)
   return NULL;
@@ -213,8 +265,15 @@ static void LoadConstants(LoadState* S, Proto* f)
    	setbvalue(o,LoadChar(S)!=0);
 	break;
    case LUA_TNUMBER:
-	setnvalue(o,LoadNumber(S));
+	setnumvalue(o,LoadNumber(S));
 	break;
+   case LUAC_TSMALLINT: {
+	uint32_t x;
+	IF (!S->compact, "bad constant");
+	x=LoadVarint(S);
+	setivalue(o,(int32_t)((x>>1)^(0U-(x&1))));  /* zigzag */
+	break;
+   }
    case LUA_TSTRING:
 	setsvalue2n(S->L,o,LoadString(S));
 	break;
@@ -223,6 +282,7 @@ static void LoadConstants(LoadState* S, Proto* f)
 	break;
   }
  }
+ if (S->compact) return;		/* loaded by LoadNested */
  n=LoadInt(S);
  f->p=luaM_newvector(S->L,n,Proto*);
  f->sizep=n;
@@ -230,6 +290,21 @@ static void LoadConstants(LoadState* S, Proto* f)
  for (i=0; i<n; i++) f->p[i]=LoadFunction(S,f->source);
 }
 
+/* compact format: the nested functions, each marked by a 1, end with a 0 */
+static void LoadNested(LoadState* S, Proto* f)
+{
+ int n=0;
+ while (LoadByte(S))
+ {
+  int oldsize=f->sizep;
+  luaM_growvector(S->L,f->p,n,f->sizep,Proto*,MAXARG_Bx,"too many functions");
+  while (oldsize<f->sizep) f->p[oldsize++]=NULL;
+  f->p[n++]=LoadFunction(S,f->source);
+ }
+ luaM_reallocvector(S->L,f->p,f->sizep,n,Proto*);
+ f->sizep=n;
+}
+
 static void LoadDebug(LoadState* S, Proto* f)
 {
  int i,n;
@@ -240,7 +315,9 @@ static void LoadDebug(LoadState* S, Proto* f)
  if(n) {
    if (!luaZ_direct_mode(S->Z)) {
      f->packedlineinfo=luaM_newvector(S->L,n,unsigned char);
+     f->packedlineinfo[n-1]=0;		/* freed by its length, so keep it terminated */
      LoadBlock(S,f->packedlineinfo,n);
+     f->packedlineinfo[n-1]=0;
    } else {
      f->packedlineinfo=(unsigned char*)luaZ_get_crt_address(S->Z);
      LoadBlock(S,NULL,n);
@@ -283,6 +360,7 @@ static Proto* LoadFunction(LoadState* S, TString* p)
  if (luaZ_direct_mode(S->Z)) proto_readonly(f);
  setptvalue2s(S->L,S->L->top,f); incr_top(S->L);
  f->source=LoadString(S); if (f->source==NULL) f->source=p;
+ if (S->compact) LoadNested(S,f);
  f->linedefined=LoadInt(S);
  f->lastlinedefined=LoadInt(S);
  f->nups=LoadByte(S);
@@ -305,6 +383,10 @@ static void LoadHeader(LoadState* S)
  int intck = (((lua_Number)0.5)==0); /* 0=float, 1=int */
  luaU_header(h);
  LoadBlock(S,s,LUAC_HEADERSIZE);
+ /* the official format and the compact one are accepted as well */
+ S->compact=(s[5]==LUAC_FORMAT_COMPACT);
+ if (s[5]==0 || S->compact) s[5]=h[5];
+ IF (S->compact && luaZ_direct_mode(S->Z), "compact chunk can't be loaded in place");
  S->swap=(s[6]!=h[6]); s[6]=h[6]; /* Check if byte-swapping is needed  */
  S->numsize=h[10]=s[10]; /* length of lua_Number */
  S->toflt=(s[11]>intck); /* check if conversion from int lua_Number to flt is needed */
@@ -318,6 +400,7 @@ static void LoadHeader(LoadState* S)
 Proto* luaU_undump (lua_State* L, ZIO* Z, Mbuffer* buff, const char* name)
 {
  LoadState S;
+ Proto* f;
  if (*name=='@' || *name=='=')
   S.name=name+1;
  else if (*name==LUA_SIGNATURE[0])
@@ -329,7 +412,16 @@ Proto* luaU_undump (lua_State* L, ZIO* Z, Mbuffer* buff, const char* name)
  S.b=buff;
  LoadHeader(&S);
  S.total=0;
- return LoadFunction(&S,luaS_newliteral(L,"=?"));
+ S.nstrings=0;
+ if (S.compact)
+ {
+  S.strings=luaH_new(L,0,0);
+  sethvalue2s(L,L->top,S.strings);  /* anchor it */
+  incr_top(L);
+ }
+ f=LoadFunction(&S,luaS_newliteral(L,"=?"));
+ if (S.compact) L->top--;
+ return f;
 }
 
 /*
@@ -26,6 +26,7 @@ typedef struct {
  int sizeof_lua_Number;
  int lua_Number_integral;
  int is_arm_fpa;
+ int compact;		/* write the compact format, which can't be loaded in place */
 } DumpTargetInfo;
 
 /* load one chunk; from lundump.c */
@@ -40,6 +41,12 @@ int luaU_dump_crosscompile (lua_State* L, const Proto* f, lua_Writer w, void* da
 /* dump one chunk; from ldump.c */
 LUAI_FUNC int luaU_dump (lua_State* L, const Proto* f, lua_Writer w, void* data, int strip);
 
+/* dump one chunk while it is compiled, a function at a time; from ldump.c */
+typedef struct DumpState DumpState;
+LUAI_FUNC DumpState* luaU_dumpbegin (lua_State* L, lua_Writer w, void* data, int strip);
+LUAI_FUNC void luaU_dumpchild (DumpState* D, const Proto* f);
+LUAI_FUNC int luaU_dumpend (DumpState* D, const Proto* f);
+
 #ifdef luac_c
 /* print one chunk; from print.c */
 LUAI_FUNC void luaU_print (const Proto* f, int full);
@@ -48,8 +55,16 @@ LUAI_FUNC void luaU_print (const Proto* f, int full);
 /* for header of binary files -- this is Lua 5.1 */
 #define LUAC_VERSION		0x51
 
-/* for header of binary files -- this is the official format */
-#define LUAC_FORMAT		0
+/* for header of binary files -- the official format is 0; format 1 adds
+   OP_GETGTABLE, which Lua 5.1 and earlier NodeMCU firmware can't run */
+#define LUAC_FORMAT		1
+
+/* the compact format: as format 1, but with varint integers, no alignment
+   padding, and each string written only once (see ldump.c) */
+#define LUAC_FORMAT_COMPACT	2
+
+/* constant type in the compact format: a number written as a zigzag varint */
+#define LUAC_TSMALLINT		(LUA_TNUMBER|0x10)
 
 /* size of header of binary files */
 #define LUAC_HEADERSIZE		12
@@ -17,6 +17,24 @@ static int adc_sample( lua_State* L )
   return 1; 
 }
 
+// Lua: readbuf(id, buf) -- fill a buffer with 16 bit samples, return their number
+static int adc_readbuf( lua_State* L )
+{
+  unsigned id = luaL_checkinteger( L, 1 );
+  MOD_CHECK_ID( adc, id );
+  luaL_Bytes *b = luaL_tobytes( L, 2 );
+  luaL_argcheck( L, b, 2, "buffer expected" );
+  size_t i, n = b->len / 2;
+  for ( i = 0; i < n; i++ )
+  {
+    unsigned val = 0xFFFF & system_adc_read();
+    b->data[2*i] = val & 0xFF;    // little endian, as array.new("u16", buf) reads it
+    b->data[2*i+1] = val >> 8;
+  }
+  lua_pushinteger( L, n );
+  return 1;
+}
+
 // Lua: readvdd33()
 static int adc_readvdd33( lua_State* L )
 {
@@ -63,6 +81,7 @@ static int adc_init107( lua_State *L )
 // Module function map
 static const LUA_REG_TYPE adc_map[] = {
   { LSTRKEY( "read" ),      LFUNCVAL( adc_sample ) },
+  { LSTRKEY( "readbuf" ),   LFUNCVAL( adc_readbuf ) },
   { LSTRKEY( "readvdd33" ), LFUNCVAL( adc_readvdd33 ) },
   { LSTRKEY( "force_init_mode" ), LFUNCVAL( adc_init107 ) },
   { LSTRKEY( "INIT_ADC" ),  LNUMVAL( 0x00 ) },
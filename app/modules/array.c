@@ -0,0 +1,350 @@
+// Module for typed numeric arrays
+//
+// An array holds numbers of one C type (8, 16 or 32 bit integers, or
+// floats) packed one after the other, so 1000 16 bit samples take 2000
+// bytes rather than the 16KB of a Lua table.  Statistics and transforms
+// run in C over the whole array or a range of it.  An array can also be
+// a view of the bytes of a buffer, such as one filled by adc.readbuf().
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "module.h"
+#include "lauxlib.h"
+
+#define ARRAY_HANDLE "array"
+
+enum { T_I8, T_U8, T_I16, T_U16, T_I32, T_U32, T_F32 };
+
+static const char *const type_names[] = {
+  "i8", "u8", "i16", "u16", "i32", "u32",
+#ifndef LUA_NUMBER_INTEGRAL
+  "f32",
+#endif
+  NULL
+};
+static const uint8_t type_sizes[] = { 1, 1, 2, 2, 4, 4, 4 };
+
+typedef struct {
+  char *data;   /* the elements: in this userdata, or in the buffer viewed */
+  size_t n;     /* number of elements */
+  int ref;      /* a view: reference to the buffer that holds the elements */
+  uint8_t type;
+} array_t;
+
+#define checkarray(L,n) ((array_t *)luaL_checkudata(L, (n), ARRAY_HANDLE))
+
+// A new array of n elements; narg is the argument blamed if it is too big
+static array_t *newarray(lua_State *L, int type, size_t n, int alloc, int narg) {
+  luaL_argcheck(L, !alloc || n <= (SIZE_MAX - sizeof(array_t)) / type_sizes[type], narg, "too big");
+  array_t *a = (array_t *)lua_newuserdata(L, sizeof(array_t) + (alloc ? n * type_sizes[type] : 0));
+  a->data = (char *)(a + 1);
+  a->n = n;
+  a->ref = LUA_NOREF;
+  a->type = type;
+  luaL_getmetatable(L, ARRAY_HANDLE);
+  lua_setmetatable(L, -2);
+  return a;
+}
+
+static double getelem(const array_t *a, size_t i) {
+  switch (a->type) {
+    case T_I8:  return ((const int8_t *)a->data)[i];
+    case T_U8:  return ((const uint8_t *)a->data)[i];
+    case T_I16: return ((const int16_t *)a->data)[i];
+    case T_U16: return ((const uint16_t *)a->data)[i];
+    case T_I32: return ((const int32_t *)a->data)[i];
+    case T_U32: return ((const uint32_t *)a->data)[i];
+    default:    return ((const float *)a->data)[i];
+  }
+}
+
+// Store v, truncated towards zero and clipped to the range of the type
+static void setelem(array_t *a, size_t i, double v) {
+  static const double lo[] = { -128, 0, -32768, 0, -2147483648.0, 0 };
+  static const double hi[] = { 127, 255, 32767, 65535, 2147483647.0, 4294967295.0 };
+  if (a->type != T_F32) {
+    if (!(v >= lo[a->type])) v = lo[a->type];   /* NaN too */
+    else if (v > hi[a->type]) v = hi[a->type];
+  }
+  switch (a->type) {
+    case T_I8:  ((int8_t *)a->data)[i] = (int8_t)v; break;
+    case T_U8:  ((uint8_t *)a->data)[i] = (uint8_t)v; break;
+    case T_I16: ((int16_t *)a->data)[i] = (int16_t)v; break;
+    case T_U16: ((uint16_t *)a->data)[i] = (uint16_t)v; break;
+    case T_I32: ((int32_t *)a->data)[i] = (int32_t)v; break;
+    case T_U32: ((uint32_t *)a->data)[i] = (uint32_t)v; break;
+    default:    ((float *)a->data)[i] = (float)v; break;
+  }
+}
+
+// Run stmt with x set to each element from off to off+n-1, and k_ to its
+// index in the range.  There is a loop for each element type, so that the
+// type isn't tested for every element.
+#define FOREACH(a, off, n, stmt) do { \
+    size_t k_; \
+    switch ((a)->type) { \
+      case T_I8:  { const int8_t *p_ = (const int8_t *)(a)->data + (off); \
+                    for (k_ = 0; k_ < (n); k_++) { double x = p_[k_]; stmt; } break; } \
+      case T_U8:  { const uint8_t *p_ = (const uint8_t *)(a)->data + (off); \
+                    for (k_ = 0; k_ < (n); k_++) { double x = p_[k_]; stmt; } break; } \
+      case T_I16: { const int16_t *p_ = (const int16_t *)(a)->data + (off); \
+                    for (k_ = 0; k_ < (n); k_++) { double x = p_[k_]; stmt; } break; } \
+      case T_U16: { const uint16_t *p_ = (const uint16_t *)(a)->data + (off); \
+                    for (k_ = 0; k_ < (n); k_++) { double x = p_[k_]; stmt; } break; } \
+      case T_I32: { const int32_t *p_ = (const int32_t *)(a)->data + (off); \
+                    for (k_ = 0; k_ < (n); k_++) { double x = p_[k_]; stmt; } break; } \
+      case T_U32: { const uint32_t *p_ = (const uint32_t *)(a)->data + (off); \
+                    for (k_ = 0; k_ < (n); k_++) { double x = p_[k_]; stmt; } break; } \
+      default:    { const float *p_ = (const float *)(a)->data + (off); \
+                    for (k_ = 0; k_ < (n); k_++) { double x = p_[k_]; stmt; } break; } \
+    } \
+  } while (0)
+
+static ptrdiff_t posrelat (ptrdiff_t pos, size_t len) {
+  /* relative string position: negative means back from end */
+  if (pos < 0) pos += (ptrdiff_t)len + 1;
+  return (pos >= 0) ? pos : 0;
+}
+
+// Clip the positions i and j at narg and narg+1, as string.sub() does,
+// and return the number of elements in the range and its offset in *off
+static size_t getrange(lua_State *L, int narg, size_t len, size_t *off) {
+  ptrdiff_t i = posrelat(luaL_optinteger(L, narg, 1), len);
+  ptrdiff_t j = posrelat(luaL_optinteger(L, narg + 1, -1), len);
+  if (i < 1) i = 1;
+  if (j > (ptrdiff_t)len) j = (ptrdiff_t)len;
+  *off = i - 1;
+  return (i <= j) ? (size_t)(j - i + 1) : 0;
+}
+
+static size_t checkindex(lua_State *L, int narg, const array_t *a) {
+  ptrdiff_t i = posrelat(luaL_checkinteger(L, narg), a->n);
+  luaL_argcheck(L, i >= 1 && (size_t)i <= a->n, narg, "out of range");
+  return i - 1;
+}
+
+// Lua: array.new(type, size), array.new(type, table), or
+// array.new(type, string or buffer) -- a buffer is viewed, a string copied
+static int array_new(lua_State *L) {
+  int type = luaL_checkoption(L, 1, NULL, type_names);
+  size_t size = type_sizes[type];
+  array_t *a;
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    int n = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, n >= 0, 2, "should be >= 0");
+    a = newarray(L, type, n, 1, 2);
+    memset(a->data, 0, n * size);
+  } else if (lua_istable(L, 2)) {
+    size_t i, n = lua_objlen(L, 2);
+    a = newarray(L, type, n, 1, 2);
+    for (i = 0; i < n; i++) {
+      lua_rawgeti(L, 2, i + 1);
+      setelem(a, i, luaL_checknumber(L, -1));
+      lua_pop(L, 1);
+    }
+  } else {
+    luaL_Bytes *b = luaL_tobytes(L, 2);
+    size_t len;
+    const char *s = luaL_checkbytes(L, 2, &len);
+    if (b) {
+      luaL_argcheck(L, ((uintptr_t)b->data & (size - 1)) == 0, 2, "buffer not aligned");
+      a = newarray(L, type, len / size, 0, 2);
+      a->data = b->data;
+      lua_pushvalue(L, 2);   /* keep the bytes alive as long as the view */
+      a->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    } else {
+      a = newarray(L, type, len / size, 1, 2);
+      memcpy(a->data, s, a->n * size);
+    }
+  }
+  return 1;
+}
+
+// Lua: arr:get(i) or arr[i]
+static int array_get(lua_State *L) {
+  array_t *a = checkarray(L, 1);
+  lua_pushnumber(L, (lua_Number)getelem(a, checkindex(L, 2, a)));
+  return 1;
+}
+
+// Lua: arr:set(i, v1[, v2, ...]) or arr[i] = v
+static int array_set(lua_State *L) {
+  array_t *a = checkarray(L, 1);
+  size_t i = checkindex(L, 2, a);
+  int top = lua_gettop(L);
+  int argn;
+  luaL_argcheck(L, i + (top - 2) <= a->n, top, "out of range");
+  for (argn = 3; argn <= top; argn++)
+    setelem(a, i++, luaL_checknumber(L, argn));
+  return 0;
+}
+
+// Lua: arr:fill(v[, i[, j]])
+static int array_fill(lua_State *L) {
+  array_t *a = checkarray(L, 1);
+  double v = luaL_checknumber(L, 2);
+  size_t off, k;
+  size_t n = getrange(L, 3, a->n, &off);
+  for (k = 0; k < n; k++)
+    setelem(a, off + k, v);
+  return 0;
+}
+
+// Lua: arr:sum([i[, j]])
+static int array_sum(lua_State *L) {
+  array_t *a = checkarray(L, 1);
+  size_t off;
+  size_t n = getrange(L, 2, a->n, &off);
+  double sum = 0;
+  FOREACH(a, off, n, sum += x);
+  lua_pushnumber(L, (lua_Number)sum);
+  return 1;
+}
+
+// Lua: arr:min([i[, j]]), arr:max([i[, j]]) -- the value and its position
+static int minmax(lua_State *L, int wantmax) {
+  array_t *a = checkarray(L, 1);
+  size_t off, at = 0;
+  size_t n = getrange(L, 2, a->n, &off);
+  if (n == 0)
+    return 0;
+  double best = getelem(a, off);
+  FOREACH(a, off, n, if (wantmax ? x > best : x < best) { best = x; at = k_; });
+  lua_pushnumber(L, (lua_Number)best);
+  lua_pushinteger(L, off + at + 1);
+  return 2;
+}
+
+static int array_min(lua_State *L) {
+  return minmax(L, 0);
+}
+
+static int array_max(lua_State *L) {
+  return minmax(L, 1);
+}
+
+// Lua: arr:mean([i[, j]]), arr:variance([i[, j]]) -- the population
+// variance, from the squared distances to the mean in a second pass, so
+// that a large mean doesn't cancel out the digits of a small variance and
+// there is no division per element
+static int stats(lua_State *L, int wantvar) {
+  array_t *a = checkarray(L, 1);
+  size_t off;
+  size_t n = getrange(L, 2, a->n, &off);
+  double mean = 0, m2 = 0;
+  if (n == 0)
+    return 0;
+  FOREACH(a, off, n, mean += x);
+  mean /= n;
+  if (wantvar)
+    FOREACH(a, off, n, { double d = x - mean; m2 += d * d; });
+  lua_pushnumber(L, (lua_Number)(wantvar ? m2 / n : mean));
+  return 1;
+}
+
+static int array_mean(lua_State *L) {
+  return stats(L, 0);
+}
+
+static int array_variance(lua_State *L) {
+  return stats(L, 1);
+}
+
+// Lua: arr:scale(mul[, add[, i[, j]]]) -- v = v * mul + add, in place
+static int array_scale(lua_State *L) {
+  array_t *a = checkarray(L, 1);
+  double mul = luaL_checknumber(L, 2);
+  double add = luaL_optnumber(L, 3, 0);
+  size_t off, k;
+  size_t n = getrange(L, 4, a->n, &off);
+  for (k = 0; k < n; k++)
+    setelem(a, off + k, getelem(a, off + k) * mul + add);
+  return 0;
+}
+
+// Lua: arr:movavg(window[, type]) -- a new array of the means of each
+// run of window elements, of the type of arr unless given
+static int array_movavg(lua_State *L) {
+  array_t *a = checkarray(L, 1);
+  int w = luaL_checkinteger(L, 2);
+  int type = lua_isnoneornil(L, 3) ? a->type : luaL_checkoption(L, 3, NULL, type_names);
+  luaL_argcheck(L, w >= 1, 2, "should be >= 1");
+  size_t n = ((size_t)w <= a->n) ? a->n - w + 1 : 0;
+  array_t *r = newarray(L, type, n, 1, 2);
+  double sum = 0;
+  size_t k;
+  for (k = 0; k < a->n && k < (size_t)w - 1; k++)
+    sum += getelem(a, k);
+  for (k = 0; k < n; k++) {
+    sum += getelem(a, k + w - 1);
+    setelem(r, k, sum / w);
+    sum -= getelem(a, k);
+  }
+  return 1;
+}
+
+static int array_len(lua_State *L) {
+  array_t *a = checkarray(L, 1);
+  lua_pushinteger(L, a->n);
+  return 1;
+}
+
+static int array_gc(lua_State *L) {
+  array_t *a = checkarray(L, 1);
+  luaL_unref(L, LUA_REGISTRYINDEX, a->ref);
+  a->ref = LUA_NOREF;
+  return 0;
+}
+
+static const LUA_REG_TYPE array_method_map[] =
+{
+  { LSTRKEY( "fill" ),     LFUNCVAL( array_fill )},
+  { LSTRKEY( "get" ),      LFUNCVAL( array_get )},
+  { LSTRKEY( "max" ),      LFUNCVAL( array_max )},
+  { LSTRKEY( "mean" ),     LFUNCVAL( array_mean )},
+  { LSTRKEY( "min" ),      LFUNCVAL( array_min )},
+  { LSTRKEY( "movavg" ),   LFUNCVAL( array_movavg )},
+  { LSTRKEY( "scale" ),    LFUNCVAL( array_scale )},
+  { LSTRKEY( "set" ),      LFUNCVAL( array_set )},
+  { LSTRKEY( "sum" ),      LFUNCVAL( array_sum )},
+  { LSTRKEY( "variance" ), LFUNCVAL( array_variance )},
+  { LNILKEY, LNILVAL}
+};
+
+// Lua: arr[i] for a number, otherwise the methods above
+static int array_index(lua_State *L) {
+  if (lua_type(L, 2) == LUA_TNUMBER)
+    return array_get(L);
+  lua_pushrotable(L, (void *)array_method_map);
+  lua_pushvalue(L, 2);
+  lua_rawget(L, -2);
+  return 1;
+}
+
+static int array_newindex(lua_State *L) {
+  lua_settop(L, 3);
+  return array_set(L);
+}
+
+static const LUA_REG_TYPE array_meta_map[] =
+{
+  { LSTRKEY( "__gc" ),       LFUNCVAL( array_gc )},
+  { LSTRKEY( "__index" ),    LFUNCVAL( array_index )},
+  { LSTRKEY( "__len" ),      LFUNCVAL( array_len )},
+  { LSTRKEY( "__newindex" ), LFUNCVAL( array_newindex )},
+  { LNILKEY, LNILVAL}
+};
+
+static const LUA_REG_TYPE array_map[] =
+{
+  { LSTRKEY( "new" ), LFUNCVAL( array_new )},
+  { LNILKEY, LNILVAL}
+};
+
+int luaopen_array(lua_State *L) {
+  luaL_rometatable(L, ARRAY_HANDLE, (void *)array_meta_map);  // create metatable for arrays
+  return 0;
+}
+
+NODEMCU_MODULE(ARRAY, "array", array_map, luaopen_array);
@@ -0,0 +1,352 @@
+// Module for mutable byte buffers
+//
+// A buffer is a fixed size block of bytes that can be changed in place,
+// so binary protocols don't have to build a new string for every edit.
+// Modules that take binary data (net, spi, i2c, uart, file, ws2812 and
+// struct.unpack) read a buffer in place wherever they accept a string.
+//
+// A builder collects strings into a heap block that doubles as needed,
+// so a long string such as an HTTP response is assembled with a few
+// reallocations and made into a Lua string once.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "module.h"
+#include "lauxlib.h"
+
+#define BUILDER_HANDLE "buffer.builder"
+
+typedef struct {
+  char *data;   /* allocated with the Lua allocator, NULL while size is 0 */
+  size_t len;
+  size_t size;
+} builder_t;
+
+#define checkbuffer(L,n) ((luaL_Bytes *)luaL_checkudata(L, (n), LUA_BUFFERHANDLE))
+#define checkbuilder(L,n) ((builder_t *)luaL_checkudata(L, (n), BUILDER_HANDLE))
+
+static luaL_Bytes *newbuffer(lua_State *L, size_t len) {
+  luaL_Bytes *b = (luaL_Bytes *)lua_newuserdata(L, sizeof(luaL_Bytes) + len);
+  b->data = (char *)(b + 1);
+  b->len = len;
+  b->ref = LUA_NOREF;
+  luaL_getmetatable(L, LUA_BUFFERHANDLE);
+  lua_setmetatable(L, -2);
+  return b;
+}
+
+static ptrdiff_t posrelat (ptrdiff_t pos, size_t len) {
+  /* relative string position: negative means back from end */
+  if (pos < 0) pos += (ptrdiff_t)len + 1;
+  return (pos >= 0) ? pos : 0;
+}
+
+// Clip the positions i and j at narg and narg+1, as string.sub() does,
+// and return the length of the range and its offset in *off
+static size_t getrange(lua_State *L, int narg, size_t len, size_t *off) {
+  ptrdiff_t i = posrelat(luaL_optinteger(L, narg, 1), len);
+  ptrdiff_t j = posrelat(luaL_optinteger(L, narg + 1, -1), len);
+  if (i < 1) i = 1;
+  if (j > (ptrdiff_t)len) j = (ptrdiff_t)len;
+  *off = i - 1;
+  return (i <= j) ? (size_t)(j - i + 1) : 0;
+}
+
+// Check that the n bytes at position narg lie within the buffer, and
+// return their offset
+static size_t checkpos(lua_State *L, int narg, luaL_Bytes *b, size_t n) {
+  ptrdiff_t pos = posrelat(luaL_checkinteger(L, narg), b->len);
+  luaL_argcheck(L, pos >= 1 && n <= b->len && (size_t)pos <= b->len - n + 1, narg, "out of range");
+  return pos - 1;
+}
+
+// Parse an integer format of getint()/setint(): an optional '<' (little
+// endian, the default) or '>' (big endian), then one of b/B (8 bits),
+// h/H (16 bits) or i/I (32 bits), upper case for unsigned
+static int getformat(lua_State *L, int narg, int *bigendian, int *issigned) {
+  const char *fmt = luaL_checkstring(L, narg);
+  *bigendian = 0;
+  if (*fmt == '<' || *fmt == '>')
+    *bigendian = (*fmt++ == '>');
+  *issigned = (*fmt >= 'a');
+  switch (*fmt) {
+    case 'b': case 'B': if (fmt[1] == '\0') return 1; break;
+    case 'h': case 'H': if (fmt[1] == '\0') return 2; break;
+    case 'i': case 'I': if (fmt[1] == '\0') return 4; break;
+  }
+  return luaL_argerror(L, narg, "invalid format");
+}
+
+// Lua: buffer.new(size[, byte]) or buffer.new(string or buffer)
+static int buffer_new(lua_State *L) {
+  if (lua_type(L, 1) == LUA_TNUMBER) {
+    int size = luaL_checkinteger(L, 1);
+    int fill = luaL_optinteger(L, 2, 0);
+    luaL_argcheck(L, size >= 0, 1, "should be >= 0");
+    luaL_Bytes *b = newbuffer(L, size);
+    memset(b->data, fill, size);
+  } else {
+    size_t len;
+    const char *s = luaL_checkbytes(L, 1, &len);
+    luaL_Bytes *b = newbuffer(L, len);
+    memcpy(b->data, s, len);
+  }
+  return 1;
+}
+
+// Lua: buf:get(i[, j]) -- the bytes from i to j (default i) as integers
+static int buffer_get(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  size_t off = checkpos(L, 2, b, 1);
+  size_t n;
+  if (lua_isnoneornil(L, 3)) {
+    n = 1;
+  } else {
+    ptrdiff_t j = posrelat(luaL_checkinteger(L, 3), b->len);
+    if (j > (ptrdiff_t)b->len) j = (ptrdiff_t)b->len;
+    n = (j > (ptrdiff_t)off) ? (size_t)(j - off) : 0;
+  }
+  luaL_checkstack(L, n, "buffer slice too long");
+  size_t i;
+  for (i = 0; i < n; i++)
+    lua_pushinteger(L, (uint8_t)b->data[off + i]);
+  return n;
+}
+
+// Lua: buf:set(pos, ...) -- store bytes and strings or buffers from pos on
+static int buffer_set(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  size_t off = checkpos(L, 2, b, 0);
+  int top = lua_gettop(L);
+  int argn;
+  for (argn = 3; argn <= top; argn++) {
+    if (lua_type(L, argn) == LUA_TNUMBER) {
+      luaL_argcheck(L, off < b->len, argn, "out of range");
+      b->data[off++] = (char)luaL_checkinteger(L, argn);
+    } else {
+      size_t len;
+      const char *s = luaL_checkbytes(L, argn, &len);
+      luaL_argcheck(L, len <= b->len - off, argn, "out of range");
+      memmove(b->data + off, s, len);
+      off += len;
+    }
+  }
+  return 0;
+}
+
+// Lua: buf:getint(pos, format) -- read an integer at pos
+static int buffer_getint(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  int bigendian, issigned;
+  int size = getformat(L, 3, &bigendian, &issigned);
+  const uint8_t *p = (const uint8_t *)b->data + checkpos(L, 2, b, size);
+  uint32_t v = 0;
+  int i;
+  for (i = 0; i < size; i++)
+    v |= (uint32_t)p[bigendian ? size - 1 - i : i] << (8 * i);
+  if (issigned && size < 4 && (v & (1u << (8 * size - 1))))
+    v |= ~0u << (8 * size);   /* sign extend */
+  if (issigned)
+    lua_pushinteger(L, (int32_t)v);
+  else
+    lua_pushnumber(L, (lua_Number)v);
+  return 1;
+}
+
+// Lua: buf:setint(pos, format, value) -- store an integer at pos
+static int buffer_setint(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  int bigendian, issigned;
+  int size = getformat(L, 3, &bigendian, &issigned);
+  uint8_t *p = (uint8_t *)b->data + checkpos(L, 2, b, size);
+  uint32_t v = (uint32_t)(int64_t)luaL_checknumber(L, 4);
+  int i;
+  for (i = 0; i < size; i++)
+    p[bigendian ? size - 1 - i : i] = (uint8_t)(v >> (8 * i));
+  return 0;
+}
+
+// Lua: buf:fill(byte[, i[, j]])
+static int buffer_fill(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  int byte = luaL_checkinteger(L, 2);
+  size_t off;
+  size_t n = getrange(L, 3, b->len, &off);
+  memset(b->data + off, byte, n);
+  return 0;
+}
+
+// Lua: buf:copy(pos, src[, i[, j]]) -- store bytes i to j of a string or
+// buffer at pos; src may overlap the buffer
+static int buffer_copy(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  size_t off = checkpos(L, 2, b, 0);
+  size_t len, srcoff;
+  const char *s = luaL_checkbytes(L, 3, &len);
+  size_t n = getrange(L, 4, len, &srcoff);
+  luaL_argcheck(L, n <= b->len - off, 3, "out of range");
+  memmove(b->data + off, s + srcoff, n);
+  return 0;
+}
+
+// Lua: buf:sub(i[, j]) -- a buffer that shares bytes i to j with buf
+static int buffer_sub(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  size_t off;
+  size_t n = getrange(L, 2, b->len, &off);
+  luaL_Bytes *view = newbuffer(L, 0);
+  view->data = b->data + off;
+  view->len = n;
+  lua_pushvalue(L, 1);   /* keep the bytes alive as long as the view */
+  view->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  return 1;
+}
+
+// Lua: buf:tostring([i[, j]]) -- a string with a copy of the bytes
+static int buffer_tostring(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  size_t off;
+  size_t n = getrange(L, 2, b->len, &off);
+  lua_pushlstring(L, b->data + off, n);
+  return 1;
+}
+
+static int buffer_len(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  lua_pushinteger(L, b->len);
+  return 1;
+}
+
+static int buffer_gc(lua_State *L) {
+  luaL_Bytes *b = checkbuffer(L, 1);
+  luaL_unref(L, LUA_REGISTRYINDEX, b->ref);
+  b->ref = LUA_NOREF;
+  return 0;
+}
+
+// Make room for n more bytes in a builder, doubling its block as needed
+static char *builder_reserve(lua_State *L, builder_t *sb, size_t n) {
+  if (sb->size - sb->len < n) {
+    size_t size = sb->size ? sb->size : 64;
+    while (size - sb->len < n) {
+      if (size > ((size_t)-1) / 2)
+        luaL_error(L, "builder too large");
+      size *= 2;
+    }
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    char *data = (char *)allocf(ud, sb->data, sb->size, size);
+    if (data == NULL)
+      luaL_error(L, "not enough memory");
+    sb->data = data;
+    sb->size = size;
+  }
+  return sb->data + sb->len;
+}
+
+// Lua: buffer.builder([size]) -- an empty builder with room for size bytes
+static int buffer_builder(lua_State *L) {
+  int size = luaL_optinteger(L, 1, 0);
+  luaL_argcheck(L, size >= 0, 1, "should be >= 0");
+  builder_t *sb = (builder_t *)lua_newuserdata(L, sizeof(builder_t));
+  sb->data = NULL;
+  sb->len = sb->size = 0;
+  luaL_getmetatable(L, BUILDER_HANDLE);
+  lua_setmetatable(L, -2);
+  if (size > 0)
+    builder_reserve(L, sb, size);
+  return 1;
+}
+
+// Lua: sb:append(data1[, data2, ...]) -- add strings, numbers or buffers
+// and return sb
+static int builder_append(lua_State *L) {
+  builder_t *sb = checkbuilder(L, 1);
+  int top = lua_gettop(L);
+  int argn;
+  for (argn = 2; argn <= top; argn++) {
+    size_t len;
+    const char *s = luaL_checkbytes(L, argn, &len);
+    memcpy(builder_reserve(L, sb, len), s, len);
+    sb->len += len;
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+// Lua: sb:reset() -- empty the builder, but keep its block for reuse
+static int builder_reset(lua_State *L) {
+  builder_t *sb = checkbuilder(L, 1);
+  sb->len = 0;
+  return 0;
+}
+
+// Lua: sb:tostring() -- the bytes collected so far as a string
+static int builder_tostring(lua_State *L) {
+  builder_t *sb = checkbuilder(L, 1);
+  lua_pushlstring(L, sb->len ? sb->data : "", sb->len);
+  return 1;
+}
+
+static int builder_len(lua_State *L) {
+  builder_t *sb = checkbuilder(L, 1);
+  lua_pushinteger(L, sb->len);
+  return 1;
+}
+
+static int builder_gc(lua_State *L) {
+  builder_t *sb = checkbuilder(L, 1);
+  if (sb->data) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    allocf(ud, sb->data, sb->size, 0);
+    sb->data = NULL;
+    sb->len = sb->size = 0;
+  }
+  return 0;
+}
+
+static const LUA_REG_TYPE builder_meta_map[] =
+{
+  { LSTRKEY( "append" ),     LFUNCVAL( builder_append )},
+  { LSTRKEY( "reset" ),      LFUNCVAL( builder_reset )},
+  { LSTRKEY( "tostring" ),   LFUNCVAL( builder_tostring )},
+  { LSTRKEY( "__gc" ),       LFUNCVAL( builder_gc )},
+  { LSTRKEY( "__index" ),    LROVAL( builder_meta_map )},
+  { LSTRKEY( "__len" ),      LFUNCVAL( builder_len )},
+  { LSTRKEY( "__tostring" ), LFUNCVAL( builder_tostring )},
+  { LNILKEY, LNILVAL}
+};
+
+static const LUA_REG_TYPE buffer_meta_map[] =
+{
+  { LSTRKEY( "copy" ),       LFUNCVAL( buffer_copy )},
+  { LSTRKEY( "fill" ),       LFUNCVAL( buffer_fill )},
+  { LSTRKEY( "get" ),        LFUNCVAL( buffer_get )},
+  { LSTRKEY( "getint" ),     LFUNCVAL( buffer_getint )},
+  { LSTRKEY( "set" ),        LFUNCVAL( buffer_set )},
+  { LSTRKEY( "setint" ),     LFUNCVAL( buffer_setint )},
+  { LSTRKEY( "sub" ),        LFUNCVAL( buffer_sub )},
+  { LSTRKEY( "tostring" ),   LFUNCVAL( buffer_tostring )},
+  { LSTRKEY( "__gc" ),       LFUNCVAL( buffer_gc )},
+  { LSTRKEY( "__index" ),    LROVAL( buffer_meta_map )},
+  { LSTRKEY( "__len" ),      LFUNCVAL( buffer_len )},
+  { LSTRKEY( "__tostring" ), LFUNCVAL( buffer_tostring )},
+  { LNILKEY, LNILVAL}
+};
+
+static const LUA_REG_TYPE buffer_map[] =
+{
+  { LSTRKEY( "builder" ), LFUNCVAL( buffer_builder )},
+  { LSTRKEY( "new" ),     LFUNCVAL( buffer_new )},
+  { LNILKEY, LNILVAL}
+};
+
+int luaopen_buffer(lua_State *L) {
+  luaL_rometatable(L, LUA_BUFFERHANDLE, (void *)buffer_meta_map);  // create metatable for buffers
+  luaL_rometatable(L, BUILDER_HANDLE, (void *)builder_meta_map);  // create metatable for builders
+  return 0;
+}
+
+NODEMCU_MODULE(BUFFER, "buffer", buffer_map, luaopen_buffer);
@@ -37,12 +37,19 @@
  */
 
 // #include <assert.h>
+#define LUAC_CROSS_FILE
 #include "module.h"
-#include "c_string.h"
-#include "c_math.h"
+#include C_HEADER_STRING
+#include C_HEADER_MATH
 #include "c_limits.h"
 #include "lauxlib.h"
+#include "lobject.h"
+#ifdef LUA_CROSS_COMPILER
+/* Host builds have no flash mapped rodata to read bytewise */
+#define byte_of_aligned_array(a, i) ((a)[i])
+#else
 #include "flash_api.h"
+#endif
 #include "ctype.h"
 
 #include "strbuf.h"
@@ -774,8 +781,7 @@ static void json_append_number(lua_State *l, json_config_t *cfg,
 
     strbuf_ensure_empty_length(json, FPCONV_G_FMT_BUFSIZE);
     // len = fpconv_g_fmt(strbuf_empty_ptr(json), num, cfg->encode_number_precision);
-    c_sprintf(strbuf_empty_ptr(json), LUA_NUMBER_FMT, (LUA_NUMBER)num);
-    len = c_strlen(strbuf_empty_ptr(json));
+    len = luaO_num2str(strbuf_empty_ptr(json), (LUA_NUMBER)num);
 
     strbuf_extend_length(json, len);
 }
@@ -496,7 +496,7 @@ static int file_write( lua_State* L )
   if(!fd)
     return luaL_error(L, "open a file first");
   size_t l, rl;
-  const char *s = luaL_checklstring(L, argpos, &l);
+  const char *s = luaL_checkbytes(L, argpos, &l);
   rl = vfs_write(fd, s, l);
   if(rl==l)
     lua_pushboolean(L, 1);
@@ -513,7 +513,7 @@ static int file_writeline( lua_State* L )
   if(!fd)
     return luaL_error(L, "open a file first");
   size_t l, rl;
-  const char *s = luaL_checklstring(L, argpos, &l);
+  const char *s = luaL_checkbytes(L, argpos, &l);
   rl = vfs_write(fd, s, l);
   if(rl==l){
     rl = vfs_write(fd, "\n", 1);
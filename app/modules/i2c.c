@@ -105,7 +105,7 @@ static int i2c_write( lua_State *L )
     }
     else
     {
-      pdata = luaL_checklstring( L, argn, &datalen );
+      pdata = luaL_checkbytes( L, argn, &datalen );
       for( i = 0; i < datalen; i ++ )
         if( platform_i2c_send_byte( id, pdata[ i ] ) == 0 )
           break;
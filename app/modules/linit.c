@@ -20,6 +20,12 @@
 BUILTIN_LIB_INIT( BASE,      "",                 luaopen_base);
 BUILTIN_LIB_INIT( LOADLIB,   LUA_LOADLIBNAME,    luaopen_package);
 
+/* Without ROM tables (host builds only) each library registers a RAM table */
+#if LUA_OPTIMIZE_MEMORY != 2
+#undef BUILTIN_LIB
+#define BUILTIN_LIB(name, luaname, map)
+#endif
+
 #if defined(LUA_USE_BUILTIN_IO)
 BUILTIN_LIB_INIT( IO,        LUA_IOLIBNAME,      luaopen_io);
 #endif
@@ -55,11 +61,15 @@ BUILTIN_LIB(      CO,        LUA_COLIBNAME,     co_funcs);
 #if defined(LUA_USE_BUILTIN_MATH)
 extern const luaR_entry math_map[];
 BUILTIN_LIB(      MATH,      LUA_MATHLIBNAME,   math_map);
+#if LUA_OPTIMIZE_MEMORY != 2
+BUILTIN_LIB_INIT( MATH,      LUA_MATHLIBNAME,   luaopen_math);
+#endif
 #endif
 
-#ifdef LUA_CROSS_COMPILER
+#if defined(LUA_CROSS_COMPILER) && !defined(LUA_HOST_MODULES)
 const luaL_Reg lua_libs[] = {{NULL, NULL}};
 const luaR_table lua_rotable[] = {{NULL, NULL}};
+extern const luaR_table lua_rotable_end[1] __attribute__((alias("lua_rotable")));
 #else 
 extern const luaL_Reg lua_libs[];
 #endif
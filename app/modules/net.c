@@ -42,6 +42,9 @@ static const net_table_name NET_TABLES[] = {
 #define TYPE_TCP TYPE_TCP_CLIENT
 #define TYPE_UDP TYPE_UDP_SOCKET
 
+// What the coroutine of a TCP socket is waiting for
+enum { WAIT_NONE = 0, WAIT_RECV, WAIT_SEND };
+
 typedef struct lnet_userdata {
   enum net_type type;
   int self_ref;
@@ -65,34 +68,47 @@ typedef struct lnet_userdata {
       int cb_connect_ref;
       int cb_disconnect_ref;
       int cb_reconnect_ref;
+      // For recv() and send() in a coroutine:
+      int co_ref;         // the coroutine that last waited
+      int wait;
+      int token;          // of the wait, see luaL_yieldwait()
+      int queue;          // recv() has been used: keep data until it's read
+      struct pbuf *rx;    // the data not yet read
+      int tx_ref;         // the string or buffer being sent, held until
+      const char *tx;     // all of it is written, and the rest of it
+      size_t txlen;
     } client;
   };
 } lnet_userdata;
 
 #pragma mark - LWIP errors
 
-int lwip_lua_checkerr (lua_State *L, err_t err) {
+static const char *lwip_errstr (err_t err) {
   switch (err) {
-    case ERR_OK: return 0;
-    case ERR_MEM: return luaL_error(L, "out of memory");
-    case ERR_BUF: return luaL_error(L, "buffer error");
-    case ERR_TIMEOUT: return luaL_error(L, "timeout");
-    case ERR_RTE: return luaL_error(L, "routing problem");
-    case ERR_INPROGRESS: return luaL_error(L, "in progress");
-    case ERR_VAL: return luaL_error(L, "illegal value");
-    case ERR_WOULDBLOCK: return luaL_error(L, "would block");
-    case ERR_ABRT: return luaL_error(L, "connection aborted");
-    case ERR_RST: return luaL_error(L, "connection reset");
-    case ERR_CLSD: return luaL_error(L, "connection closed");
-    case ERR_CONN: return luaL_error(L, "not connected");
-    case ERR_ARG: return luaL_error(L, "illegal argument");
-    case ERR_USE: return luaL_error(L, "address in use");
-    case ERR_IF: return luaL_error(L, "netif error");
-    case ERR_ISCONN: return luaL_error(L, "already connected");
-    default: return luaL_error(L, "unknown error");
+    case ERR_MEM: return "out of memory";
+    case ERR_BUF: return "buffer error";
+    case ERR_TIMEOUT: return "timeout";
+    case ERR_RTE: return "routing problem";
+    case ERR_INPROGRESS: return "in progress";
+    case ERR_VAL: return "illegal value";
+    case ERR_WOULDBLOCK: return "would block";
+    case ERR_ABRT: return "connection aborted";
+    case ERR_RST: return "connection reset";
+    case ERR_CLSD: return "connection closed";
+    case ERR_CONN: return "not connected";
+    case ERR_ARG: return "illegal argument";
+    case ERR_USE: return "address in use";
+    case ERR_IF: return "netif error";
+    case ERR_ISCONN: return "already connected";
+    default: return "unknown error";
   }
 }
 
+int lwip_lua_checkerr (lua_State *L, err_t err) {
+  if (err == ERR_OK) return 0;
+  return luaL_error(L, "%s", lwip_errstr(err));
+}
+
 #pragma mark - Create
 
 lnet_userdata *net_create( lua_State *L, enum net_type type ) {
@@ -112,6 +128,14 @@ lnet_userdata *net_create( lua_State *L, enum net_type type ) {
       ud->client.cb_reconnect_ref = LUA_NOREF;
       ud->client.cb_disconnect_ref = LUA_NOREF;
       ud->client.hold = 0;
+      ud->client.co_ref = LUA_NOREF;
+      ud->client.wait = WAIT_NONE;
+      ud->client.token = 0;
+      ud->client.queue = 0;
+      ud->client.rx = NULL;
+      ud->client.tx_ref = LUA_NOREF;
+      ud->client.tx = NULL;
+      ud->client.txlen = 0;
     case TYPE_UDP_SOCKET:
       ud->client.wait_dns = 0;
       ud->client.cb_dns_ref = LUA_NOREF;
@@ -125,6 +149,107 @@ lnet_userdata *net_create( lua_State *L, enum net_type type ) {
   return ud;
 }
 
+#pragma mark - Coroutines
+
+// Is the coroutine of the socket still in its wait? Other code that
+// resumes it ends the wait, and it must not be resumed again for it
+static int net_waiting( lua_State *L, lnet_userdata *ud ) {
+  if (ud->client.wait == WAIT_NONE) return 0;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ud->client.co_ref);
+  int waiting = luaL_waiting(lua_tothread(L, -1), ud->client.token);
+  lua_pop(L, 1);
+  if (!waiting) ud->client.wait = WAIT_NONE;
+  return waiting;
+}
+
+// Resume the coroutine waiting in recv() or send() with the nargs values
+// on top of the stack as the results, if it is still waiting
+static void net_wake( lua_State *L, lnet_userdata *ud, int nargs ) {
+  if (!net_waiting(L, ud)) {
+    lua_pop(L, nargs);
+    return;
+  }
+  ud->client.wait = WAIT_NONE;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ud->client.co_ref);
+  lua_State *co = lua_tothread(L, -1);
+  lua_insert(L, -(nargs + 1));  // the thread stays on the stack while it runs
+  luaL_resume(L, co, nargs);
+  lua_pop(L, 1);
+}
+
+// Wait in the running coroutine, which becomes that of the socket
+static int net_wait( lua_State *L, lnet_userdata *ud, int what ) {
+  lua_State *co = NULL;
+  if (ud->client.co_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->client.co_ref);
+    co = lua_tothread(L, -1);
+    lua_pop(L, 1);
+  }
+  if (co != L) {
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->client.co_ref);
+    lua_pushthread(L);
+    ud->client.co_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  ud->client.wait = what;
+  return luaL_yieldwait(L, &ud->client.token);
+}
+
+// Let go of the data being sent
+static void net_drop_tx( lua_State *L, lnet_userdata *ud ) {
+  luaL_unref(L, LUA_REGISTRYINDEX, ud->client.tx_ref);
+  ud->client.tx_ref = LUA_NOREF;
+  ud->client.tx = NULL;
+  ud->client.txlen = 0;
+}
+
+// Wake a coroutine still waiting on a closed socket, and let go of it and
+// of the data not read or not sent
+static void net_drop_co( lua_State *L, lnet_userdata *ud ) {
+  if (ud->client.wait != WAIT_NONE) {
+    lua_pushnil(L);
+    net_wake(L, ud, 1);
+  }
+  luaL_unref(L, LUA_REGISTRYINDEX, ud->client.co_ref);
+  ud->client.co_ref = LUA_NOREF;
+  if (ud->client.rx) {
+    pbuf_free(ud->client.rx);
+    ud->client.rx = NULL;
+  }
+  net_drop_tx(L, ud);
+}
+
+// Push the received data and free it, and open the window by its size
+static void net_push_rx( lua_State *L, lnet_userdata *ud, struct pbuf *p ) {
+  u16_t len = p->tot_len;
+  if (p->next == NULL) {
+    lua_pushlstring(L, p->payload, len);
+  } else {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    pbuf_copy_partial(p, luaL_prepbuffsize(&b, len), len, 0);
+    luaL_addsize(&b, len);
+    luaL_pushresult(&b);
+  }
+  pbuf_free(p);
+  if (ud->tcp_pcb)
+    tcp_recved(ud->tcp_pcb, len);
+}
+
+// Write as much of the data left to send as there is room for
+static err_t net_write_tx( lnet_userdata *ud ) {
+  size_t n = tcp_sndbuf(ud->tcp_pcb);
+  if (n > ud->client.txlen) n = ud->client.txlen;
+  if (n == 0) return ERR_OK;
+  err_t err = tcp_write(ud->tcp_pcb, ud->client.tx, n, TCP_WRITE_FLAG_COPY);
+  if (err == ERR_OK) {
+    ud->client.tx += n;
+    ud->client.txlen -= n;
+  } else if (err == ERR_MEM && tcp_sndqueuelen(ud->tcp_pcb) > 0) {
+    err = ERR_OK;  // out of segments: wait for an ack to free some
+  }
+  return err;
+}
+
 #pragma mark - LWIP callbacks
 
 static void net_err_cb(void *arg, err_t err) {
@@ -132,6 +257,14 @@ static void net_err_cb(void *arg, err_t err) {
   if (!ud || ud->type != TYPE_TCP_CLIENT || ud->self_ref == LUA_NOREF) return;
   ud->pcb = NULL; // Will be freed at LWIP level
   lua_State *L = lua_getstate();
+  if (ud->client.wait != WAIT_NONE) {
+    lua_pushnil(L);
+    net_wake(L, ud, 1);
+  }
+  // the coroutine may still read the data received, but is no longer held
+  luaL_unref(L, LUA_REGISTRYINDEX, ud->client.co_ref);
+  ud->client.co_ref = LUA_NOREF;
+  net_drop_tx(L, ud);
   int ref;
   if (err != ERR_OK && ud->client.cb_reconnect_ref != LUA_NOREF)
     ref = ud->client.cb_reconnect_ref;
@@ -236,6 +369,18 @@ static err_t net_tcp_recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, er
     net_err_cb(arg, err);
     return tcp_close(tpcb);
   }
+  lua_State *L = lua_getstate();
+  if (ud->client.wait == WAIT_RECV && net_waiting(L, ud)) {
+    net_push_rx(L, ud, p);
+    net_wake(L, ud, 1);
+    return ERR_OK;
+  }
+  if (ud->client.queue && ud->client.cb_receive_ref == LUA_NOREF) {
+    // keep it for recv(), with the window closed by its size until then
+    if (ud->client.rx) pbuf_cat(ud->client.rx, p);
+    else ud->client.rx = p;
+    return ERR_OK;
+  }
   net_recv_cb(ud, p, 0, 0);
   tcp_recved(tpcb, ud->client.hold ? 0 : TCP_WND);
   return ERR_OK;
@@ -244,6 +389,24 @@ static err_t net_tcp_recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, er
 static err_t net_sent_cb(void *arg, struct tcp_pcb *tpcb, u16_t len) {
   lnet_userdata *ud = (lnet_userdata*)arg;
   if (!ud || !ud->pcb || ud->type != TYPE_TCP_CLIENT || ud->self_ref == LUA_NOREF) return ERR_ABRT;
+  if (ud->client.tx_ref != LUA_NOREF) {
+    err_t err = net_write_tx(ud);
+    if (err == ERR_OK && ud->client.txlen > 0)
+      return ERR_OK;
+    // all written, or failed: send() returns nothing, or nil and the error
+    lua_State *L = lua_getstate();
+    net_drop_tx(L, ud);
+    if (ud->client.wait == WAIT_SEND) {
+      if (err == ERR_OK) {
+        net_wake(L, ud, 0);
+      } else {
+        lua_pushnil(L);
+        lua_pushstring(L, lwip_errstr(err));
+        net_wake(L, ud, 2);
+      }
+    }
+    return ERR_OK;
+  }
   if (ud->client.cb_sent_ref == LUA_NOREF) return ERR_OK;
   lua_State *L = lua_getstate();
   lua_rawgeti(L, LUA_REGISTRYINDEX, ud->client.cb_sent_ref);
@@ -538,7 +701,8 @@ int net_send( lua_State *L ) {
     if (!domain) return luaL_error(L, "need IP address");
     if (!ipaddr_aton(domain, &addr)) return luaL_error(L, "invalid IP address");
   }
-  data = luaL_checklstring(L, stack++, &datalen);
+  int dataidx = stack++;
+  data = luaL_checkbytes(L, dataidx, &datalen);
   if (!data || datalen == 0) return luaL_error(L, "no data to send");
   if (lua_isfunction(L, stack) || lua_islightfunction(L, stack)) {
     lua_pushvalue(L, stack++);
@@ -578,11 +742,48 @@ int net_send( lua_State *L ) {
       lua_call(L, 1, 0);
     }
   } else if (ud->type == TYPE_TCP_CLIENT) {
+    if (ud->client.tx_ref != LUA_NOREF)
+      return luaL_error(L, "send in progress");
+    if (datalen > tcp_sndbuf(ud->tcp_pcb) && !net_waiting(L, ud) &&
+        luaL_canyield(L)) {
+      // in a coroutine, wait for room rather than fail; the data is held
+      // until it is all written, whatever the coroutine does meanwhile
+      lua_pushvalue(L, dataidx);
+      ud->client.tx_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+      ud->client.tx = data;
+      ud->client.txlen = datalen;
+      err = net_write_tx(ud);
+      if (err != ERR_OK) {
+        net_drop_tx(L, ud);
+        return lwip_lua_checkerr(L, err);
+      }
+      return net_wait(L, ud, WAIT_SEND);
+    }
     err = tcp_write(ud->tcp_pcb, data, datalen, TCP_WRITE_FLAG_COPY);
   }
   return lwip_lua_checkerr(L, err);
 }
 
+// Lua: data = client:recv()
+int net_recv( lua_State *L ) {
+  lnet_userdata *ud = net_get_udata(L);
+  if (!ud || ud->type != TYPE_TCP_CLIENT)
+    return luaL_error(L, "invalid user data");
+  ud->client.queue = 1;
+  if (ud->client.rx) {
+    struct pbuf *p = ud->client.rx;
+    ud->client.rx = NULL;
+    net_push_rx(L, ud, p);
+    return 1;
+  }
+  if (!ud->pcb)
+    return 0;
+  if (net_waiting(L, ud))
+    return luaL_error(L, "already waiting");
+  luaL_checkyieldable(L);
+  return net_wait(L, ud, WAIT_RECV);
+}
+
 // Lua: client:hold()
 int net_hold( lua_State *L ) {
   lnet_userdata *ud = net_get_udata(L);
@@ -738,6 +939,7 @@ int net_close( lua_State *L ) {
           tcp_abort(ud->tcp_pcb);
         }
         ud->tcp_pcb = NULL;
+        net_drop_co(L, ud);
         break;
       case TYPE_TCP_SERVER:
         tcp_close(ud->tcp_pcb);
@@ -789,6 +991,8 @@ int net_delete( lua_State *L ) {
       ud->client.cb_disconnect_ref = LUA_NOREF;
       luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_reconnect_ref);
       ud->client.cb_reconnect_ref = LUA_NOREF;
+      ud->client.wait = WAIT_NONE;
+      net_drop_co(L, ud);
     case TYPE_UDP_SOCKET:
       luaL_unref(L, LUA_REGISTRYINDEX, ud->client.cb_dns_ref);
       ud->client.cb_dns_ref = LUA_NOREF;
@@ -976,6 +1180,7 @@ static const LUA_REG_TYPE net_tcpsocket_map[] = {
   { LSTRKEY( "close" ),   LFUNCVAL( net_close ) },
   { LSTRKEY( "on" ),      LFUNCVAL( net_on ) },
   { LSTRKEY( "send" ),    LFUNCVAL( net_send ) },
+  { LSTRKEY( "recv" ),    LFUNCVAL( net_recv ) },
   { LSTRKEY( "hold" ),    LFUNCVAL( net_hold ) },
   { LSTRKEY( "unhold" ),  LFUNCVAL( net_unhold ) },
   { LSTRKEY( "dns" ),     LFUNCVAL( net_dns ) },
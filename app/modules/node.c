@@ -6,14 +6,19 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lcode.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
 #include "legc.h"
+#include "lgc.h"
+#include "lalloc.h"
 
 #include "lopcodes.h"
+#include "lparser.h"
 #include "lstring.h"
 #include "lundump.h"
+#include "lflash.h"
 
 #include "platform.h"
 #include "lrodefs.h"
@@ -237,6 +242,31 @@ static int writer(lua_State* L, const void* p, size_t size, void* u)
 }
 
 #define toproto(L,i) (clvalue(L->top+(i))->l.p)
+
+// Called by the parser with each function of the main chunk being compiled
+static void compile_emit( lua_State* L, Proto* f, void* ud )
+{
+  luaU_dumpchild((DumpState *)ud, f);
+}
+
+// Load the file at 1 with the CompileStream at 2 in the registry, where the
+// parser looks for it.  Run protected, so that node_compile() can take the
+// stream out of the registry again however the load ends.
+static int compile_load( lua_State* L )
+{
+  lua_pushlightuserdata(L, (void *)&luaY_parser);
+  lua_pushvalue(L, 2);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+#ifdef LUA_OPTIMIZE_BYTECODE
+  lua_pushlightuserdata(L, (void *)&luaK_optimize);  // and have it optimized
+  lua_pushboolean(L, 1);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+#endif
+  if (luaL_loadfsfile(L, lua_tostring(L, 1)) != 0)
+    return lua_error(L);
+  return 1;
+}
+
 // Lua: compile(filename) -- compile lua file into lua bytecode, and save to .lc
 static int node_compile( lua_State* L )
 {
@@ -259,14 +289,12 @@ static int node_compile( lua_State* L )
   output[c_strlen(output) - 1] = '\0';
   NODE_DBG(output);
   NODE_DBG("\n");
-  if (luaL_loadfsfile(L, fname) != 0) {
-    luaM_free( L, output );
-    return luaL_error(L, lua_tostring(L, -1));
-  }
-
-  f = toproto(L, -1);
 
+#ifdef LUA_OPTIMIZE_DEBUG
+  int stripping = 0;      /* the parser already applied node.stripdebug() */
+#else
   int stripping = 1;      /* strip debug information? */
+#endif
 
   file_fd = vfs_open(output, "w+");
   if (!file_fd)
@@ -275,8 +303,37 @@ static int node_compile( lua_State* L )
     return luaL_error(L, "cannot open/write to file");
   }
 
+  // Each function of the main chunk is written out and released as soon
+  // as it has been compiled, so the heap only has to hold the largest one
+  CompileStream stream;
+  lua_lock(L);
+  stream.emit = compile_emit;
+  stream.ud = luaU_dumpbegin(L, writer, &file_fd, stripping);
+  lua_unlock(L);
+  lua_pushcfunction(L, compile_load);
+  lua_pushvalue(L, 1);
+  lua_pushlightuserdata(L, &stream);
+  int status = lua_pcall(L, 2, 1, 0);
+  lua_pushlightuserdata(L, (void *)&luaY_parser);
+  lua_pushnil(L);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+#ifdef LUA_OPTIMIZE_BYTECODE
+  lua_pushlightuserdata(L, (void *)&luaK_optimize);
+  lua_pushnil(L);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+#endif
+
+  if (status != 0) {
+    vfs_close(file_fd);
+    vfs_remove(output);
+    luaM_free( L, output );
+    return luaL_error(L, lua_tostring(L, -1));
+  }
+
+  f = toproto(L, -1);
+
   lua_lock(L);
-  int result = luaU_dump(L, f, writer, &file_fd, stripping);
+  int result = luaU_dumpend((DumpState *)stream.ud, f);
   lua_unlock(L);
 
   if (vfs_flush(file_fd) != VFS_RES_OK) {
@@ -453,6 +510,63 @@ static int node_egc_setmode(lua_State* L) {
   legc_set_mode( L, mode, limit );
   return 0;
 }
+
+#ifdef LUA_ALLOC_ARENA
+// Push a table describing the Lua heap arena
+static void push_arenainfo(lua_State* L) {
+  lalloc_stats st;
+  int i;
+  lalloc_getstats(&st);
+  lua_createtable(L, 0, 7);
+  lua_pushinteger(L, st.size);
+  lua_setfield(L, -2, "size");
+  lua_pushinteger(L, st.used);
+  lua_setfield(L, -2, "used");
+  lua_pushinteger(L, st.free);
+  lua_setfield(L, -2, "free");
+  lua_pushinteger(L, st.largest);
+  lua_setfield(L, -2, "largest");
+  lua_pushinteger(L, st.nfree);
+  lua_setfield(L, -2, "blocks");
+  lua_pushinteger(L, st.spilled);
+  lua_setfield(L, -2, "spilled");
+  lua_createtable(L, LALLOC_BUCKETS, 0);
+  for (i = 0; i < LALLOC_BUCKETS; i++) {
+    lua_pushinteger(L, st.histogram[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setfield(L, -2, "histogram");
+}
+#endif
+
+// Lua: node.meminfo()
+// Returns a table with the free system heap, the Lua heap arena statistics
+// if the arena is enabled, and a census of the live Lua objects by type.
+static int node_meminfo( lua_State* L )
+{
+  lu_mem count[LUA_TUPVAL+1], bytes[LUA_TUPVAL+1];
+  int i;
+  luaC_census(L, count, bytes);
+  lua_createtable(L, 0, 3);
+  lua_pushinteger(L, system_get_free_heap_size());
+  lua_setfield(L, -2, "heap");
+#ifdef LUA_ALLOC_ARENA
+  push_arenainfo(L);
+  lua_setfield(L, -2, "arena");
+#endif
+  lua_createtable(L, 0, LUA_TUPVAL - LUA_TSTRING + 1);
+  for (i = LUA_TSTRING; i <= LUA_TUPVAL; i++) {
+    lua_createtable(L, 0, 2);
+    lua_pushinteger(L, count[i]);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, bytes[i]);
+    lua_setfield(L, -2, "bytes");
+    lua_setfield(L, -2, i == LUA_TPROTO ? "proto" :
+                        i == LUA_TUPVAL ? "upval" : lua_typename(L, i));
+  }
+  lua_setfield(L, -2, "objects");
+  return 1;
+}
 //
 // Lua: osprint(true/false)
 // Allows you to turn on the native Espressif SDK printing
@@ -540,6 +654,46 @@ static int node_random (lua_State *L) {
 }
 
 
+#ifdef LUA_FLASH_STORE
+// Lua: node.flashreload(imagefile) -- load an LFS image and restart
+static int node_flashreload (lua_State *L) {
+  const char *fname = luaL_checkstring(L, 1);
+  return luaN_reload(L, fname);
+}
+
+// Lua: node.flashindex([module]) -- module function, or list of modules
+static int node_flashindex (lua_State *L) {
+  const char *image = luaN_image();
+  if (lua_isnoneornil(L, 1)) {
+    const FlashHeader *h = (const FlashHeader *)image;
+    const FlashModule *m = (const FlashModule *)(image + sizeof(FlashHeader));
+    lu_int32 i;
+    if (!image)
+      return 0;
+    lua_createtable(L, h->nmodules, 0);
+    for (i = 0; i < h->nmodules; i++) {
+      lua_pushstring(L, image + m[i].name);
+      lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+  } else {
+    int i = luaN_findmodule(image, luaL_checkstring(L, 1));
+    if (i < 0)
+      return 0;
+    luaN_loadmodule(L, image, i);
+    return 1;
+  }
+}
+#endif
+
+#ifdef LUA_FREEZE_STORE
+// Lua: rotable = node.freeze(table) -- copy a constant table into flash
+static int node_freeze (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  return luaN_freeze(L, 1);
+}
+#endif
+
 // Module function map
 
 static const LUA_REG_TYPE node_egc_map[] = {
@@ -567,6 +721,7 @@ static const LUA_REG_TYPE node_map[] =
   { LSTRKEY( "flashid" ), LFUNCVAL( node_flashid ) },
   { LSTRKEY( "flashsize" ), LFUNCVAL( node_flashsize) },
   { LSTRKEY( "heap" ), LFUNCVAL( node_heap ) },
+  { LSTRKEY( "meminfo" ), LFUNCVAL( node_meminfo ) },
   { LSTRKEY( "input" ), LFUNCVAL( node_input ) },
   { LSTRKEY( "output" ), LFUNCVAL( node_output ) },
 // Moved to adc module, use adc.readvdd33()
@@ -580,6 +735,13 @@ static const LUA_REG_TYPE node_map[] =
   { LSTRKEY( "random" ), LFUNCVAL( node_random) },
 #ifdef LUA_OPTIMIZE_DEBUG
   { LSTRKEY( "stripdebug" ), LFUNCVAL( node_stripdebug ) },
+#endif
+#ifdef LUA_FLASH_STORE
+  { LSTRKEY( "flashreload" ), LFUNCVAL( node_flashreload ) },
+  { LSTRKEY( "flashindex" ), LFUNCVAL( node_flashindex ) },
+#endif
+#ifdef LUA_FREEZE_STORE
+  { LSTRKEY( "freeze" ), LFUNCVAL( node_freeze ) },
 #endif
   { LSTRKEY( "egc" ),  LROVAL( node_egc_map ) },
   { LSTRKEY( "task" ), LROVAL( node_task_map ) },
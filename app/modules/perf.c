@@ -4,18 +4,24 @@
 // 
 // perf.start(start, end, nbins[, pc offset on stack])
 // perf.stop()  -> total sample, samples outside range, table { addr -> count , .. }
+//
+// perf.luastart([interval_us[, depth]])
+// perf.luastop() -> total samples, samples outside Lua, table { "src:line" -> count, .. },
+//                   table { "root;..;leaf" -> count, .. }
 
 
 #include "ets_sys.h"
 #include "os_type.h"
 #include "osapi.h"
 #include "c_stdlib.h"
+#include "c_stdio.h"
 
 #include "module.h"
 #include "lauxlib.h"
 #include "platform.h"
 #include "hw_timer.h"
 #include "cpu_esp8266.h"
+#include "lstate.h"
 
 typedef struct {
   int ref;
@@ -54,6 +60,8 @@ static void ICACHE_RAM_ATTR hw_timer_cb(os_param_t p)
   }
 }
 
+static void stop_lua(lua_State *L);
+
 static int perf_start(lua_State *L)
 {
   uint32_t start = luaL_optinteger(L, 1, 0x40000000);
@@ -86,6 +94,7 @@ static int perf_start(lua_State *L)
   if (data) {
     lua_unref(L, data->ref);
   }
+  stop_lua(L);
 
   data = d;
 
@@ -135,9 +144,252 @@ static int perf_stop(lua_State *L)
   return 4;
 }
 
+//
+// Lua level profiling.  The timer interrupt can't safely walk the Lua stack,
+// so it just arms a one-shot count hook on the main thread (as lua.c does
+// from its signal handler).  The hook runs before the next VM instruction and
+// records the function and current line of each frame into a ring, which is
+// folded into the result tables whenever it fills up.  The ring holds the
+// functions themselves, so their prototypes can't be collected before they
+// are looked up.
+//
+// A hook that fires after the next tick was pending while Lua was idle or
+// inside a C function; such samples are counted as outside.
+//
+
+#define LUA_RING      32    /* samples buffered before they are aggregated */
+#define LUA_MAXDEPTH  16
+
+typedef struct {
+  int ref;
+  int ring_ref;             /* table of sampled functions, LUA_RING * depth */
+  int hot_ref;              /* "src:line" -> count */
+  int stacks_ref;           /* "root;...;leaf" -> count */
+  lua_State *L;
+  int depth;
+  int n;                    /* samples in the ring */
+  volatile uint32_t ticks;  /* timer ticks so far */
+  volatile uint32_t armed;  /* tick that armed the hook, 0 if none pending */
+  volatile uint32_t skipped;  /* ticks that found the hook still pending */
+  uint32_t late;            /* hooks that ran after the next tick */
+  uint32_t samples;         /* samples recorded */
+  uint8_t nframes[LUA_RING];
+  int lines[1];             /* LUA_RING * depth current lines */
+} LDATA;
+
+static LDATA *ldata;
+
+static void lua_sample_hook(lua_State *L, lua_Debug *ar);
+
+static void ICACHE_RAM_ATTR lua_timer_cb(os_param_t p)
+{
+  (void) p;
+
+  if (ldata) {
+    ldata->ticks++;
+    if (ldata->armed) {
+      ldata->skipped++;
+    } else {
+      // The equivalent of lua_sethook(), which lives in flash
+      lua_State *L = ldata->L;
+      ldata->armed = ldata->ticks;
+      L->hook = lua_sample_hook;
+      L->basehookcount = 1;
+      L->hookcount = 1;
+      L->hookmask = LUA_MASKCOUNT;
+    }
+  }
+}
+
+// Add one to t[key] where the key is on the top of the stack, and pop it
+static void bump(lua_State *L, int t)
+{
+  lua_pushvalue(L, -1);
+  lua_rawget(L, t);
+  lua_Integer n = lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  lua_pushinteger(L, n + 1);
+  lua_rawset(L, t);
+}
+
+// Push the function in ring slot i and add its name to the buffer
+static void add_frame(lua_State *L, luaL_Buffer *b, int ring, int i)
+{
+  lua_Debug ar;
+  char line[12];
+
+  lua_rawgeti(L, ring, i + 1);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    luaL_addstring(b, "(tail call)");
+    return;
+  }
+  lua_getinfo(L, ">S", &ar);
+  luaL_addstring(b, ar.short_src);
+  if (ar.linedefined > 0) {
+    c_sprintf(line, ":%d", ar.linedefined);
+    luaL_addstring(b, line);
+  }
+}
+
+static void flush_ring(lua_State *L, LDATA *d)
+{
+  lua_rawgeti(L, LUA_REGISTRYINDEX, d->ring_ref);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, d->hot_ref);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, d->stacks_ref);
+  int ring = lua_gettop(L) - 2;
+  int hot = ring + 1, stacks = ring + 2;
+  int s;
+
+  for (s = 0; s < d->n; s++) {
+    int base = s * d->depth;
+    int level = d->nframes[s];
+    luaL_Buffer b;
+    lua_Debug ar;
+
+    // The leaf frame is always a Lua function: count hooks only run in the VM
+    lua_rawgeti(L, ring, base + 1);
+    lua_getinfo(L, ">S", &ar);
+    lua_pushfstring(L, "%s:%d", ar.short_src, d->lines[base]);
+    bump(L, hot);
+
+    luaL_buffinit(L, &b);
+    while (level-- > 0) {
+      add_frame(L, &b, ring, base + level);
+      if (level > 0) {
+        luaL_addchar(&b, ';');
+      }
+    }
+    luaL_pushresult(&b);
+    bump(L, stacks);
+  }
+  d->n = 0;
+
+  lua_pop(L, 3);
+}
+
+static void lua_sample_hook(lua_State *L, lua_Debug *ar)
+{
+  LDATA *d = ldata;
+  lua_Debug fr;
+  int level;
+
+  (void) ar;
+  lua_sethook(L, NULL, 0, 0);
+  if (!d || !d->armed || L != d->L) {
+    return;  // a stale hook, or one inherited by a coroutine
+  }
+  if (d->ticks != d->armed) {
+    d->late++;
+    d->armed = 0;
+    return;
+  }
+  d->armed = 0;
+
+  int base = d->n * d->depth;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, d->ring_ref);
+  for (level = 0; level < d->depth && lua_getstack(L, level, &fr); level++) {
+    lua_getinfo(L, "fl", &fr);
+    lua_rawseti(L, -2, base + level + 1);
+    d->lines[base + level] = fr.currentline;
+  }
+  lua_pop(L, 1);
+  d->nframes[d->n] = level;
+  d->samples++;
+
+  if (++d->n == LUA_RING) {
+    flush_ring(L, d);
+  }
+}
+
+static void stop_lua(lua_State *L)
+{
+  LDATA *d = ldata;
+
+  if (d) {
+    ldata = NULL;
+    lua_sethook(d->L, NULL, 0, 0);
+    lua_unref(L, d->ring_ref);
+    lua_unref(L, d->hot_ref);
+    lua_unref(L, d->stacks_ref);
+    lua_unref(L, d->ref);
+  }
+}
+
+static int perf_luastart(lua_State *L)
+{
+  uint32_t interval = luaL_optinteger(L, 1, 1000);
+  int depth = luaL_optinteger(L, 2, 8);
+
+  luaL_argcheck(L, interval >= 100, 1, "interval must be at least 100us");
+  luaL_argcheck(L, depth >= 1 && depth <= LUA_MAXDEPTH, 2, "depth out of range");
+
+  if (data) {
+    platform_hw_timer_close(TIMER_OWNER);
+    lua_unref(L, data->ref);
+    data = NULL;
+  }
+  if (ldata) {
+    platform_hw_timer_close(TIMER_OWNER);
+    stop_lua(L);
+  }
+
+  size_t data_size = sizeof(LDATA) + (LUA_RING * depth - 1) * sizeof(int);
+  LDATA *d = (LDATA *) lua_newuserdata(L, data_size);
+  memset(d, 0, data_size);
+  d->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_createtable(L, LUA_RING * depth, 0);
+  d->ring_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  d->hot_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  d->stacks_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  d->L = lua_getstate();
+  d->depth = depth;
+
+  ldata = d;
+
+  if (!platform_hw_timer_init(TIMER_OWNER, FRC1_SOURCE, TRUE)) {
+    stop_lua(L);
+    luaL_error(L, "Unable to initialize timer");
+  }
+
+  platform_hw_timer_set_func(TIMER_OWNER, lua_timer_cb, 0);
+  platform_hw_timer_arm_us(TIMER_OWNER, interval);
+
+  return 0;
+}
+
+static int perf_luastop(lua_State *L)
+{
+  LDATA *d = ldata;
+
+  if (!d) {
+    return 0;
+  }
+
+  platform_hw_timer_close(TIMER_OWNER);
+  lua_sethook(d->L, NULL, 0, 0);
+  if (d->armed) {
+    d->late++;
+  }
+  flush_ring(L, d);
+
+  lua_pushnumber(L, d->ticks);
+  lua_pushnumber(L, d->skipped + d->late);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, d->hot_ref);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, d->stacks_ref);
+
+  stop_lua(L);
+
+  return 4;
+}
+
 static const LUA_REG_TYPE perf_map[] = {
   { LSTRKEY( "start" ),   LFUNCVAL( perf_start ) },
   { LSTRKEY( "stop" ),    LFUNCVAL( perf_stop ) },
+  { LSTRKEY( "luastart" ), LFUNCVAL( perf_luastart ) },
+  { LSTRKEY( "luastop" ),  LFUNCVAL( perf_luastop ) },
   { LNILKEY, LNILVAL }
 };
 
@@ -141,7 +141,7 @@ static int spi_send_recv( lua_State *L )
     {
       luaL_Buffer b;
 
-      pdata = luaL_checklstring( L, argn, &datalen );
+      pdata = luaL_checkbytes( L, argn, &datalen );
       if (recv > 0) {
         luaL_buffinit( L, &b );
       }
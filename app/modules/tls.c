@@ -291,7 +291,7 @@ static int tls_socket_send( lua_State *L ) {
   }
 
   size_t sl;
-  const char* buf = luaL_checklstring(L, 2, &sl);
+  const char* buf = luaL_checkbytes(L, 2, &sl);
   if (!buf) {
     return luaL_error(L, "wrong arg type");
   }
@@ -41,6 +41,8 @@ tmr.state(id)
 	ret: (bool, int) or nil
 	returns alarm status (true=started/false=stopped) and mode
 	nil if timer is unregistered
+tmr.sleep(interval)
+	in a coroutine, wait for interval ms and let other tasks run
 tmr.softwd(int)
 	set a negative value to stop the timer
 	any other value starts the timer, when the
@@ -352,6 +354,67 @@ static int tmr_create( lua_State *L ) {
 	return 1;
 }
 
+// A coroutine in tmr.sleep(). The registry table at sleep_ref holds each
+// sleeping coroutine's sleep_t by the coroutine, and the coroutine by the
+// sleep_t, so both stay put until the timer fires, whatever the coroutine
+// does meanwhile. A coroutine that sleeps again reuses its sleep_t.
+typedef struct {
+	os_timer_t os;
+	int token;
+} sleep_t;
+
+static int sleep_ref = LUA_NOREF;
+
+static void sleep_wake(void *arg){
+	sleep_t *s = (sleep_t *)arg;
+	int token = s->token;
+	lua_State* L = lua_getstate();
+	lua_rawgeti(L, LUA_REGISTRYINDEX, sleep_ref);
+	lua_pushlightuserdata(L, s);
+	lua_rawget(L, -2);
+	lua_State *co = lua_tothread(L, -1);
+	if (co) {
+		// let go of both, the sleep_t may be collected from here on
+		lua_pushvalue(L, -1);
+		lua_pushnil(L);
+		lua_rawset(L, -4);
+		lua_pushlightuserdata(L, s);
+		lua_pushnil(L);
+		lua_rawset(L, -4);
+	}
+	lua_remove(L, -2);
+	// unless other code resumed the coroutine since it went to sleep
+	if (luaL_waiting(co, token))
+		luaL_resume(L, co, 0);
+	lua_pop(L, 1);
+}
+
+// Lua: tmr.sleep( interval )
+static int tmr_sleep( lua_State *L ) {
+	uint32_t interval = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, (interval > 0 && interval <= MAX_TIMEOUT), 1, MAX_TIMEOUT_ERR_STR);
+	luaL_checkyieldable(L);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, sleep_ref);
+	lua_pushthread(L);
+	lua_rawget(L, -2);
+	sleep_t *s = (sleep_t *)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	if (!s) {
+		lua_pushthread(L);
+		s = (sleep_t *)lua_newuserdata(L, sizeof(sleep_t));
+		lua_rawset(L, -3);
+		lua_pushlightuserdata(L, s);
+		lua_pushthread(L);
+		lua_rawset(L, -3);
+	}
+	lua_pop(L, 1);
+	// still armed if other code resumed this coroutine out of a sleep
+	ets_timer_disarm(&s->os);
+	ets_timer_setfn(&s->os, sleep_wake, s);
+	ets_timer_arm_new(&s->os, interval, 0, 1);
+	return luaL_yieldwait(L, &s->token);
+}
+
 // Module function map
 
 static const LUA_REG_TYPE tmr_dyn_map[] = {
@@ -372,6 +435,7 @@ static const LUA_REG_TYPE tmr_map[] = {
 	{ LSTRKEY( "now" ),          LFUNCVAL( tmr_now ) },
 	{ LSTRKEY( "wdclr" ),        LFUNCVAL( tmr_wdclr ) },
 	{ LSTRKEY( "softwd" ),       LFUNCVAL( tmr_softwd ) },
+	{ LSTRKEY( "sleep" ),        LFUNCVAL( tmr_sleep ) },
 	{ LSTRKEY( "time" ),         LFUNCVAL( tmr_time ) },
 	{ LSTRKEY( "register" ),     LFUNCVAL( tmr_register ) },
 	{ LSTRKEY( "alarm" ),        LFUNCVAL( tmr_alarm ) },
@@ -391,6 +455,8 @@ int luaopen_tmr( lua_State *L ){
 	int i;	
 
 	luaL_rometatable(L, "tmr.timer", (void *)tmr_dyn_map);
+	lua_newtable(L);
+	sleep_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
 	for(i=0; i<NUM_TMR; i++){
 		alarm_timers[i].lua_ref = LUA_NOREF;
@@ -164,8 +164,7 @@ static int l_uart_write( lua_State* L )
     }
     else
     {
-      luaL_checktype( L, s, LUA_TSTRING );
-      buf = lua_tolstring( L, s, &len );
+      buf = luaL_checkbytes( L, s, &len );
       for( i = 0; i < len; i ++ )
         platform_uart_send( id, buf[ i ] );
     }
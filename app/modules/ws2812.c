@@ -131,6 +131,10 @@ static int ws2812_write(lua_State* L) {
   {
     buffer1 = lua_tolstring(L, 1, &length1);
   }
+  else if (luaL_tobytes(L, 1))
+  {
+    buffer1 = luaL_checkbytes(L, 1, &length1);
+  }
   else if (type == LUA_TUSERDATA)
   {
     ws2812_buffer * buffer = (ws2812_buffer*)luaL_checkudata(L, 1, "ws2812.buffer");
@@ -154,6 +158,10 @@ static int ws2812_write(lua_State* L) {
   {
     buffer2 = lua_tolstring(L, 2, &length2);
   }
+  else if (luaL_tobytes(L, 2))
+  {
+    buffer2 = luaL_checkbytes(L, 2, &length2);
+  }
   else if (type == LUA_TUSERDATA)
   {
     ws2812_buffer * buffer = (ws2812_buffer*)luaL_checkudata(L, 2, "ws2812.buffer");
@@ -18,6 +18,9 @@
 #include "user_interface.h"
 #include "user_exceptions.h"
 #include "user_modules.h"
+#ifdef LUA_ALLOC_ARENA
+#include "lalloc.h"
+#endif
 
 #include "ets_sys.h"
 #include "driver/uart.h"
@@ -241,6 +244,11 @@ void user_init(void)
     rtctime_late_startup ();
 #endif
 
+#ifdef LUA_ALLOC_ARENA
+    // Carve the Lua heap out of the system heap while it is still in one piece
+    lalloc_init();
+#endif
+
     UartBautRate br = BIT_RATE_DEFAULT;
 
     input_sig = task_get_id(handle_input);
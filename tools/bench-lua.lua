@@ -0,0 +1,58 @@
+local args = { ... }
+local b = require "tools.build"
+local builder = b.new_builder( ".build/bench-lua" )
+local utils = b.utils
+local sf = string.format
+
+if not (_VERSION == "Lua 5.1" and pcall(require,"lfs")) then
+  print  [[
+
+bench-lua.lua must be run within Lua 5.1 and it requires the Lua Filesystem to be installed.
+See tools/cross-lua.lua for details.
+]]
+  os.exit(1)
+end
+builder:add_option( 'rotables', 'build with ROM tables as the firmware does', true )
+builder:add_option( 'gotos', 'dispatch VM instructions with computed gotos', false )
+builder:init( args )
+builder:set_build_mode( builder.BUILD_DIR_LINEARIZED )
+local output = 'lua.bench'
+local rotables = builder:get_option( 'rotables' )
+local gotos = builder:get_option( 'gotos' )
+-- Build the VM as the firmware does, with ROM tables (LTR) and the modules
+-- registered through the linker arrays in ld/host.ld.  rotables=false builds
+-- the core libraries alone in RAM tables, the configuration of luac.cross.
+-- The Lua Flash Store is plain memory, loaded with lua.bench -f
+local cdefs = '-DLUA_CROSS_COMPILER -DLUA_HOST_MODULES -DLUA_FLASH_STORE=0x40000 -Ddbg_printf=printf ' ..
+  ( rotables and '-DLUA_OPTIMIZE_MEMORY=2 -DMIN_OPT_LEVEL=2' or '-DLUA_OPTIMIZE_MEMORY=0' ) ..
+  ( gotos and ' -DLUA_USE_COMPUTED_GOTO' or '' )
+
+-- Lua source files and include path
+local lua_files = [[
+    lalloc.c lapi.c lauxlib.c lbaselib.c lcode.c ldblib.c ldebug.c ldo.c ldump.c
+    lflash.c lfunc.c lgc.c llex.c lmathlib.c lmem.c loadlib.c lobject.c lopcodes.c
+    lparser.c lrotable.c lstate.c lstring.c lstrlib.c ltable.c ltablib.c
+    ltm.c  lundump.c lvm.c lzio.c
+    luac_cross/lbench.c
+    ../modules/linit.c
+    ../libc/c_stdlib.c
+  ]]
+lua_files = lua_files:gsub( "\n" , "" )
+local lua_full_files = utils.prepend_path( lua_files, "app/lua" )
+
+-- Host-portable modules
+local module_files = [[
+    modules/array.c modules/bit.c modules/buffer.c modules/struct.c modules/cjson.c
+    cjson/strbuf.c cjson/cjson_mem.c
+  ]]
+module_files = module_files:gsub( "\n" , "" )
+local module_full_files = rotables and utils.prepend_path( module_files, "app" ) or ""
+local local_include = "-Iapp/include -Iinclude -Iapp/lua -Iapp/libc -Iapp/cjson"
+
+-- Compiler/linker options
+builder:set_compile_cmd( sf( "gcc -O2 -fno-pie %s -Wall %s -c $(FIRST) -o $(TARGET)", local_include, cdefs ) )
+builder:set_link_cmd( "gcc -no-pie -o $(TARGET) $(DEPENDS) -Wl,-T,ld/host.ld -lm" )
+
+-- Build everything
+builder:make_exe_target( output, lua_full_files .. " " .. module_full_files )
+builder:build()
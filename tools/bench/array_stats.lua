@@ -0,0 +1,16 @@
+-- Statistics over 1000 16 bit samples, kept in an array instead of a
+-- table, as a sensor logger would after adc.readbuf()
+local N = 1000
+local samples = array.new("i16", N)
+for i = 1, N do samples[i] = (i * 37) % 1024 - 512 end
+
+local acc = 0
+for r = 1, 200 do
+  local mean, var = samples:mean(), samples:variance()
+  local lo, at = samples:min()
+  local hi = samples:max()
+  acc = acc + mean + var + lo + hi + at
+end
+local smooth = samples:movavg(8)
+samples:scale(2, 1)
+acc = acc + smooth:sum() + samples:sum()
@@ -0,0 +1,17 @@
+-- The frames of struct_bit.lua, edited in place in a buffer instead of
+-- being packed into a new string each time
+local band, bor, lshift, rshift = bit.band, bit.bor, bit.lshift, bit.rshift
+
+local frame = buffer.new(9)
+local crc = 0
+for i = 1, 20000 do
+  frame:setint(1, "B", i % 256)
+  frame:setint(2, "<H", i % 65536)
+  frame:setint(4, "<I", i * 3)
+  frame:setint(8, "<h", -(i % 1000))
+  local a, b, c, d = struct.unpack("<BHIh", frame)
+  for j = 1, #frame do
+    crc = band(bor(lshift(crc, 1), rshift(crc, 15)), 0xffff)
+    crc = bit.bxor(crc, frame:get(j))
+  end
+end
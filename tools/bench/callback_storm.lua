@@ -0,0 +1,37 @@
+-- Callback storm: a large long-lived application state, and a stream of
+-- events whose callbacks allocate short-lived strings and tables
+local modules = {}
+for m = 1, 12 do
+  local mod = { name = "mod" .. m, handlers = {}, config = {} }
+  for i = 1, 20 do
+    mod.config["key" .. i] = { value = i, label = "label " .. m .. "." .. i }
+    mod.handlers[i] = function(msg) return msg.topic .. "/" .. i end
+  end
+  modules[m] = mod
+end
+
+local stats = { events = 0, bytes = 0, last = {} }
+local queue = {}
+
+local function on_message(topic, payload)
+  local msg = { topic = topic, payload = payload, parts = {} }
+  for part in payload:gmatch("[^,]+") do
+    msg.parts[#msg.parts + 1] = part
+  end
+  local mod = modules[#payload % #modules + 1]
+  local reply = mod.handlers[#msg.parts % 20 + 1](msg)
+  stats.events = stats.events + 1
+  stats.bytes = stats.bytes + #reply
+  if stats.events % 100 == 0 then
+    stats.last[mod.name] = reply  -- occasionally keep a new string
+  end
+  queue[#queue + 1] = function() return #msg.parts end
+end
+
+for tick = 1, 20000 do
+  on_message("sensor/" .. (tick % 16), ("%d,%d,%d,%s"):format(tick, tick * 3, tick % 7, "ok"))
+  if #queue >= 8 then  -- the timer fires: drain the posted tasks
+    for i = 1, #queue do queue[i]() end
+    queue = {}
+  end
+end
@@ -0,0 +1,32 @@
+-- Closures and callbacks: the event handler style used by most NodeMCU code
+local handlers = {}
+
+local function on(event, cb)
+  local list = handlers[event]
+  if not list then list = {} handlers[event] = list end
+  list[#list + 1] = cb
+end
+
+local function emit(event, ...)
+  local list = handlers[event]
+  for i = 1, #list do list[i](...) end
+end
+
+for round = 1, 50 do
+  handlers = {}
+  local total = 0
+  for i = 1, 20 do
+    local scale = i
+    on("data", function(v) total = total + v * scale end)
+    on("done", function() total = total - scale end)
+  end
+  for i = 1, 500 do
+    emit("data", i)
+  end
+  emit("done")
+  local counters = {}
+  for i = 1, 1000 do
+    local n = 0
+    counters[i % 50 + 1] = function() n = n + 1 return n end
+  end
+end
@@ -0,0 +1,10 @@
+-- VM dispatch: Lua calls, tail calls, returns and method calls
+local function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end
+local function count(n, acc) if n == 0 then return acc end return count(n - 1, acc + 1) end
+
+local obj = { v = 0 }
+function obj:add(d) self.v = self.v + d return self end
+
+fib(24)
+for i = 1, 2000 do count(100, 0) end
+for i = 1, 300000 do obj:add(i):add(-i) end
@@ -0,0 +1,9 @@
+-- VM dispatch: reading and writing fields of a table and of an upvalue
+local p = { x = 1, y = 2, z = 3 }
+local function step(i)
+  p.x, p.y, p.z = p.y, p.z, p.x + i
+end
+for i = 1, 300000 do
+  p.x, p.y = p.y, p.x + i
+  step(i)
+end
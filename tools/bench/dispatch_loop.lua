@@ -0,0 +1,10 @@
+-- VM dispatch: numeric for loops with arithmetic and branches on locals
+local s = 0
+for i = 1, 2000000 do
+  if i % 3 == 0 then s = s + i elseif i % 5 == 0 then s = s - i else s = s + 1 end
+end
+local n, a, b = 0, 1, 0
+while n < 1000000 do
+  a, b = b, (a + b) % 65536
+  n = n + 1
+end
@@ -0,0 +1,12 @@
+-- VM dispatch: array indexing, constructors and SETLIST
+local t = {}
+for i = 1, 1000 do t[i] = i end
+local s = 0
+for r = 1, 300 do
+  for i = 1, #t do s = s + t[i] end
+  for i = 1, #t, 2 do t[i], t[i + 1] = t[i + 1], t[i] end
+end
+for i = 1, 100000 do
+  local v = { i, i + 1, i + 2, x = i }
+  s = s + v[3] - v.x
+end
@@ -0,0 +1,14 @@
+-- GC stress: a long-lived graph mutated while garbage is produced
+local live = {}
+for i = 1, 2000 do
+  live[i] = { i, tostring(i), { i } }
+end
+
+for round = 1, 30 do
+  for i = 1, 2000 do
+    local node = live[(i * 7919) % 2000 + 1]
+    node[3] = { node[1], round, tostring(round) .. node[2] }
+    local tmp = { i, i + 1, i + 2, name = "t" .. i }
+  end
+  if round % 10 == 0 then collectgarbage() end
+end
@@ -0,0 +1,37 @@
+-- Building a 4KB HTTP response from table rows: with string.format,
+-- table.concat and gsub, and with a buffer.builder reused for each one
+local concat, format = table.concat, string.format
+
+local rows = {}
+for i = 1, 100 do
+  rows[i] = { name = "sensor" .. i, value = i * 1.5, unit = "C" }
+end
+
+local function with_concat(t)
+  local parts = {}
+  for i = 1, #rows do
+    local r = rows[i]
+    parts[i] = format("<tr><td>%s</td><td>%.1f %s</td></tr>\n", r.name, r.value + t, r.unit)
+  end
+  local page = format("<html><body><table>\n%s</table></body></html>\n", concat(parts))
+  page = page:gsub("<td>", "<td class=\"v\">")
+  return format("HTTP/1.0 200 OK\r\nContent-Length: %d\r\n\r\n", #page) .. page
+end
+
+local sb = buffer.builder(4096)
+local function with_builder(t)
+  sb:reset()
+  sb:append("<html><body><table>\n")
+  for i = 1, #rows do
+    local r = rows[i]
+    sb:append("<tr><td class=\"v\">", r.name, "</td><td class=\"v\">",
+              format("%.1f", r.value + t), " ", r.unit, "</td></tr>\n")
+  end
+  sb:append("</table></body></html>\n")
+  local page = sb:tostring()
+  return format("HTTP/1.0 200 OK\r\nContent-Length: %d\r\n\r\n", #page) .. page
+end
+
+for round = 1, 100 do
+  local a, b = with_concat(round), with_builder(round)
+end
@@ -0,0 +1,33 @@
+-- Integer arithmetic: a sieve, a ring buffer of readings, an Adler-32
+-- style checksum and a 16 bit LCG, all counters, indexes and whole values
+local N = 30000
+local sieve = {}
+for i = 2, N do sieve[i] = true end
+for i = 2, N do
+  if sieve[i] then
+    for j = i * i, N, i do sieve[j] = false end
+  end
+end
+local primes = 0
+for i = 2, N do if sieve[i] then primes = primes + 1 end end
+
+local ring, head, sum = {}, 1, 0
+for i = 1, 64 do ring[i] = 0 end
+for i = 1, 100000 do
+  local v = (i * 37) % 1024
+  sum = sum - ring[head] + v
+  ring[head] = v
+  head = head % 64 + 1
+end
+
+local a, b = 1, 0
+for i = 1, 100000 do
+  a = (a + i % 256) % 65521
+  b = (b + a) % 65521
+end
+
+local x = 12345
+for i = 1, 100000 do
+  x = (x * 25173 + 13849) % 65536
+  if x < 32768 then sum = sum + 1 elseif x >= 49152 then sum = sum - 1 end
+end
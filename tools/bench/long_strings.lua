@@ -0,0 +1,16 @@
+-- Long strings: payloads of 256 bytes to 8 KB built from parts, both new
+-- ones and ones equal to a string that is still live
+local concat, rep = table.concat, string.rep
+
+local block = rep("0123456789abcdef", 16)
+local keep = {}
+for round = 1, 40 do
+  for size = 1, 32 do
+    local parts = {}
+    for i = 1, size do parts[i] = block end
+    parts[size + 1] = round
+    keep[size] = concat(parts)        -- a new string
+    local again = concat(parts)       -- equal to the one just kept
+    assert(#again == #keep[size])
+  end
+end
@@ -0,0 +1,13 @@
+-- Module fields and constant compares: module.function calls through
+-- globals, and numeric tests against constants
+local n = 0
+for i = 1, 300000 do
+  n = n + bit.band(i, 7) + math.abs(-i) % 3
+  if string.len("x") == 1 then n = n + 1 end
+end
+Counter = { step = 3, limit = 1000 }
+for i = 1, 300000 do
+  local v = i % Counter.limit
+  if v < 10 then n = n + Counter.step elseif v >= 990 then n = n - 1 end
+  if v == 500 then n = n * 1 end
+end
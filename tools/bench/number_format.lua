@@ -0,0 +1,15 @@
+-- Number formatting and parsing as in telemetry: integer readings and
+-- millisecond timestamps turned into strings, and parsed back
+local format, tostring, tonumber = string.format, tostring, tonumber
+
+local n = 0
+for i = 1, 20000 do
+  local ts = 1700000000000 + i * 250
+  local line = "t=" .. ts .. ",v=" .. (i % 4096) .. ",rssi=" .. -(i % 90)
+  local s = format("%d;%d;%s", i, i * 7, tostring(i % 1000))
+  n = n + tonumber(tostring(i)) + #line + #s
+end
+local f = 0
+for i = 1, 2000 do
+  f = f + #tostring(i / 8) + #format("%.2f", i / 3)
+end
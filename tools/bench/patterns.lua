@@ -0,0 +1,26 @@
+-- Request line and header parsing with the same few patterns on every
+-- line, as an HTTP server or a serial protocol handler does
+local match, gmatch, gsub, find = string.match, string.gmatch, string.gsub, string.find
+
+local lines = {
+  "GET /index.html?x=1&y=22 HTTP/1.1",
+  "Host: 192.168.4.1",
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64)",
+  "Accept: text/html,application/xhtml+xml",
+  "Content-Length: 1234",
+  "POST /api/v1/sensor HTTP/1.1",
+}
+
+local n = 0
+for round = 1, 2000 do
+  for i = 1, #lines do
+    local l = lines[i]
+    local method, path = match(l, "^(%u+) (%S+)")
+    local k, v = match(l, "^([%w%-]+):%s*(.-)%s*$")
+    if path then
+      for key, val in gmatch(path, "([%w_]+)=([^&]*)") do n = n + #val end
+    end
+    if find(l, "%d+%.%d+") then n = n + 1 end
+    n = n + select(2, gsub(l, "%s+", " "))
+  end
+end
@@ -0,0 +1,178 @@
+/*
+ * Micro-benchmark of rotable lookups and iteration by map size.
+ *
+ * Builds maps of 8 to 128 string keys.  For each it times lookups of 4 hot
+ * keys near the end of the map, and a pairs() style walk of the whole map,
+ * once with the code rotables used before keys were tagged (copy the key
+ * to a C string, then a strcmp() per entry) and once with the current
+ * luaR_findstrentry() and luaR_next().  It then times luaR_findglobal()
+ * against the old strlen() and strncmp() walk of lua_rotable[], for the
+ * modules linked in.  Build it against the firmware's Lua VM as lua.bench
+ * is, with the same defines:
+ *
+ *   gcc -O2 -fno-pie -DLUA_CROSS_COMPILER -DLUA_HOST_MODULES \
+ *     -DLUA_OPTIMIZE_MEMORY=2 -DMIN_OPT_LEVEL=2 -Ddbg_printf=printf \
+ *     -Iapp/include -Iapp/lua -Iapp/libc -Iapp/cjson -o rotable.bench \
+ *     tools/bench/rotable_lookup.c app/modules/linit.c app/libc/c_stdlib.c \
+ *     $(for f in lalloc lapi lauxlib lbaselib lcode ldblib ldebug ldo ldump \
+ *       lfunc lgc llex lmathlib lmem loadlib lobject lopcodes lparser \
+ *       lrotable lstate lstring lstrlib ltable ltablib ltm lundump lvm lzio; \
+ *       do echo app/lua/$f.c; done) \
+ *     -no-pie -Wl,-T,ld/host.ld -lm
+ */
+#define LUAC_CROSS_FILE
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lrotable.h"
+#include "lstring.h"
+#include C_HEADER_STRING
+#include <stdio.h>
+#include <time.h>
+
+#define MAXKEYS  128
+#define LOOKUPS  2000000
+
+extern const luaR_table lua_rotable[];
+
+static char names[MAXKEYS][8];
+static luaR_entry entries[MAXKEYS + 1];
+
+/* luaR_auxfind() as it was: a strcmp() per entry up to the key */
+static const TValue *old_find(const luaR_entry *pentry, const char *strkey, unsigned *ppos) {
+  unsigned i = 0;
+  for (; luaR_keytype(&pentry->key) != LUA_TNIL; pentry++, i++)
+    if (luaR_keytype(&pentry->key) == LUA_TSTRING && !c_strcmp(pentry->key.id.strkey, strkey)) {
+      if (ppos)
+        *ppos = i;
+      return &pentry->value;
+    }
+  return NULL;
+}
+
+/* luaH_getstr_ro() as it was: copy the key to a C string, then find it */
+static const TValue *old_getstr(const luaR_entry *pentries, const TString *key) {
+  char keyname[LUA_MAX_ROTABLE_NAME + 1];
+  luaR_getcstr(keyname, key, LUA_MAX_ROTABLE_NAME);
+  return old_find(pentries, keyname, NULL);
+}
+
+/* luaR_next() as it was: copy the previous key and find it again */
+static void old_next(lua_State *L, const luaR_entry *pentries, TValue *key, TValue *val) {
+  char keyname[LUA_MAX_ROTABLE_NAME + 1];
+  unsigned pos = 0;
+  if (!ttisnil(key)) {
+    luaR_getcstr(keyname, rawtsvalue(key), LUA_MAX_ROTABLE_NAME);
+    old_find(pentries, keyname, &pos);
+    pos++;
+  }
+  setnilvalue(key);
+  setnilvalue(val);
+  if (luaR_keytype(&pentries[pos].key) != LUA_TNIL) {
+    setsvalue(L, key, luaS_newro(L, pentries[pos].key.id.strkey));
+    setobj(L, val, &pentries[pos].value);
+  }
+}
+
+/* luaR_findglobal() as it was: a strlen() and strncmp() per module */
+static void *old_findglobal(const char *name, unsigned len) {
+  unsigned i;
+  if (c_strlen(name) > LUA_MAX_ROTABLE_NAME)
+    return NULL;
+  for (i = 0; lua_rotable[i].name; i++)
+    if (*lua_rotable[i].name != '\0' && c_strlen(lua_rotable[i].name) == len &&
+        !c_strncmp(lua_rotable[i].name, name, len))
+      return (void *)lua_rotable[i].pentries;
+  return NULL;
+}
+
+/* Fill the map with n entries; the entries are const, so poke them in */
+static void fill(int n) {
+  int i;
+  for (i = 0; i <= n; i++) {
+    luaR_key key;
+    TValue val;
+    key.tag = i < n ? luaR_strtag(names[i], c_strlen(names[i])) : LUA_TNIL;
+    key.id.strkey = i < n ? names[i] : NULL;
+    setnvalue(&val, i);
+    c_memcpy((void *)&entries[i].key, &key, sizeof(key));
+    c_memcpy((void *)&entries[i].value, &val, sizeof(val));
+  }
+}
+
+static double ns_per(clock_t start, long n) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / n;
+}
+
+int main(void) {
+  lua_State *L = luaL_newstate();
+  TString *keys[MAXKEYS];
+  TValue kv[2];
+  int i, n, nglobals;
+  volatile lua_Number sum = 0;
+  double t[4];
+  clock_t start;
+  long r, steps;
+
+  for (i = 0; i < MAXKEYS; i++)
+    sprintf(names[i], "key%03d", i);
+  printf("           lookup (ns)     next (ns per step)\n");
+  printf("entries    before  after    before  after\n");
+  for (n = 8; n <= MAXKEYS; n *= 2) {
+    fill(n);
+    for (i = 0; i < n; i++) {
+      keys[i] = luaS_new(L, names[i]);
+      luaS_fix(keys[i]);
+      if (luaR_findstrentry(entries, keys[i], NULL) != old_getstr(entries, keys[i])) {
+        printf("lookup of %s differs\n", names[i]);
+        return 1;
+      }
+    }
+    start = clock();
+    for (r = 0; r < LOOKUPS; r++)
+      sum += nvalue(old_getstr(entries, keys[n - 5 + (r * 7) % 4]));
+    t[0] = ns_per(start, LOOKUPS);
+    start = clock();
+    for (r = 0; r < LOOKUPS; r++)
+      sum += nvalue(luaR_findstrentry(entries, keys[n - 5 + (r * 7) % 4], NULL));
+    t[1] = ns_per(start, LOOKUPS);
+    steps = 0;
+    start = clock();
+    for (r = 0; r < LOOKUPS / n; r++) {
+      setnilvalue(&kv[0]);
+      do { old_next(L, entries, &kv[0], &kv[1]); steps++; } while (!ttisnil(&kv[0]));
+    }
+    t[2] = ns_per(start, steps);
+    steps = 0;
+    start = clock();
+    for (r = 0; r < LOOKUPS / n; r++) {
+      setnilvalue(&kv[0]);
+      do { luaR_next(L, entries, &kv[0], &kv[1]); steps++; } while (!ttisnil(&kv[0]));
+    }
+    t[3] = ns_per(start, steps);
+    printf("%7d %9.1f %6.1f %9.1f %6.1f\n", n, t[0], t[1], t[2], t[3]);
+  }
+
+  for (nglobals = 0; lua_rotable[nglobals].name; nglobals++)
+    if (luaR_findglobal(lua_rotable[nglobals].name, c_strlen(lua_rotable[nglobals].name)) !=
+        lua_rotable[nglobals].pentries) {
+      printf("module %s not found\n", lua_rotable[nglobals].name);
+      return 1;
+    }
+  start = clock();
+  for (r = 0; r < LOOKUPS; r++) {
+    const char *name = lua_rotable[r % nglobals].name;
+    sum += old_findglobal(name, c_strlen(name)) != NULL;
+  }
+  t[0] = ns_per(start, LOOKUPS);
+  start = clock();
+  for (r = 0; r < LOOKUPS; r++) {
+    const char *name = lua_rotable[r % nglobals].name;
+    sum += luaR_findglobal(name, c_strlen(name)) != NULL;
+  }
+  t[1] = ns_per(start, LOOKUPS);
+  printf("\nmodules    before  after  (ns per luaR_findglobal)\n%7d %9.1f %6.1f\n",
+         nglobals, t[0], t[1]);
+  lua_close(L);
+  return 0;
+}
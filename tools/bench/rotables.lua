@@ -0,0 +1,10 @@
+-- ROM table lookups: library functions and constants resolved by name
+local sum = 0
+for i = 1, 200000 do
+  sum = sum + math.floor(i / 3) + string.len("abc") + bit.band(i, 0xff)
+  local f = table.insert
+  local k = math.pi
+end
+for round = 1, 500 do
+  for k, v in pairs(string) do sum = sum + 1 end
+end
@@ -0,0 +1,17 @@
+-- String building: concatenation, table.concat, string.format and gsub
+local concat, format, rep = table.concat, string.format, string.rep
+
+for round = 1, 100 do
+  local s = ""
+  for i = 1, 100 do
+    s = s .. i .. ","
+  end
+  local parts = {}
+  for i = 1, 200 do
+    parts[#parts + 1] = format("%s=%d;", "key" .. i, i * 3)
+  end
+  local line = concat(parts)
+  local n = 0
+  line:gsub("(%w+)=(%d+)", function(k, v) n = n + v end)
+  local upper = line:upper():sub(1, 64) .. rep("-", 16)
+end
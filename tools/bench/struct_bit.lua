@@ -0,0 +1,13 @@
+-- Binary packing with struct and bit, as used by sensor and protocol code
+local pack, unpack = struct.pack, struct.unpack
+local band, bor, lshift, rshift = bit.band, bit.bor, bit.lshift, bit.rshift
+
+local crc = 0
+for i = 1, 20000 do
+  local frame = pack("<BHIh", i % 256, i % 65536, i * 3, -(i % 1000))
+  local a, b, c, d = unpack("<BHIh", frame)
+  for j = 1, #frame do
+    crc = band(bor(lshift(crc, 1), rshift(crc, 15)), 0xffff)
+    crc = bit.bxor(crc, frame:byte(j))
+  end
+end
@@ -0,0 +1,20 @@
+-- Table churn: short-lived array and hash tables, growth and removal
+local insert, remove = table.insert, table.remove
+
+for round = 1, 200 do
+  local list = {}
+  for i = 1, 500 do
+    insert(list, { id = i, name = "item" .. i % 10, value = i * 0.5 })
+  end
+  local index = {}
+  for i = 1, #list do
+    local e = list[i]
+    index[e.name] = (index[e.name] or 0) + e.value
+  end
+  while #list > 250 do
+    remove(list)
+  end
+  for i = 1, 100 do
+    remove(list, 1)
+  end
+end
@@ -0,0 +1,21 @@
+-- The list and index work of table_churn.lua, with preallocated tables
+-- that are cleared and refilled instead of being created every round
+local create, clear, move = table.create, table.clear, table.move
+
+local list = create(500, 0)
+local index = create(0, 10)
+local items = {}
+for i = 1, 500 do
+  items[i] = { id = i, name = "item" .. i % 10, value = i * 0.5 }
+end
+for round = 1, 200 do
+  clear(list)
+  clear(index)
+  move(items, 1, 500, 1, list)
+  for i = 1, #list do
+    local e = list[i]
+    index[e.name] = (index[e.name] or 0) + e.value
+  end
+  move(list, 101, 250, 1)
+  for i = 151, 500 do list[i] = nil end
+end
@@ -0,0 +1,12 @@
+-- VM dispatch: arithmetic, comparisons, field access and calls
+local function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end
+
+local s = 0
+for i = 1, 1000000 do
+  if i % 3 == 0 then s = s + i elseif i % 5 == 0 then s = s - i else s = s + 1 end
+end
+local p = { x = 1, y = 2 }
+for i = 1, 300000 do
+  p.x, p.y = p.y, p.x + i
+end
+fib(22)
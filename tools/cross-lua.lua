@@ -20,11 +20,11 @@ local cdefs = '-DLUA_CROSS_COMPILER -Ddbg_printf=printf'
 
 -- Lua source files and include path
 local lua_files = [[
-    lapi.c lauxlib.c lbaselib.c lcode.c ldblib.c ldebug.c ldo.c ldump.c 
-    lfunc.c lgc.c llex.c lmathlib.c lmem.c loadlib.c lobject.c lopcodes.c  
+    lalloc.c lapi.c lauxlib.c lbaselib.c lcode.c ldblib.c ldebug.c ldo.c ldump.c 
+    lflash.c lfunc.c lgc.c llex.c lmathlib.c lmem.c loadlib.c lobject.c lopcodes.c  
     lparser.c lrotable.c lstate.c lstring.c lstrlib.c ltable.c ltablib.c 
     ltm.c  lundump.c lvm.c lzio.c 
-    luac_cross/luac.c luac_cross/loslib.c luac_cross/print.c
+    luac_cross/luac.c luac_cross/lflashimg.c luac_cross/loslib.c luac_cross/print.c
     ../modules/linit.c
     ../libc/c_stdlib.c
   ]]
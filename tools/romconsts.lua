@@ -0,0 +1,237 @@
+-- Generate the manifest of ROM module constants used by "luac.cross -c".
+--
+-- Usage: lua tools/romconsts.lua [output]      (from the repository root)
+--
+-- Scans the modules enabled in app/include/user_modules.h for their
+-- NODEMCU_MODULE() maps and writes one "module.KEY value" line for each
+-- LNUMVAL entry, and a "module" line for each ROM module, which
+-- "luac.cross -O" hoists out of loops.  Values are usually macros, so they
+-- are resolved through the #defines of the module source and the headers
+-- it includes.  Entries whose value can't be resolved (enums, function-like
+-- macros, casts) are left out, and luac.cross then compiles them as
+-- ordinary table lookups.
+
+local args = { ... }
+local sf = string.format
+
+if not (_VERSION == "Lua 5.1" and pcall(require,"lfs")) then
+  print  [[
+
+romconsts.lua must be run within Lua 5.1 and it requires the Lua Filesystem to be installed.
+See tools/cross-lua.lua for details.
+]]
+  os.exit(1)
+end
+local lfs = require "lfs"
+
+local output = args[ 1 ] or "romconsts.txt"
+
+local function readfile( path )
+  local f = io.open( path, "r" )
+  if not f then return nil end
+  local s = f:read( "*a" )
+  f:close()
+  return s
+end
+
+-- Strip comments, and join continued lines
+local function clean( s )
+  return ( s:gsub( "/%*.-%*/", " " ):gsub( "//[^\n]*", "" ):gsub( "\\\n", " " ) )
+end
+
+-- The include path of app/modules/Makefile, then the SDK's once it has
+-- been extracted by a firmware build
+local incdirs = {
+  "app/include", "app/modules", "app/libc", "app/coap", "app/mqtt", "app/u8glib",
+  "app/ucglib", "app/lua", "app/pcm", "app/platform", "app/spiffs", "app/smart",
+  "app/cjson", "app/dhtlib", "app/fatfs", "app/http", "app/websocket",
+  "sdk-overrides/include",
+}
+if lfs.attributes( "sdk", "mode" ) == "directory" then
+  for name in lfs.dir( "sdk" ) do
+    if name:match( "^esp_iot_sdk_v" ) then table.insert( incdirs, "sdk/" .. name .. "/include" ) end
+  end
+end
+
+local function findheader( name, from )
+  local dirs = { from:match( "^(.*)/" ) }
+  for _, d in ipairs( incdirs ) do table.insert( dirs, d ) end
+  for _, d in ipairs( dirs ) do
+    local path = d .. "/" .. name
+    if lfs.attributes( path, "mode" ) == "file" then return path end
+  end
+end
+
+-- Collect the object-like #defines and the enumerators of a file and of
+-- the headers it includes.  An enumerator is recorded as the expression
+-- "(previous) + 1", or its initializer, and evaluated when it is used.
+local function getdefines( path, defines, seen )
+  if seen[ path ] then return end
+  seen[ path ] = true
+  local s = readfile( path )
+  if not s then return end
+  s = clean( s )
+  for line in s:gmatch( "[^\n]+" ) do
+    local inc = line:match( '^%s*#%s*include%s*"([^"]+)"' )
+    if inc then
+      local h = findheader( inc, path )
+      if h then getdefines( h, defines, seen ) end
+    else
+      local name, body = line:match( "^%s*#%s*define%s+([%a_][%w_]*)%s+(.-)%s*$" )
+      if name and not defines[ name ] then defines[ name ] = body end
+    end
+  end
+  for body in s:gmatch( "enum%s*[%w_]*%s*(%b{})" ) do
+    local prev = "-1"
+    for item in body:sub( 2, -2 ):gmatch( "[^,]+" ) do
+      local name, init = item:match( "^%s*([%a_][%w_]*)%s*=?%s*(.-)%s*$" )
+      if name then
+        init = init ~= "" and init or "(" .. prev .. ") + 1"
+        if not defines[ name ] then defines[ name ] = init end
+        prev = name
+      end
+    end
+  end
+end
+
+-- Bitwise operations on non-negative integers, which Lua 5.1 lacks
+local function bitop( a, b, f )
+  local r, p = 0, 1
+  while a > 0 or b > 0 do
+    if f( a % 2, b % 2 ) then r = r + p end
+    a, b, p = math.floor( a / 2 ), math.floor( b / 2 ), p * 2
+  end
+  return r
+end
+
+local binary = {
+  [ "|" ] = { 1, function( a, b ) return bitop( a, b, function( x, y ) return x == 1 or y == 1 end ) end },
+  [ "^" ] = { 2, function( a, b ) return bitop( a, b, function( x, y ) return x ~= y end ) end },
+  [ "&" ] = { 3, function( a, b ) return bitop( a, b, function( x, y ) return x == 1 and y == 1 end ) end },
+  [ "<<" ] = { 4, function( a, b ) return a * 2 ^ b end },
+  [ ">>" ] = { 4, function( a, b ) return math.floor( a / 2 ^ b ) end },
+  [ "+" ] = { 5, function( a, b ) return a + b end },
+  [ "-" ] = { 5, function( a, b ) return a - b end },
+  [ "*" ] = { 6, function( a, b ) return a * b end },
+  [ "/" ] = { 6, function( a, b ) return a / b end },
+  [ "%" ] = { 6, function( a, b ) return math.fmod( a, b ) end },
+}
+
+-- Evaluate a constant C expression, or return nil if it isn't one
+local evaluate
+
+local function tokenize( s, defines, depth )
+  local toks, pos = {}, 1
+  while pos <= #s do
+    local sp, ep = s:find( "^%s+", pos )
+    if sp then
+      pos = ep + 1
+    else
+      local num = s:match( "^0[xX]%x+", pos ) or s:match( "^%d+%.?%d*[eE][-+]?%d+", pos ) or
+                  s:match( "^%d+%.?%d*", pos ) or s:match( "^%.%d+", pos )
+      local id = not num and s:match( "^[%a_][%w_]*", pos )
+      local op = not num and not id and ( s:match( "^<<", pos ) or s:match( "^>>", pos ) or s:match( "^[-+*/%%|&^()~]", pos ) )
+      if num then
+        pos = pos + #num
+        pos = pos + #( s:match( "^[uUlLfF]*", pos ) )
+        table.insert( toks, tonumber( num ) )
+      elseif id then
+        local v = defines[ id ] and evaluate( defines[ id ], defines, depth + 1 )
+        if not v then return nil end
+        pos = pos + #id
+        table.insert( toks, v )
+      elseif op then
+        pos = pos + #op
+        table.insert( toks, op )
+      else
+        return nil
+      end
+    end
+  end
+  return toks
+end
+
+evaluate = function( s, defines, depth )
+  if depth > 16 then return nil end
+  local toks = tokenize( s, defines, depth or 0 )
+  if not toks or #toks == 0 then return nil end
+  local i = 1
+  local expr
+  local function primary()
+    local t = toks[ i ]
+    i = i + 1
+    if type( t ) == "number" then return t end
+    if t == "(" then
+      local v = expr( 1 )
+      if not v or toks[ i ] ~= ")" then return nil end
+      i = i + 1
+      return v
+    end
+    if t == "-" then local v = primary() return v and -v end
+    if t == "+" then return primary() end
+    return nil
+  end
+  expr = function( minprec )
+    local lhs = primary()
+    while lhs do
+      local op = binary[ toks[ i ] ]
+      if not op or op[ 1 ] < minprec then break end
+      i = i + 1
+      local rhs = expr( op[ 1 ] + 1 )
+      if not rhs then return nil end
+      lhs = op[ 2 ]( lhs, rhs )
+    end
+    return lhs
+  end
+  local v = expr( 1 )
+  if i <= #toks then return nil end
+  return v
+end
+
+-- Modules enabled in the firmware configuration
+local enabled = {}
+local config = clean( assert( readfile( "app/include/user_modules.h" ), "run this from the repository root" ) )
+for name in config:gmatch( "#%s*define%s+LUA_USE_MODULES_([%w_]+)" ) do
+  enabled[ name ] = true
+end
+
+local lines, skipped = {}, 0
+-- The built in libraries that are ROM tables, see app/modules/linit.c
+local builtin = { STRING = "string", TABLE = "table", DEBUG = "debug", DEBUG_MINIMAL = "debug",
+                  OS = "os", COROUTINE = "coroutine", MATH = "math" }
+local seen = {}
+for name in config:gmatch( "#%s*define%s+LUA_USE_BUILTIN_([%w_]+)" ) do
+  local luaname = builtin[ name ]
+  if luaname and not seen[ luaname ] then
+    seen[ luaname ] = true
+    table.insert( lines, luaname )
+  end
+end
+for file in lfs.dir( "app/modules" ) do
+  if file:match( "%.c$" ) then
+    local path = "app/modules/" .. file
+    local src = clean( readfile( path ) )
+    local cfg, luaname, map = src:match( 'NODEMCU_MODULE%s*%(%s*([%w_]+)%s*,%s*"([%w_]+)"%s*,%s*([%w_]+)' )
+    if cfg and enabled[ cfg ] then
+      table.insert( lines, luaname )
+      local body = src:match( "LUA_REG_TYPE%s+" .. map .. "%s*%[%s*%]%s*=%s*(%b{})" )
+      local defines = {}
+      getdefines( path, defines, {} )
+      for key, expr in ( body or "" ):gmatch( 'LSTRKEY%s*%(%s*"([%w_]+)"%s*%)%s*,%s*LNUMVAL%s*(%b())' ) do
+        local v = evaluate( expr:sub( 2, -2 ), defines, 0 )
+        if v then
+          table.insert( lines, sf( "%s.%s %.17g", luaname, key, v ) )
+        else
+          skipped = skipped + 1
+        end
+      end
+    end
+  end
+end
+table.sort( lines )
+
+local f = assert( io.open( output, "w" ) )
+f:write( "# ROM module constants for luac.cross -c, generated by tools/romconsts.lua\n" )
+f:write( table.concat( lines, "\n" ), "\n" )
+f:close()
+print( sf( "%s: %d modules and constants, %d constants left out", output, #lines, skipped ) )
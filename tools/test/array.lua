@@ -0,0 +1,20 @@
+-- array: sizes that would overflow the allocation are rejected, and the
+-- statistics agree with the same loops over a table
+
+local ok, err = pcall(array.new, "i32", 0x7fffffff)
+assert(not ok)  -- "too big" where size_t is 32 bits
+assert(#array.new("i32", 0) == 0)
+
+local t = {}
+for i = 1, 1000 do t[i] = (i * 37) % 1024 - 512 + 100000 end
+local a = array.new("i32", t)
+local sum = 0
+for i = 1, #t do sum = sum + t[i] end
+local mean = sum / #t
+local m2 = 0
+for i = 1, #t do m2 = m2 + (t[i] - mean) ^ 2 end
+assert(a:sum() == sum)
+assert(math.abs(a:mean() - mean) < 1e-9)
+assert(math.abs(a:variance() - m2 / #t) < 1e-6 * m2 / #t)
+assert(a:mean(3, 3) == t[3] and a:variance(3, 3) == 0)
+assert(a:mean(5, 4) == nil)
@@ -0,0 +1,104 @@
+-- Loops that use ROM modules, for the optimizer of "lua.bench -O" and
+-- "luac.cross -O", which loads a module once before such a loop into a
+-- new register and moves the loop's own registers up by one.  Run with
+-- and without -O: the results must not change.
+
+-- numeric for, nested, with the loop variable captured
+local fns, n = {}, 0
+for i = 1, 4 do
+  for j = i, 4 do
+    n = n + bit.band(i, j) + string.len(("x"):rep(j))
+  end
+  fns[i] = function() return i + bit.lshift(i, 1) end
+end
+assert(n == 43)
+for i = 1, 4 do assert(fns[i]() == 3 * i) end
+
+-- while, with a break, a body local captured by a closure, and a call
+-- with open results
+local got, i = {}, 0
+while true do
+  i = i + 1
+  local v = string.byte("hello", i)
+  if not v then break end
+  got[#got + 1] = function() return string.char(v) end
+  local a, b = string.byte("hello", i, i + 1)
+  assert(a == v and (b == nil) == (i == 5))
+end
+local s = ""
+for k = 1, #got do s = s .. got[k]() end
+assert(s == "hello")
+
+-- repeat, whose condition sees a local of the body, around a numeric for
+local r, t = 0, {}
+repeat
+  for k = 1, 3 do r = r + bit.bor(k, 4) end
+  local done = bit.band(r, 7) == 6
+  t[#t + 1] = string.format("%d", r)
+until done
+assert(table.concat(t, ",") == "18,36,54" and r == 54)
+
+-- a generic for inside a while loop, and concatenation and varargs
+local function joined(...)
+  local out, m = {}, 0
+  while m < 2 do
+    m = m + 1
+    for _, w in ipairs({ ... }) do
+      out[#out + 1] = string.upper(w) .. m .. select("#", ...)
+    end
+  end
+  return table.concat(out, " ")
+end
+assert(joined("a", "b") == "A12 B12 A22 B22")
+
+-- a table constructor with open results, and method calls
+local lists = {}
+for k = 1, 2 do
+  lists[k] = { string.byte("abc", 1, -1) }
+  lists[k].s = ("%d-%s"):format(k, math.floor(k / 2))
+end
+assert(#lists[2] == 3 and lists[2][3] == 99 and lists[2].s == "2-1")
+
+-- an outer local set to nil next to a new local of the loop: one LOADNIL
+-- sets both, so the registers of this loop can't move
+local c, x = 0, 1
+while c < 3 do
+  x = nil
+  local y
+  c = c + 1
+  y = bit.bxor(c, 1)
+  x = y
+end
+assert(x == 2)
+
+-- a jump from before the loop to its head, which must load the module
+local function climb(w)
+  if w > 5 then w = 10 end
+  while w < 12 do w = w + bit.band(w, 1) + 1 end
+  return w
+end
+assert(climb(0) == 13 and climb(6) == 13)
+
+-- a loop that assigns the module keeps loading it
+local saved, seen = bit, {}
+for k = 1, 3 do
+  seen[k] = bit.band(k, 3)
+  if k == 2 then bit = { band = function() return -1 end } end
+end
+bit = saved
+assert(seen[1] == 1 and seen[2] == 2 and seen[3] == -1)
+
+-- errors keep their line numbers
+local function here()
+  local _, e = pcall(error, "", 3)
+  return e
+end
+local where
+local ok, e = pcall(function()
+  local m = 0
+  while true do
+    m = m + bit.band(m, 1) + 1
+    if m > 3 then where = here() local u = nil return u.x end
+  end
+end)
+assert(not ok and where ~= "" and e:sub(1, #where) == where, e)
@@ -0,0 +1,37 @@
+-- luaL_Buffer: a buffer that outgrows LUAL_BUFFERSIZE moves into a boxed
+-- heap block.  Collect while such a box is live on the stack, and after an
+-- error has unwound past one, in both the ROM table and RAM table builds.
+
+local rep, concat = string.rep, table.concat
+
+-- gsub keeps its result in a luaL_Buffer across calls to the replacement
+local subject = rep("abcdefgh", 200)
+local calls = 0
+local out = subject:gsub("(%w)", function(c)
+  calls = calls + 1
+  if calls % 300 == 0 then collectgarbage() end
+  return c:upper()
+end)
+assert(calls == #subject)
+assert(out == subject:upper())
+
+-- table.concat builds its result in a box that grows several times
+local parts = {}
+for i = 1, 2000 do parts[i] = tostring(i) end
+local joined = concat(parts, ",")
+collectgarbage()
+assert(#joined == #concat(parts) + 1999)
+assert(joined:sub(1, 8) == "1,2,3,4,")
+
+-- an error raised while a box is live leaves it to the collector
+for round = 1, 20 do
+  local n = 0
+  local ok = pcall(subject.gsub, subject, "%w", function(c)
+    n = n + 1
+    if n == 1000 and round > 10 then error("stop") end
+    return c .. c
+  end)
+  assert(ok == (round <= 10))
+  collectgarbage()
+end
+collectgarbage()
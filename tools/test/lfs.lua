@@ -0,0 +1,51 @@
+-- Lua Flash Store: modules run from an image whose Protos and strings are
+-- used in place.  Needs the image of tools/test/lfs built with luac.cross -F
+-- and loaded with lua.bench -f (see docs/en/upload.md); skipped otherwise.
+
+local ok, a = pcall(require, "lfs_a")
+if not ok then
+  print("lfs.lua: no LFS image loaded, skipped")
+  return
+end
+local b = require "lfs_b"
+
+-- strings made at run time are the strings in flash, so they find the
+-- fields that the module set with its constants
+local key = ("greet" .. "ing")
+assert(a[key] == "hello from flash")
+assert(a.keys[("al" .. "pha")] == 1 and a.keys.beta == 2 and a.keys[3] == "three")
+local t = { [key] = true }
+assert(t.greeting)
+
+assert(a.half == 0.5 and a.big == 2^40 and a.neg == -7)
+assert(a.add(2, 3) == 5 and b.twice(21) == 42 and b.name == "lfs_b")
+assert(a.join("x", "y", 1) == "x,y,1")
+assert(a.proxy.foo == "foo!")
+
+-- closures and upvalues live in RAM and are collected as usual, by both
+-- kinds of collector, which never write to the objects in flash
+for _, mode in ipairs{"incremental", "generational", "incremental"} do
+  collectgarbage(mode)
+  local fns = {}
+  for i = 1, 200 do fns[i] = a.scale(i) end
+  for _ = 1, 3 do collectgarbage() end
+  for i = 1, 200 do assert(fns[i](2) == 2 * i) end
+  for i = 1, 200 do fns[i] = { a.join(i, "x") } end
+  collectgarbage("step")
+  fns = nil
+  collectgarbage()
+end
+assert(a.counter() == 1 and a.counter() == 2)
+
+-- error positions come from the source and line info in the image
+local ok2, err = pcall(a.fail)
+assert(not ok2 and err:find("lfs_a.lua:%d+: failed in flash"), err)
+
+-- a function in flash can be dumped and loaded back into RAM
+local add = loadstring(string.dump(a.add))
+assert(add(4, 5) == 9)
+
+-- strings that are not in flash are created and collected in RAM
+for i = 1, 1000 do local s = "lfs" .. i end
+collectgarbage()
+assert(("lfs" .. "_a") == "lfs_a")
@@ -0,0 +1,21 @@
+-- Module for tools/test/lfs.lua, loaded from a Lua Flash Store image
+local M = {}
+local count = 0
+
+M.greeting = "hello from flash"
+M.keys = { alpha = 1, beta = 2, [3] = "three" }
+M.half, M.big, M.neg = 0.5, 2^40, -7
+-- "__index" is fixed at startup, which must leave the string in flash alone
+M.proxy = setmetatable({}, { __index = function(_, k) return k .. "!" end })
+
+function M.add(a, b) return a + b end
+
+function M.counter() count = count + 1 return count end
+
+function M.scale(n) return function(x) return x * n end end
+
+function M.join(...) return table.concat({...}, ",") end
+
+function M.fail() error("failed in flash") end
+
+return M
@@ -0,0 +1,7 @@
+-- Module for tools/test/lfs.lua: uses another module in the same image
+local a = require "lfs_a"
+
+return {
+  twice = function(x) return a.add(x, x) end,
+  name = "lfs_b",
+}
@@ -0,0 +1,133 @@
+-- Compiled patterns: a pattern is matched by match() the first time it is
+-- seen and by its compiled program afterwards, so every call after the
+-- first must give the same results and raise the same errors.
+
+local find, match, gmatch, gsub = string.find, string.match, string.gmatch, string.gsub
+
+-- push every pattern out of the cache of PCACHE_SIZE (8) patterns
+local function flush()
+  for i = 1, 10 do find("", "^flush" .. i) end
+end
+
+local function pack(ok, ...)
+  return { ok = ok, n = select("#", ...), ... }
+end
+
+local function same(a, b)
+  if a.ok ~= b.ok or a.n ~= b.n then return false end
+  for i = 1, a.n do
+    if a[i] ~= b[i] then return false end
+  end
+  return true
+end
+
+local function allmatches(s, p)
+  local t = {}
+  for a, b, c in gmatch(s, p) do t[#t + 1] = tostring(a) .. "," .. tostring(b) .. "," .. tostring(c) end
+  return table.concat(t, ";")
+end
+
+local ops = {
+  function(s, p) return find(s, p) end,
+  function(s, p) return find(s, p, 3) end,
+  function(s, p) return find(s, p, -4) end,
+  function(s, p) return match(s, p) end,
+  function(s, p) return allmatches(s, p) end,
+  function(s, p) return gsub(s, p, "<%0>") end,
+  function(s, p) return gsub(s, p, "%1", 2) end,
+  function(s, p) return gsub(s, p, { a = "A", ["("] = false }) end,
+  function(s, p) return gsub(s, p, function(c) return c and c .. "!" end) end,
+}
+
+-- run each operation three times on a pattern that is new to the cache:
+-- interpreted, compiled, then from the cache
+local function check(s, p)
+  for i, op in ipairs(ops) do
+    flush()
+    local first = pack(pcall(op, s, p))
+    for n = 2, 3 do
+      local r = pack(pcall(op, s, p))
+      if not same(first, r) then
+        error(("%q on %q: call %d of op %d differs: %s / %s"):format(
+          p, s, n, i, tostring(first[1]), tostring(r[1])), 0)
+      end
+    end
+  end
+end
+
+local subject = "  hello (world) [x] a$b $ 123-456 aaa abab foo.bar\0baz  "
+local cases = {
+  -- anchors, and $ anywhere but at the end
+  "^", "$", "^$", "^  h", "baz  $", "^hello", "a$b", "$ 1", "x$", "^%s*(.-)%s*$",
+  -- classes, sets and repetitions
+  "%a+", "%d%d%d", "[%a_][%w_]*", "[^%s]+", "[%]]", "[a-c]+", "[]x]", "[^]]",
+  "%x*", ".-b", "a?b", "%p", "%z", "[%z]", "%.", "o+", "l*", "l-o",
+  -- captures, position captures and back references
+  "(%a+)", "()o()", "(h)(e)(l)", "((a)b)", "(a)%1", "(b)(a)%2%1", "(%a)%1",
+  "()", "(()a)", "%s(%w+)%s", "(a*(.)%w(%s*))",
+  -- balances and frontiers
+  "%b()", "%b[]", "%bab", "%b$$", "%f[%a]%a+", "%f[%A]", "%f[%z]", "%f[^%z]",
+  "%f[%w]%w+%f[%W]", "%f[%d]%d+",
+}
+for _, p in ipairs(cases) do check(subject, p) end
+check("", "^$")
+check("aaa", "a-")
+check("((a)(b))", "%b()")
+
+-- malformed patterns raise the same error every time
+local bad = {
+  "(", "a(", "((a)", ")", "a)", "%", "a%", "[a", "[", "[^", "[%", "%b", "%ba",
+  "%f", "%fa", "%1", "(a)%2", "(a%1)", "%f[a", "(()",
+}
+for _, p in ipairs(bad) do
+  for _, op in ipairs(ops) do
+    flush()
+    local ok1, e1 = pcall(op, subject, p)
+    local ok2, e2 = pcall(op, subject, p)
+    local ok3, e3 = pcall(op, subject, p)
+    assert(ok1 == ok2 and ok2 == ok3 and e1 == e2 and e2 == e3, p)
+  end
+end
+assert(not pcall(find, subject, "("))
+
+-- random patterns, fixed seed
+local pieces = {
+  "a", "b", "%a", "%d", "%s", ".", "[ab]", "[^a]", "%w", "(", ")", "()", "%1",
+  "%b()", "%f[%a]", "^", "$", "*", "+", "-", "?", "[%a%d]", "%", "x", " ",
+}
+local subjects = { subject, "abba (a) 12 b", "aaa bbb ab ba", "" }
+math.randomseed(42)
+for n = 1, 400 do
+  local t = {}
+  for i = 1, math.random(1, 6) do t[i] = pieces[math.random(#pieces)] end
+  check(subjects[n % #subjects + 1], table.concat(t))
+end
+
+-- a gsub callback pushes the pattern in use out of the cache and collects
+-- it; the match must go on with the same program
+local p = "(%a+)%s*"
+local s = "one two three four"
+assert(gsub(s, p, "%1,") == "one,two,three,four,")
+assert(gsub(s, p, "%1,") == "one,two,three,four,")  -- now compiled
+local calls = 0
+local r, n = gsub(s, p, function(w)
+  calls = calls + 1
+  for i = 1, 20 do
+    local q = "^evict" .. calls .. "_" .. i
+    find(w, q)
+    find(w, q)  -- compiled, so the cache holds programs too
+  end
+  collectgarbage()
+  return w:upper() .. ","
+end)
+assert(r == "ONE,TWO,THREE,FOUR," and n == 4 and calls == 4)
+
+-- and the same for gmatch, whose program lives in the iterator
+local it = gmatch(s, p)
+local words = {}
+for w in it do
+  words[#words + 1] = w
+  flush()
+  collectgarbage()
+end
+assert(table.concat(words, ",") == "one,two,three,four")
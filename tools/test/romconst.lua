@@ -0,0 +1,23 @@
+-- ROM module constants (luac.cross -c): a field read is folded to its
+-- number, but a field that is assigned or defined as a function is a
+-- compile error instead of a store that is silently dropped.
+
+local reg = debug.getregistry()
+local saved = reg._ROMCONST
+reg._ROMCONST = { romtest = { K = 7 } }
+
+-- folded: romtest is nil at run time
+assert(loadstring("return romtest.K + 1")() == 8)
+-- not folded: a local of the module's name, or a key not in the manifest
+assert(loadstring("local romtest = { K = 3 } return romtest.K")() == 3)
+assert(not pcall(loadstring("return romtest.L")))
+
+local function rejects(src)
+  local f, err = loadstring(src)
+  assert(f == nil and err:find("cannot assign to a constant"), src)
+end
+rejects("function romtest.K() end")
+rejects("romtest.K = 1")
+rejects("local a; a, romtest.K = 1, 2")
+
+reg._ROMCONST = saved
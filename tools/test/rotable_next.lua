@@ -0,0 +1,37 @@
+-- next() over ROM tables: each step is found from the key passed in, so
+-- nested and interleaved iterations see every entry exactly once.
+
+local function keys(t)
+  local n, seen = 0, {}
+  for k, v in pairs(t) do
+    assert(not seen[k] and rawget(t, k) == v)
+    seen[k] = true
+    n = n + 1
+  end
+  return n, seen
+end
+
+local nmath, mathkeys = keys(math)
+local nstring = keys(string)
+assert(nmath > 0 and nstring > 0 and mathkeys.floor)
+
+-- the same table nested in itself, and two tables interleaved
+local outer = 0
+for k in pairs(math) do
+  outer = outer + 1
+  assert(keys(math) == nmath)
+end
+assert(outer == nmath)
+
+local km, ks, n = next(math), next(string), 0
+while km or ks do
+  if km then km = next(math, km) end
+  if ks then ks = next(string, ks) end
+  n = n + 1
+end
+assert(n == math.max(nmath, nstring))
+
+-- a key that is not the string handed out by next(), and one not in the table
+local k = next(math)
+assert(next(math, (k .. "x"):sub(1, #k)) == next(math, k))
+assert(next(math, "nosuchkey") == nil)
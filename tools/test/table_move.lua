@@ -0,0 +1,39 @@
+-- table.move: overlapping ranges are copied in the right order whether the
+-- destination is left out or is the source table passed again.
+
+local move = table.move
+
+local function check(t, expect)
+  assert(#t == #expect)
+  for i = 1, #expect do assert(t[i] == expect[i]) end
+end
+
+-- destination above the source: copied from the top down
+local t = { 1, 2, 3 }
+assert(move(t, 1, 3, 2) == t)
+check(t, { 1, 1, 2, 3 })
+
+t = { 1, 2, 3 }
+assert(move(t, 1, 3, 2, t) == t)
+check(t, { 1, 1, 2, 3 })
+
+-- destination below the source: copied from the bottom up
+t = { 1, 2, 3, 4 }
+move(t, 2, 4, 1, t)
+check(t, { 2, 3, 4, 4 })
+
+-- another table is never overlapping
+t = { 1, 2, 3 }
+local d = { 9, 9 }
+assert(move(t, 1, 3, 2, d) == d)
+check(d, { 9, 1, 2, 3 })
+check(t, { 1, 2, 3 })
+
+-- empty range
+t = { 1, 2 }
+move(t, 3, 2, 1, t)
+check(t, { 1, 2 })
+
+-- bad ranges
+assert(not pcall(move, t, -1, 0x7fffffff, 1))
+assert(not pcall(move, t, 1, 2, 0x7fffffff))